@@ -0,0 +1,41 @@
+#pragma once
+
+// Axis-Aligned Bounding Boxes
+
+#include "mat4f.h"
+#include "vec3f.h"
+
+#include <math.h>
+#include <stdbool.h>
+
+// Axis-aligned bounding box.
+typedef struct aabb_t
+{
+	vec3f_t min;
+	vec3f_t max;
+} aabb_t;
+
+// Determine if two boxes overlap. Touching boxes overlap.
+__forceinline bool aabb_overlaps(const aabb_t* a, const aabb_t* b)
+{
+	return a->min.x <= b->max.x && b->min.x <= a->max.x &&
+		a->min.y <= b->max.y && b->min.y <= a->max.y &&
+		a->min.z <= b->max.z && b->min.z <= a->max.z;
+}
+
+// Compute the box enclosing a box transformed by a matrix: scale, rotation and translation.
+__forceinline void aabb_transform(aabb_t* result, const aabb_t* box, const mat4f_t* m)
+{
+	for (int j = 0; j < 3; ++j)
+	{
+		float center = m->data[3][j];
+		float extent = 0.0f;
+		for (int i = 0; i < 3; ++i)
+		{
+			center += 0.5f * (box->min.a[i] + box->max.a[i]) * m->data[i][j];
+			extent += 0.5f * (box->max.a[i] - box->min.a[i]) * fabsf(m->data[i][j]);
+		}
+		result->min.a[j] = center - extent;
+		result->max.a[j] = center + extent;
+	}
+}
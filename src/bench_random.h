@@ -0,0 +1,24 @@
+#pragma once
+
+// Benchmark Random Numbers
+// Small, fast and repeatable xorshift32 generator shared by the benchmarks.
+// State must start nonzero; each benchmark seeds its own so runs are comparable.
+
+#include <stdint.h>
+
+// Advance the state and return the next 32 random bits.
+__forceinline uint32_t bench_random(uint32_t* state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+// Return a random float in [min, max].
+__forceinline float bench_randomf(uint32_t* state, float min, float max)
+{
+	return min + (max - min) * (float)(bench_random(state) & 0xffffff) / (float)0xffffff;
+}
@@ -0,0 +1,508 @@
+#include "collision.h"
+
+#include "heap.h"
+#include "mat4f.h"
+
+#include <math.h>
+#include <string.h>
+
+enum
+{
+	// Cell coordinates are clamped so far-away boxes cannot overflow them.
+	k_max_cell_coord = 1 << 20,
+};
+
+// Tracked entity.
+typedef struct proxy_t
+{
+	ecs_entity_ref_t ref;
+	aabb_t box;
+	uint32_t layers;
+	// Grid cell holding the box center.
+	int cell[3];
+	// Neighbors in the list of the cell's bucket, or -1.
+	int next;
+	int prev;
+	// Box must be recomputed on the next update.
+	bool stale;
+} proxy_t;
+
+typedef struct collision_t
+{
+	heap_t* heap;
+	ecs_t* ecs;
+	int world_transform_type;
+	int aabb_type;
+
+	// Changes stamped at or after this version have not been processed yet.
+	uint32_t last_version;
+
+	int capacity;
+	int proxy_count;
+	proxy_t* proxies;
+
+	// Proxy index of each entity slot, or -1.
+	int* entity_proxies;
+
+	// Spatial hash grid.
+	// Proxies of bucket b are linked from bucket_heads[b] through proxy_t::next.
+	// Different cells can share a bucket; proxies are matched by cell when visited.
+	float cell_size;
+	float inv_cell_size;
+	uint32_t bucket_count;
+	int* bucket_heads;
+	bool grid_dirty;
+
+	// Largest half size of any box on each axis, bounding how far a box reaches from its cell.
+	vec3f_t max_half_size;
+} collision_t;
+
+static bool has_proxy_components(collision_t* collision, ecs_entity_ref_t ref);
+static void add_proxy(collision_t* collision, ecs_entity_ref_t ref);
+static void remove_destroyed_proxies(collision_t* collision);
+static int refresh_boxes(collision_t* collision);
+static void update_max_half_size(collision_t* collision);
+static void rebuild_grid(collision_t* collision);
+static void link_proxy(collision_t* collision, int proxy);
+static void unlink_proxy(collision_t* collision, int proxy);
+static void compute_cell(collision_t* collision, vec3f_t point, int cell[3]);
+static bool get_cell_range(collision_t* collision, const aabb_t* box, int lo[3], int hi[3]);
+static uint32_t hash_cell(collision_t* collision, int x, int y, int z);
+static bool query_box(collision_t* collision, const aabb_t* box, uint32_t layers, int query, collision_hit_t* hits, int* hit_count, int max_hits);
+static bool pair_proxy(collision_t* collision, int i, uint32_t layers_a, uint32_t layers_b, collision_pair_t* pairs, int* pair_count, int max_pairs);
+
+collision_t* collision_create(heap_t* heap, ecs_t* ecs, int world_transform_type)
+{
+	collision_t* collision = heap_alloc(heap, sizeof(collision_t), 8);
+	memset(collision, 0, sizeof(*collision));
+	collision->heap = heap;
+	collision->ecs = ecs;
+	collision->world_transform_type = world_transform_type;
+	collision->aabb_type = ecs_register_component_type(ecs, "aabb", sizeof(aabb_component_t), _Alignof(aabb_component_t), k_ecs_storage_dense);
+
+	int capacity = ecs_get_entity_capacity(ecs);
+	collision->capacity = capacity;
+	collision->proxies = heap_alloc(heap, sizeof(proxy_t) * capacity, 8);
+	collision->entity_proxies = heap_alloc(heap, sizeof(int) * capacity, 8);
+	memset(collision->entity_proxies, 0xff, sizeof(int) * capacity);
+
+	// Twice as many buckets as entities keeps most buckets to one cell.
+	collision->bucket_count = 1;
+	while (collision->bucket_count < (uint32_t)capacity * 2)
+	{
+		collision->bucket_count <<= 1;
+	}
+	collision->bucket_heads = heap_alloc(heap, sizeof(int) * collision->bucket_count, 8);
+	memset(collision->bucket_heads, 0xff, sizeof(int) * collision->bucket_count);
+	collision->cell_size = 1.0f;
+	collision->inv_cell_size = 1.0f;
+	return collision;
+}
+
+void collision_destroy(collision_t* collision)
+{
+	heap_free(collision->heap, collision->bucket_heads);
+	heap_free(collision->heap, collision->entity_proxies);
+	heap_free(collision->heap, collision->proxies);
+	heap_free(collision->heap, collision);
+}
+
+int collision_get_aabb_type(collision_t* collision)
+{
+	return collision->aabb_type;
+}
+
+void collision_update(collision_t* collision)
+{
+	remove_destroyed_proxies(collision);
+
+	int spawned_count = 0;
+	const ecs_entity_ref_t* spawned = ecs_get_spawned_entities(collision->ecs, &spawned_count);
+	for (int i = 0; i < spawned_count; ++i)
+	{
+		if (has_proxy_components(collision, spawned[i]))
+		{
+			add_proxy(collision, spawned[i]);
+		}
+	}
+
+	if (refresh_boxes(collision) > 0 || collision->grid_dirty)
+	{
+		update_max_half_size(collision);
+	}
+	if (collision->grid_dirty)
+	{
+		rebuild_grid(collision);
+	}
+
+	collision->last_version = ecs_get_version(collision->ecs);
+}
+
+void collision_reset(collision_t* collision)
+{
+	collision->proxy_count = 0;
+	memset(collision->entity_proxies, 0xff, sizeof(int) * collision->capacity);
+
+	ecs_mask_t mask = ECS_MASK(collision->aabb_type);
+	for (ecs_query_t query = ecs_query_create(collision->ecs, mask);
+		ecs_query_is_valid(collision->ecs, &query);
+		ecs_query_next(collision->ecs, &query))
+	{
+		ecs_entity_ref_t ref = ecs_query_get_entity(collision->ecs, &query);
+		if (has_proxy_components(collision, ref))
+		{
+			add_proxy(collision, ref);
+		}
+	}
+	collision->grid_dirty = true;
+	collision->last_version = 0;
+}
+
+bool collision_get_world_aabb(collision_t* collision, ecs_entity_ref_t ref, aabb_t* box)
+{
+	if (ref.entity < 0 || ref.entity >= collision->capacity)
+	{
+		return false;
+	}
+	int proxy = collision->entity_proxies[ref.entity];
+	if (proxy < 0 || collision->proxies[proxy].ref.sequence != ref.sequence)
+	{
+		return false;
+	}
+	*box = collision->proxies[proxy].box;
+	return true;
+}
+
+int collision_query_boxes(collision_t* collision, const aabb_t* boxes, int box_count, uint32_t layers, collision_hit_t* hits, int max_hits)
+{
+	int hit_count = 0;
+	for (int q = 0; q < box_count; ++q)
+	{
+		if (!query_box(collision, &boxes[q], layers, q, hits, &hit_count, max_hits))
+		{
+			break;
+		}
+	}
+	return hit_count;
+}
+
+int collision_find_pairs(collision_t* collision, uint32_t layers_a, uint32_t layers_b, collision_pair_t* pairs, int max_pairs)
+{
+	int pair_count = 0;
+	for (int i = 0; i < collision->proxy_count; ++i)
+	{
+		if ((collision->proxies[i].layers & (layers_a | layers_b)) &&
+			!pair_proxy(collision, i, layers_a, layers_b, pairs, &pair_count, max_pairs))
+		{
+			break;
+		}
+	}
+	return pair_count;
+}
+
+static bool has_proxy_components(collision_t* collision, ecs_entity_ref_t ref)
+{
+	return ecs_entity_get_component_const(collision->ecs, ref, collision->aabb_type, false) &&
+		ecs_entity_get_component_const(collision->ecs, ref, collision->world_transform_type, false);
+}
+
+static void add_proxy(collision_t* collision, ecs_entity_ref_t ref)
+{
+	int proxy = collision->entity_proxies[ref.entity];
+	if (proxy >= 0 && collision->proxies[proxy].ref.sequence == ref.sequence)
+	{
+		return;
+	}
+
+	proxy = collision->proxy_count++;
+	collision->proxies[proxy] = (proxy_t) { .ref = ref, .stale = true };
+	collision->entity_proxies[ref.entity] = proxy;
+	collision->grid_dirty = true;
+}
+
+static void remove_destroyed_proxies(collision_t* collision)
+{
+	int destroyed_count = 0;
+	const ecs_entity_ref_t* destroyed = ecs_get_destroyed_entities(collision->ecs, &destroyed_count);
+
+	int removed = 0;
+	for (int i = 0; i < destroyed_count; ++i)
+	{
+		int proxy = collision->entity_proxies[destroyed[i].entity];
+		if (proxy >= 0 && collision->proxies[proxy].ref.sequence == destroyed[i].sequence)
+		{
+			collision->proxies[proxy].ref.entity = -1;
+			collision->entity_proxies[destroyed[i].entity] = -1;
+			++removed;
+		}
+	}
+	if (!removed)
+	{
+		return;
+	}
+
+	proxy_t* proxies = collision->proxies;
+	int count = 0;
+	for (int i = 0; i < collision->proxy_count; ++i)
+	{
+		if (proxies[i].ref.entity < 0)
+		{
+			continue;
+		}
+		proxies[count] = proxies[i];
+		collision->entity_proxies[proxies[count].ref.entity] = count;
+		++count;
+	}
+	collision->proxy_count = count;
+	collision->grid_dirty = true;
+}
+
+static int refresh_boxes(collision_t* collision)
+{
+	proxy_t* proxies = collision->proxies;
+	ecs_mask_t changed_mask = ECS_MASK(collision->world_transform_type, collision->aabb_type);
+
+	// Refresh proxies whose world transform or box changed.
+	int changed_count = 0;
+	for (int i = 0; i < collision->proxy_count; ++i)
+	{
+		if (!proxies[i].stale &&
+			ecs_entity_get_version(collision->ecs, proxies[i].ref, changed_mask, false) < collision->last_version)
+		{
+			continue;
+		}
+		changed_count++;
+
+		proxy_t* proxy = &proxies[i];
+		const mat4f_t* world = ecs_entity_get_component_const(collision->ecs, proxy->ref, collision->world_transform_type, false);
+		const aabb_component_t* aabb = ecs_entity_get_component_const(collision->ecs, proxy->ref, collision->aabb_type, false);
+		aabb_transform(&proxy->box, &aabb->local, world);
+		proxy->layers = aabb->layers;
+		proxy->stale = false;
+
+		// Relink only proxies that changed cell. A dirty grid is rebuilt in full after this.
+		int cell[3];
+		compute_cell(collision, vec3f_scale(vec3f_add(proxy->box.min, proxy->box.max), 0.5f), cell);
+		if (!collision->grid_dirty && (cell[0] != proxy->cell[0] || cell[1] != proxy->cell[1] || cell[2] != proxy->cell[2]))
+		{
+			unlink_proxy(collision, i);
+			memcpy(proxy->cell, cell, sizeof(cell));
+			link_proxy(collision, i);
+		}
+	}
+	return changed_count;
+}
+
+static void update_max_half_size(collision_t* collision)
+{
+	vec3f_t max_half_size = vec3f_zero();
+	for (int i = 0; i < collision->proxy_count; ++i)
+	{
+		const aabb_t* box = &collision->proxies[i].box;
+		max_half_size = vec3f_max(max_half_size, vec3f_scale(vec3f_sub(box->max, box->min), 0.5f));
+	}
+	collision->max_half_size = max_half_size;
+}
+
+static void rebuild_grid(collision_t* collision)
+{
+	proxy_t* proxies = collision->proxies;
+	int count = collision->proxy_count;
+
+	// Cells twice the average box size keep most boxes to one cell and most queries to a few.
+	// Resize only on large drift; every cell is recomputed below either way.
+	double size_sum = 0.0;
+	for (int i = 0; i < count; ++i)
+	{
+		vec3f_t size = vec3f_sub(proxies[i].box.max, proxies[i].box.min);
+		size_sum += __max(size.x, __max(size.y, size.z));
+	}
+	float ideal = count ? (float)(2.0 * size_sum / count) : 1.0f;
+	ideal = __max(ideal, 1e-3f);
+	if (ideal > collision->cell_size * 2.0f || ideal < collision->cell_size * 0.5f)
+	{
+		collision->cell_size = ideal;
+		collision->inv_cell_size = 1.0f / ideal;
+	}
+
+	// Linking in reverse leaves each bucket in proxy order.
+	memset(collision->bucket_heads, 0xff, sizeof(int) * collision->bucket_count);
+	for (int i = count - 1; i >= 0; --i)
+	{
+		compute_cell(collision, vec3f_scale(vec3f_add(proxies[i].box.min, proxies[i].box.max), 0.5f), proxies[i].cell);
+		link_proxy(collision, i);
+	}
+
+	collision->grid_dirty = false;
+}
+
+static void link_proxy(collision_t* collision, int proxy)
+{
+	proxy_t* p = &collision->proxies[proxy];
+	int* head = &collision->bucket_heads[hash_cell(collision, p->cell[0], p->cell[1], p->cell[2])];
+	p->prev = -1;
+	p->next = *head;
+	if (*head >= 0)
+	{
+		collision->proxies[*head].prev = proxy;
+	}
+	*head = proxy;
+}
+
+static void unlink_proxy(collision_t* collision, int proxy)
+{
+	proxy_t* p = &collision->proxies[proxy];
+	if (p->prev >= 0)
+	{
+		collision->proxies[p->prev].next = p->next;
+	}
+	else
+	{
+		collision->bucket_heads[hash_cell(collision, p->cell[0], p->cell[1], p->cell[2])] = p->next;
+	}
+	if (p->next >= 0)
+	{
+		collision->proxies[p->next].prev = p->prev;
+	}
+}
+
+static void compute_cell(collision_t* collision, vec3f_t point, int cell[3])
+{
+	for (int j = 0; j < 3; ++j)
+	{
+		float coord = floorf(point.a[j] * collision->inv_cell_size);
+		coord = __max(coord, (float)-k_max_cell_coord);
+		coord = __min(coord, (float)k_max_cell_coord);
+		cell[j] = (int)coord;
+	}
+}
+
+// Get the range of cells holding the centers of boxes that can overlap a box.
+// Returns false if the range spans more cells than there are proxies,
+// in which case testing every proxy is cheaper.
+static bool get_cell_range(collision_t* collision, const aabb_t* box, int lo[3], int hi[3])
+{
+	compute_cell(collision, vec3f_sub(box->min, collision->max_half_size), lo);
+	compute_cell(collision, vec3f_add(box->max, collision->max_half_size), hi);
+	double cell_count = (double)(hi[0] - lo[0] + 1) * (double)(hi[1] - lo[1] + 1) * (double)(hi[2] - lo[2] + 1);
+	return cell_count <= (double)collision->proxy_count;
+}
+
+static uint32_t hash_cell(collision_t* collision, int x, int y, int z)
+{
+	uint32_t hash = ((uint32_t)x * 73856093u) ^ ((uint32_t)y * 19349663u) ^ ((uint32_t)z * 83492791u);
+	return hash & (collision->bucket_count - 1);
+}
+
+// Add a hit if the proxy is on the layers and overlaps the query box.
+// Returns false if out of space.
+static bool add_hit(const proxy_t* proxy, const aabb_t* box, uint32_t layers, int query, collision_hit_t* hits, int* hit_count, int max_hits)
+{
+	if (!(proxy->layers & layers) || !aabb_overlaps(&proxy->box, box))
+	{
+		return true;
+	}
+	if (*hit_count >= max_hits)
+	{
+		return false;
+	}
+	hits[(*hit_count)++] = (collision_hit_t) { .query = query, .entity = proxy->ref };
+	return true;
+}
+
+// Add a pair if one proxy is on layers_a, the other on layers_b, and they overlap.
+// Returns false if out of space.
+static bool add_pair(const proxy_t* a, const proxy_t* b, uint32_t layers_a, uint32_t layers_b, collision_pair_t* pairs, int* pair_count, int max_pairs)
+{
+	bool forward = (a->layers & layers_a) && (b->layers & layers_b);
+	bool backward = (a->layers & layers_b) && (b->layers & layers_a);
+	if ((!forward && !backward) || !aabb_overlaps(&a->box, &b->box))
+	{
+		return true;
+	}
+	if (*pair_count >= max_pairs)
+	{
+		return false;
+	}
+	pairs[(*pair_count)++] = forward ?
+		(collision_pair_t) { .a = a->ref, .b = b->ref } :
+		(collision_pair_t) { .a = b->ref, .b = a->ref };
+	return true;
+}
+
+static bool query_box(collision_t* collision, const aabb_t* box, uint32_t layers, int query, collision_hit_t* hits, int* hit_count, int max_hits)
+{
+	const proxy_t* proxies = collision->proxies;
+	int lo[3], hi[3];
+	if (!get_cell_range(collision, box, lo, hi))
+	{
+		for (int i = 0; i < collision->proxy_count; ++i)
+		{
+			if (!add_hit(&proxies[i], box, layers, query, hits, hit_count, max_hits))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	for (int z = lo[2]; z <= hi[2]; ++z)
+	{
+		for (int y = lo[1]; y <= hi[1]; ++y)
+		{
+			for (int x = lo[0]; x <= hi[0]; ++x)
+			{
+				uint32_t bucket = hash_cell(collision, x, y, z);
+				for (int k = collision->bucket_heads[bucket]; k >= 0; k = proxies[k].next)
+				{
+					const proxy_t* proxy = &proxies[k];
+					if (proxy->cell[0] == x && proxy->cell[1] == y && proxy->cell[2] == z &&
+						!add_hit(proxy, box, layers, query, hits, hit_count, max_hits))
+					{
+						return false;
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// Add pairs of proxy i with later proxies, so each pair is found once.
+static bool pair_proxy(collision_t* collision, int i, uint32_t layers_a, uint32_t layers_b, collision_pair_t* pairs, int* pair_count, int max_pairs)
+{
+	const proxy_t* proxies = collision->proxies;
+	int lo[3], hi[3];
+	if (!get_cell_range(collision, &proxies[i].box, lo, hi))
+	{
+		for (int j = i + 1; j < collision->proxy_count; ++j)
+		{
+			if (!add_pair(&proxies[i], &proxies[j], layers_a, layers_b, pairs, pair_count, max_pairs))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	for (int z = lo[2]; z <= hi[2]; ++z)
+	{
+		for (int y = lo[1]; y <= hi[1]; ++y)
+		{
+			for (int x = lo[0]; x <= hi[0]; ++x)
+			{
+				uint32_t bucket = hash_cell(collision, x, y, z);
+				for (int j = collision->bucket_heads[bucket]; j >= 0; j = proxies[j].next)
+				{
+					const proxy_t* proxy = &proxies[j];
+					if (j > i && proxy->cell[0] == x && proxy->cell[1] == y && proxy->cell[2] == z &&
+						!add_pair(&proxies[i], proxy, layers_a, layers_b, pairs, pair_count, max_pairs))
+					{
+						return false;
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
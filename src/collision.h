@@ -0,0 +1,79 @@
+#pragma once
+
+// Collision Broadphase
+// Axis-aligned bounding boxes on entities and overlap queries against them.
+// World boxes are bucketed by center in a uniform spatial hash grid,
+// with cells sized from the average box so a query only visits nearby cells.
+// Only entities whose world transform or box changed are refreshed, and a box that moves to another
+// cell is relinked alone. The grid, and its cell size, is only rebuilt when entities come and go.
+
+#include "aabb.h"
+#include "ecs.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct heap_t heap_t;
+
+// Handle to a collision system.
+typedef struct collision_t collision_t;
+
+// Bounding box of an entity.
+typedef struct aabb_component_t
+{
+	// Box in the local space of the entity.
+	// The world box encloses it after the world transform.
+	aabb_t local;
+	// Collision layers the entity is on, one bit per layer.
+	uint32_t layers;
+} aabb_component_t;
+
+// Two entities whose world boxes overlap.
+typedef struct collision_pair_t
+{
+	ecs_entity_ref_t a;
+	ecs_entity_ref_t b;
+} collision_pair_t;
+
+// An entity whose world box overlaps a query box.
+typedef struct collision_hit_t
+{
+	// Index of the query box.
+	int query;
+	ecs_entity_ref_t entity;
+} collision_hit_t;
+
+// Create a collision system and register its component type with the entity system.
+// World transform type is the world space matrix component; it must begin with a mat4f_t,
+// e.g. hierarchy_get_world_transform_type().
+collision_t* collision_create(heap_t* heap, ecs_t* ecs, int world_transform_type);
+
+// Destroy a collision system.
+void collision_destroy(collision_t* collision);
+
+// Get the component type holding aabb_component_t.
+int collision_get_aabb_type(collision_t* collision);
+
+// Per-frame collision update. Call once after each ecs_update() and after world transforms
+// are written, e.g. after hierarchy_update().
+// Entities with world transform and aabb components are tracked.
+// Picks up spawned and destroyed entities and refreshes world boxes of entities that changed.
+void collision_update(collision_t* collision);
+
+// Rebuild the broadphase from the entity system, e.g. after ecs_load().
+void collision_reset(collision_t* collision);
+
+// Get the world box of an entity as of the last update.
+// Returns false if the entity is not tracked.
+bool collision_get_world_aabb(collision_t* collision, ecs_entity_ref_t ref, aabb_t* box);
+
+// Find entities on any of the given layers whose world boxes overlap any of box_count query boxes.
+// At most max_hits hits are written, grouped by query in order.
+// Returns the number of hits written.
+int collision_query_boxes(collision_t* collision, const aabb_t* boxes, int box_count, uint32_t layers, collision_hit_t* hits, int max_hits);
+
+// Find every pair of overlapping entities where one is on layers_a and the other on layers_b.
+// Pair order within the list is unspecified; when both entities qualify either way,
+// the pair is reported once.
+// At most max_pairs pairs are written. Returns the number of pairs written.
+int collision_find_pairs(collision_t* collision, uint32_t layers_a, uint32_t layers_b, collision_pair_t* pairs, int max_pairs);
@@ -0,0 +1,203 @@
+#include "collision_bench.h"
+
+#include "bench_random.h"
+#include "collision.h"
+#include "debug.h"
+#include "ecs.h"
+#include "heap.h"
+#include "hierarchy.h"
+#include "timer.h"
+#include "transform.h"
+
+#include <stdint.h>
+
+enum
+{
+	k_bench_box_count = 100000,
+	k_bench_query_count = 1000,
+	k_bench_frames = 8,
+	k_bench_max_hits = 1 << 20,
+};
+
+static const float k_bench_world_size = 150.0f;
+
+typedef struct bench_world_t
+{
+	heap_t* heap;
+	ecs_t* ecs;
+	hierarchy_t* hierarchy;
+	collision_t* collision;
+	int transform_type;
+	vec3f_t* velocities;
+	aabb_t* queries;
+	collision_hit_t* hits;
+	collision_pair_t* pairs;
+	uint32_t rng;
+} bench_world_t;
+
+static vec3f_t bench_random_vec3f(bench_world_t* world, float min, float max)
+{
+	return (vec3f_t) { .x = bench_randomf(&world->rng, min, max), .y = bench_randomf(&world->rng, min, max), .z = bench_randomf(&world->rng, min, max) };
+}
+
+static double bench_ms(uint64_t ticks)
+{
+	return (double)ticks * 1000.0 / (double)timer_get_ticks_per_second();
+}
+
+static void spawn_boxes(bench_world_t* world)
+{
+	int aabb_type = collision_get_aabb_type(world->collision);
+	int hierarchy_type = hierarchy_get_component_type(world->hierarchy);
+	int prefab = ecs_register_prefab(world->ecs,
+		ECS_MASK(world->transform_type, aabb_type, hierarchy_type, hierarchy_get_world_transform_type(world->hierarchy)));
+	transform_identity(ecs_prefab_get_component(world->ecs, prefab, world->transform_type));
+	hierarchy_component_t* hierarchy_comp = ecs_prefab_get_component(world->ecs, prefab, hierarchy_type);
+	hierarchy_comp->parent = (ecs_entity_ref_t) { .entity = -1, .sequence = -1 };
+	aabb_component_t* aabb = ecs_prefab_get_component(world->ecs, prefab, aabb_type);
+	aabb->local = (aabb_t) { .min = vec3f_scale(vec3f_one(), -1.0f), .max = vec3f_one() };
+	aabb->layers = 1;
+	ecs_spawn_batch(world->ecs, prefab, k_bench_box_count, NULL);
+
+	transform_t* transforms = ECS_COLUMN(world->ecs, transform_t, world->transform_type);
+	for (int i = 0; i < k_bench_box_count; ++i)
+	{
+		transforms[i].translation = bench_random_vec3f(world, 0.0f, k_bench_world_size);
+		transforms[i].scale = bench_random_vec3f(world, 0.25f, 1.0f);
+		world->velocities[i] = bench_random_vec3f(world, -0.5f, 0.5f);
+	}
+}
+
+static void move_boxes(bench_world_t* world)
+{
+	ecs_mask_t mask = ECS_MASK(world->transform_type);
+	transform_t* transforms = ECS_COLUMN(world->ecs, transform_t, world->transform_type);
+	for (ecs_view_t view = ecs_view_create(world->ecs, mask, mask);
+		ecs_view_is_valid(world->ecs, &view);
+		ecs_view_next(world->ecs, &view))
+	{
+		for (int i = view.begin; i < view.end; ++i)
+		{
+			vec3f_t* position = &transforms[i].translation;
+			vec3f_t* velocity = &world->velocities[i];
+			*position = vec3f_add(*position, *velocity);
+			for (int j = 0; j < 3; ++j)
+			{
+				if (position->a[j] < 0.0f || position->a[j] > k_bench_world_size)
+				{
+					velocity->a[j] = -velocity->a[j];
+				}
+			}
+		}
+	}
+}
+
+// The path the broadphase replaces: test each query box against every entity's box built from its transform.
+static int query_brute_force(bench_world_t* world)
+{
+	ecs_mask_t mask = ECS_MASK(world->transform_type);
+	const transform_t* transforms = ECS_COLUMN(world->ecs, transform_t, world->transform_type);
+	int hit_count = 0;
+	for (int q = 0; q < k_bench_query_count; ++q)
+	{
+		for (ecs_view_t view = ecs_view_create(world->ecs, mask, ecs_mask_empty());
+			ecs_view_is_valid(world->ecs, &view);
+			ecs_view_next(world->ecs, &view))
+		{
+			for (int i = view.begin; i < view.end; ++i)
+			{
+				aabb_t box =
+				{
+					.min = vec3f_sub(transforms[i].translation, transforms[i].scale),
+					.max = vec3f_add(transforms[i].translation, transforms[i].scale),
+				};
+				hit_count += aabb_overlaps(&box, &world->queries[q]);
+			}
+		}
+	}
+	return hit_count;
+}
+
+bool collision_bench_run(heap_t* heap)
+{
+	bench_world_t world = { .heap = heap, .rng = 0x6a09e667 };
+	world.ecs = ecs_create(heap, k_bench_box_count);
+	world.transform_type = ecs_register_component_type(world.ecs, "transform", sizeof(transform_t), _Alignof(transform_t), k_ecs_storage_dense);
+	world.hierarchy = hierarchy_create(heap, world.ecs, world.transform_type);
+	world.collision = collision_create(heap, world.ecs, hierarchy_get_world_transform_type(world.hierarchy));
+	world.velocities = heap_alloc(heap, sizeof(vec3f_t) * k_bench_box_count, 8);
+	world.queries = heap_alloc(heap, sizeof(aabb_t) * k_bench_query_count, 8);
+	world.hits = heap_alloc(heap, sizeof(collision_hit_t) * k_bench_max_hits, 8);
+	world.pairs = heap_alloc(heap, sizeof(collision_pair_t) * k_bench_max_hits, 8);
+
+	// Boxes are hierarchy roots, so their world matrices come from their local transforms.
+	spawn_boxes(&world);
+	ecs_update(world.ecs);
+	hierarchy_update(world.hierarchy);
+	uint64_t t0 = timer_get_ticks();
+	collision_update(world.collision);
+	uint64_t build_ticks = timer_get_ticks() - t0;
+
+	debug_print(k_print_info, "--- collision (%d moving boxes, %d query boxes) ---\n", k_bench_box_count, k_bench_query_count);
+	debug_print(k_print_info, "%-28s %10.3f ms\n", "initial build", bench_ms(build_ticks));
+
+	bool valid = true;
+	uint64_t world_ticks = 0;
+	uint64_t update_ticks = 0;
+	uint64_t query_ticks = 0;
+	uint64_t brute_ticks = 0;
+	uint64_t pair_ticks = 0;
+	int pair_count = 0;
+	for (int frame = 0; frame < k_bench_frames; ++frame)
+	{
+		move_boxes(&world);
+		ecs_update(world.ecs);
+
+		t0 = timer_get_ticks();
+		hierarchy_update(world.hierarchy);
+		world_ticks += timer_get_ticks() - t0;
+
+		t0 = timer_get_ticks();
+		collision_update(world.collision);
+		update_ticks += timer_get_ticks() - t0;
+
+		for (int q = 0; q < k_bench_query_count; ++q)
+		{
+			vec3f_t center = bench_random_vec3f(&world, 0.0f, k_bench_world_size);
+			world.queries[q] = (aabb_t) { .min = vec3f_sub(center, vec3f_scale(vec3f_one(), 2.0f)), .max = vec3f_add(center, vec3f_scale(vec3f_one(), 2.0f)) };
+		}
+
+		t0 = timer_get_ticks();
+		int hit_count = collision_query_boxes(world.collision, world.queries, k_bench_query_count, 1, world.hits, k_bench_max_hits);
+		query_ticks += timer_get_ticks() - t0;
+
+		t0 = timer_get_ticks();
+		int brute_count = query_brute_force(&world);
+		brute_ticks += timer_get_ticks() - t0;
+
+		if (hit_count != brute_count)
+		{
+			debug_print(k_print_error, "Collision query found %d hits; brute force found %d.\n", hit_count, brute_count);
+			valid = false;
+		}
+
+		t0 = timer_get_ticks();
+		pair_count = collision_find_pairs(world.collision, 1, 1, world.pairs, k_bench_max_hits);
+		pair_ticks += timer_get_ticks() - t0;
+	}
+
+	debug_print(k_print_info, "%-28s %10.3f ms/frame\n", "world transforms (hierarchy)", bench_ms(world_ticks) / k_bench_frames);
+	debug_print(k_print_info, "%-28s %10.3f ms/frame\n", "update (moved)", bench_ms(update_ticks) / k_bench_frames);
+	debug_print(k_print_info, "%-28s %10.3f ms/frame\n", "query boxes (grid)", bench_ms(query_ticks) / k_bench_frames);
+	debug_print(k_print_info, "%-28s %10.3f ms/frame\n", "query boxes (brute force)", bench_ms(brute_ticks) / k_bench_frames);
+	debug_print(k_print_info, "%-28s %10.3f ms/frame (%d pairs)\n", "find pairs (grid)", bench_ms(pair_ticks) / k_bench_frames, pair_count);
+
+	heap_free(heap, world.pairs);
+	heap_free(heap, world.hits);
+	heap_free(heap, world.queries);
+	heap_free(heap, world.velocities);
+	collision_destroy(world.collision);
+	hierarchy_destroy(world.hierarchy);
+	ecs_destroy(world.ecs);
+	return valid;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// Collision Benchmarks
+// Measures broadphase updates and overlap queries over many moving boxes,
+// against testing every query box against every entity.
+
+#include <stdbool.h>
+
+typedef struct heap_t heap_t;
+
+// Run the benchmark and print results.
+// Returns false if broadphase and brute-force queries disagree.
+bool collision_bench_run(heap_t* heap);
@@ -7,112 +7,408 @@
 
 enum
 {
-	k_max_component_types = 64,
-	k_max_entities = 512,
+	k_max_component_types = k_ecs_mask_bits,
+	k_max_prefabs = 64,
+	k_sparse_initial_capacity = 4,
+
+	k_image_magic = 0x31534345, // 'ECS1'
+	k_image_version = 3,
 };
 
 typedef enum entity_state_t
 {
 	k_entity_unused,
+	k_entity_pending_discard,
 	k_entity_pending_add,
 	k_entity_active,
 	k_entity_pending_remove,
 } entity_state_t;
 
+typedef struct component_type_t
+{
+	ecs_storage_t storage;
+	size_t size;
+	size_t alignment;
+	char name[32];
+
+	// Dense storage holds one slot per entity.
+	// Sparse storage holds count packed slots, mapped through sparse and packed_entities.
+	char* data;
+	uint32_t* versions;
+
+	int* sparse;
+	int* packed_entities;
+	int count;
+	int capacity;
+
+	ecs_component_fixup_t fixup;
+	void* fixup_user;
+} component_type_t;
+
+// Binary world image layout:
+//   image_header_t
+//   sequences, entity states and component masks of every entity slot
+//   per component type: image_component_t, data, versions, [sparse, packed entities]
+typedef struct image_header_t
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t world_version;
+	int global_sequence;
+	int entity_count;
+	int component_type_count;
+} image_header_t;
+
+typedef struct image_component_t
+{
+	char name[32];
+	uint32_t storage;
+	uint32_t size;
+	int count;
+} image_component_t;
+
+// Template for spawning entities: component mask plus default data for each component.
+typedef struct prefab_t
+{
+	ecs_mask_t component_mask;
+	char* data;
+	uint32_t offsets[k_max_component_types];
+} prefab_t;
+
 typedef struct ecs_t
 {
 	heap_t* heap;
 	int global_sequence;
+	uint32_t version;
+
+	// Entity table with one slot per possible entity.
+	// Slots at or above high_water_mark have never been used.
+	int entity_capacity;
+	int high_water_mark;
+	int* sequences;
+	entity_state_t* entity_states;
+	ecs_mask_t* component_masks;
+
+	// Stack of retired slots below the high water mark.
+	int* free_slots;
+	int free_count;
 
-	int sequences[k_max_entities];
-	entity_state_t entity_states[k_max_entities];
-	uint64_t component_masks[k_max_entities];
+	// Lifecycle transitions queued for the next ecs_update().
+	ecs_entity_ref_t* pending_adds;
+	int pending_add_count;
+	ecs_entity_ref_t* pending_removes;
+	int pending_remove_count;
 
-	void* components[k_max_component_types];
-	size_t component_type_sizes[k_max_component_types];
-	char component_type_names[k_max_component_types][32];
+	// Lifecycle transitions applied by the last ecs_update().
+	ecs_entity_ref_t* spawned;
+	int spawned_count;
+	ecs_entity_ref_t* destroyed;
+	int destroyed_count;
+
+	int component_type_count;
+	component_type_t component_types[k_max_component_types];
+
+	int prefab_count;
+	prefab_t prefabs[k_max_prefabs];
 } ecs_t;
 
-ecs_t* ecs_create(heap_t* heap)
+static bool is_entity_changed(ecs_t* ecs, int entity, const ecs_mask_t* mask, uint32_t version);
+static bool is_entity_active(ecs_t* ecs, int entity);
+static ecs_query_t query_create(ecs_t* ecs, ecs_mask_t mask, ecs_mask_t exclude_mask, ecs_mask_t changed_mask, uint32_t version);
+static int get_component_slot(component_type_t* type, int entity);
+static int get_component_slot_count(component_type_t* type);
+static void sparse_component_add(ecs_t* ecs, component_type_t* type, int entity);
+static void sparse_component_reserve(ecs_t* ecs, component_type_t* type, int capacity);
+static void component_fixup(ecs_t* ecs, component_type_t* type, char* data, bool is_load);
+static void sparse_component_remove(component_type_t* type, int entity);
+static void rebuild_entity_lists(ecs_t* ecs);
+static void spawn_prefab_run(ecs_t* ecs, prefab_t* prefab, int first, int count, ecs_entity_ref_t* out_refs);
+static void fill_pattern(char* dst, const char* pattern, size_t size, int count);
+
+ecs_t* ecs_create(heap_t* heap, int entity_capacity)
 {
 	ecs_t* ecs = heap_alloc(heap, sizeof(ecs_t), 8);
 	memset(ecs, 0, sizeof(*ecs));
 	ecs->heap = heap;
 	ecs->global_sequence = 1;
+	ecs->version = 1;
+
+	ecs->entity_capacity = entity_capacity;
+	ecs->sequences = heap_alloc(heap, sizeof(int) * entity_capacity, 8);
+	memset(ecs->sequences, 0, sizeof(int) * entity_capacity);
+	ecs->entity_states = heap_alloc(heap, sizeof(entity_state_t) * entity_capacity, 8);
+	memset(ecs->entity_states, 0, sizeof(entity_state_t) * entity_capacity);
+	ecs->component_masks = heap_alloc(heap, sizeof(ecs_mask_t) * entity_capacity, _Alignof(ecs_mask_t));
+	memset(ecs->component_masks, 0, sizeof(ecs_mask_t) * entity_capacity);
+
+	ecs->free_slots = heap_alloc(heap, sizeof(int) * entity_capacity, 8);
+	ecs->pending_adds = heap_alloc(heap, sizeof(ecs_entity_ref_t) * entity_capacity, 8);
+	ecs->pending_removes = heap_alloc(heap, sizeof(ecs_entity_ref_t) * entity_capacity, 8);
+	ecs->spawned = heap_alloc(heap, sizeof(ecs_entity_ref_t) * entity_capacity, 8);
+	ecs->destroyed = heap_alloc(heap, sizeof(ecs_entity_ref_t) * entity_capacity, 8);
 	return ecs;
 }
 
 void ecs_destroy(ecs_t* ecs)
 {
-	for (int i = 0; i < _countof(ecs->components); ++i)
+	for (int i = 0; i < ecs->component_type_count; ++i)
 	{
-		if (ecs->components[i])
+		component_type_t* type = &ecs->component_types[i];
+		heap_free(ecs->heap, type->data);
+		heap_free(ecs->heap, type->versions);
+		if (type->storage == k_ecs_storage_sparse)
 		{
-			heap_free(ecs->heap, ecs->components[i]);
+			heap_free(ecs->heap, type->sparse);
+			heap_free(ecs->heap, type->packed_entities);
 		}
 	}
+	for (int i = 0; i < ecs->prefab_count; ++i)
+	{
+		heap_free(ecs->heap, ecs->prefabs[i].data);
+	}
+	heap_free(ecs->heap, ecs->destroyed);
+	heap_free(ecs->heap, ecs->spawned);
+	heap_free(ecs->heap, ecs->pending_removes);
+	heap_free(ecs->heap, ecs->pending_adds);
+	heap_free(ecs->heap, ecs->free_slots);
+	heap_free(ecs->heap, ecs->component_masks);
+	heap_free(ecs->heap, ecs->entity_states);
+	heap_free(ecs->heap, ecs->sequences);
 	heap_free(ecs->heap, ecs);
 }
 
 void ecs_update(ecs_t* ecs)
 {
-	for (int i = 0; i < _countof(ecs->entity_states); ++i)
+	// Pending lists become this update's event lists; last update's event lists are recycled.
+	ecs_entity_ref_t* spawned = ecs->spawned;
+	ecs->spawned = ecs->pending_adds;
+	ecs->pending_adds = spawned;
+	ecs->spawned_count = 0;
+
+	for (int i = 0; i < ecs->pending_add_count; ++i)
+	{
+		int entity = ecs->spawned[i].entity;
+		if (ecs->entity_states[entity] == k_entity_pending_add)
+		{
+			ecs->entity_states[entity] = k_entity_active;
+			ecs->spawned[ecs->spawned_count++] = ecs->spawned[i];
+		}
+	}
+	ecs->pending_add_count = 0;
+
+	ecs_entity_ref_t* destroyed = ecs->destroyed;
+	ecs->destroyed = ecs->pending_removes;
+	ecs->pending_removes = destroyed;
+	ecs->destroyed_count = 0;
+
+	for (int i = 0; i < ecs->pending_remove_count; ++i)
 	{
-		if (ecs->entity_states[i] == k_entity_pending_add)
+		int entity = ecs->destroyed[i].entity;
+		if (ecs->entity_states[entity] == k_entity_pending_remove)
 		{
-			ecs->entity_states[i] = k_entity_active;
+			ecs->destroyed[ecs->destroyed_count++] = ecs->destroyed[i];
 		}
-		else if (ecs->entity_states[i] == k_entity_pending_remove)
+		ecs->entity_states[entity] = k_entity_unused;
+		ecs->free_slots[ecs->free_count++] = entity;
+		for (int c = 0; c < ecs->component_type_count; ++c)
 		{
-			ecs->entity_states[i] = k_entity_unused;
+			if (ecs->component_types[c].storage == k_ecs_storage_sparse && ecs_mask_test(&ecs->component_masks[entity], c))
+			{
+				sparse_component_remove(&ecs->component_types[c], entity);
+			}
 		}
 	}
+	ecs->pending_remove_count = 0;
+
+	ecs->version++;
+}
+
+const ecs_entity_ref_t* ecs_get_spawned_entities(ecs_t* ecs, int* count)
+{
+	*count = ecs->spawned_count;
+	return ecs->spawned;
+}
+
+const ecs_entity_ref_t* ecs_get_destroyed_entities(ecs_t* ecs, int* count)
+{
+	*count = ecs->destroyed_count;
+	return ecs->destroyed;
+}
+
+uint32_t ecs_get_version(ecs_t* ecs)
+{
+	return ecs->version;
+}
+
+int ecs_get_entity_capacity(ecs_t* ecs)
+{
+	return ecs->entity_capacity;
+}
+
+int ecs_register_component_type(ecs_t* ecs, const char* name, size_t size_per_component, size_t alignment, ecs_storage_t storage)
+{
+	if (ecs->component_type_count >= _countof(ecs->component_types))
+	{
+		debug_print(k_print_warning, "Out of component types.");
+		return -1;
+	}
+
+	int index = ecs->component_type_count++;
+	component_type_t* type = &ecs->component_types[index];
+
+	size_t aligned_size = (size_per_component + (alignment - 1)) & ~(alignment - 1);
+	strcpy_s(type->name, sizeof(type->name), name);
+	type->storage = storage;
+	type->size = aligned_size;
+	type->alignment = alignment;
+
+	if (storage == k_ecs_storage_sparse)
+	{
+		type->capacity = k_sparse_initial_capacity;
+		type->count = 0;
+		type->sparse = heap_alloc(ecs->heap, sizeof(int) * ecs->entity_capacity, 8);
+		memset(type->sparse, 0xff, sizeof(int) * ecs->entity_capacity);
+		type->packed_entities = heap_alloc(ecs->heap, sizeof(int) * type->capacity, 8);
+	}
+	else
+	{
+		type->capacity = ecs->entity_capacity;
+	}
+
+	type->data = heap_alloc(ecs->heap, aligned_size * type->capacity, alignment);
+	memset(type->data, 0, aligned_size * type->capacity);
+	type->versions = heap_alloc(ecs->heap, sizeof(uint32_t) * type->capacity, 8);
+	memset(type->versions, 0, sizeof(uint32_t) * type->capacity);
+	return index;
 }
 
-int ecs_register_component_type(ecs_t* ecs, const char* name, size_t size_per_component, size_t alignment)
+size_t ecs_get_component_type_size(ecs_t* ecs, int component_type)
 {
-	for (int i = 0; i < _countof(ecs->components); ++i)
+	return ecs->component_types[component_type].size;
+}
+
+ecs_entity_ref_t ecs_entity_add(ecs_t* ecs, ecs_mask_t component_mask)
+{
+	int i;
+	if (ecs->free_count > 0)
+	{
+		i = ecs->free_slots[--ecs->free_count];
+	}
+	else if (ecs->high_water_mark < ecs->entity_capacity)
+	{
+		i = ecs->high_water_mark++;
+	}
+	else
 	{
-		if (ecs->components[i] == NULL)
+		debug_print(k_print_warning, "Out of entities.");
+		return (ecs_entity_ref_t) { .entity = -1, .sequence = -1 };
+	}
+
+	ecs->entity_states[i] = k_entity_pending_add;
+	ecs->sequences[i] = ecs->global_sequence++;
+	ecs->component_masks[i] = component_mask;
+	for (int c = 0; c < ecs->component_type_count; ++c)
+	{
+		if (ecs_mask_test(&component_mask, c))
 		{
-			size_t aligned_size = (size_per_component + (alignment - 1)) & ~(alignment - 1);
-			strcpy_s(ecs->component_type_names[i], sizeof(ecs->component_type_names[i]), name);
-			ecs->component_type_sizes[i] = aligned_size;
-			ecs->components[i] = heap_alloc(ecs->heap, aligned_size * k_max_entities, alignment);
-			memset(ecs->components[i], 0, aligned_size * k_max_entities);
-			return i;
+			component_type_t* type = &ecs->component_types[c];
+			if (type->storage == k_ecs_storage_sparse)
+			{
+				sparse_component_add(ecs, type, i);
+			}
+			type->versions[get_component_slot(type, i)] = ecs->version;
 		}
 	}
-	debug_print(k_print_warning, "Out of component types.");
-	return -1;
+
+	ecs_entity_ref_t ref = { .entity = i, .sequence = ecs->sequences[i] };
+	ecs->pending_adds[ecs->pending_add_count++] = ref;
+	return ref;
 }
 
-size_t ecs_get_component_type_size(ecs_t* ecs, int component_type)
+int ecs_register_prefab(ecs_t* ecs, ecs_mask_t component_mask)
 {
-	return ecs->component_type_sizes[component_type];
+	if (ecs->prefab_count >= _countof(ecs->prefabs))
+	{
+		debug_print(k_print_warning, "Out of prefabs.\n");
+		return -1;
+	}
+
+	int index = ecs->prefab_count++;
+	prefab_t* prefab = &ecs->prefabs[index];
+	prefab->component_mask = component_mask;
+
+	size_t size = 0;
+	for (int c = 0; c < ecs->component_type_count; ++c)
+	{
+		if (ecs_mask_test(&component_mask, c))
+		{
+			component_type_t* type = &ecs->component_types[c];
+			size = (size + (type->alignment - 1)) & ~(type->alignment - 1);
+			prefab->offsets[c] = (uint32_t)size;
+			size += type->size;
+		}
+	}
+	prefab->data = heap_alloc(ecs->heap, __max(size, 1), 16);
+	memset(prefab->data, 0, size);
+	return index;
 }
 
-ecs_entity_ref_t ecs_entity_add(ecs_t* ecs, uint64_t component_mask)
+void* ecs_prefab_get_component(ecs_t* ecs, int prefab, int component_type)
 {
-	for (int i = 0; i < _countof(ecs->entity_states); ++i)
+	prefab_t* p = &ecs->prefabs[prefab];
+	if (ecs_mask_test(&p->component_mask, component_type))
 	{
-		if (ecs->entity_states[i] == k_entity_unused)
+		return &p->data[p->offsets[component_type]];
+	}
+	return NULL;
+}
+
+ecs_mask_t ecs_prefab_get_component_mask(ecs_t* ecs, int prefab)
+{
+	return ecs->prefabs[prefab].component_mask;
+}
+
+int ecs_spawn_batch(ecs_t* ecs, int prefab, int count, ecs_entity_ref_t* out_refs)
+{
+	int spawned = 0;
+	while (spawned < count)
+	{
+		int remaining = count - spawned;
+		ecs_entity_ref_t* refs = out_refs ? out_refs + spawned : NULL;
+		if (ecs->entity_capacity - ecs->high_water_mark >= remaining || ecs->free_count == 0)
+		{
+			// Take one contiguous run from the never-used tail of the entity table.
+			int run = __min(remaining, ecs->entity_capacity - ecs->high_water_mark);
+			if (run == 0)
+			{
+				debug_print(k_print_warning, "Out of entities.\n");
+				break;
+			}
+			spawn_prefab_run(ecs, &ecs->prefabs[prefab], ecs->high_water_mark, run, refs);
+			ecs->high_water_mark += run;
+			spawned += run;
+		}
+		else
 		{
-			ecs->entity_states[i] = k_entity_pending_add;
-			ecs->sequences[i] = ecs->global_sequence++;
-			ecs->component_masks[i] = component_mask;
-			return (ecs_entity_ref_t) { .entity = i, .sequence = ecs->sequences[i] };
+			// Not enough room at the tail; reuse retired slots first.
+			spawn_prefab_run(ecs, &ecs->prefabs[prefab], ecs->free_slots[--ecs->free_count], 1, refs);
+			spawned++;
 		}
 	}
-	debug_print(k_print_warning, "Out of entities.");
-	return (ecs_entity_ref_t) { .entity = -1, .sequence = -1 };
+	return spawned;
 }
 
 void ecs_entity_remove(ecs_t* ecs, ecs_entity_ref_t ref, bool allow_pending_add)
 {
 	if (ecs_is_entity_ref_valid(ecs, ref, allow_pending_add))
 	{
-		ecs->entity_states[ref.entity] = k_entity_pending_remove;
+		entity_state_t* state = &ecs->entity_states[ref.entity];
+		if (*state != k_entity_pending_remove)
+		{
+			// Entities removed before they were ever spawned are discarded without a destroy event.
+			*state = *state == k_entity_pending_add ? k_entity_pending_discard : k_entity_pending_remove;
+			ecs->pending_removes[ecs->pending_remove_count++] = ref;
+		}
 	}
 	else
 	{
@@ -129,17 +425,94 @@ bool ecs_is_entity_ref_valid(ecs_t* ecs, ecs_entity_ref_t ref, bool allow_pendin
 
 void* ecs_entity_get_component(ecs_t* ecs, ecs_entity_ref_t ref, int component_type, bool allow_pending_add)
 {
-	if (ecs_is_entity_ref_valid(ecs, ref, allow_pending_add) && ecs->components[component_type])
+	if (ecs_is_entity_ref_valid(ecs, ref, allow_pending_add) && component_type < ecs->component_type_count)
 	{
-		char* components = ecs->components[component_type];
-		return &components[ecs->component_type_sizes[component_type] * ref.entity];
+		component_type_t* type = &ecs->component_types[component_type];
+		int slot = get_component_slot(type, ref.entity);
+		if (slot >= 0)
+		{
+			type->versions[slot] = ecs->version;
+			return &type->data[type->size * slot];
+		}
 	}
 	return NULL;
 }
 
-ecs_query_t ecs_query_create(ecs_t* ecs, uint64_t mask)
+const void* ecs_entity_get_component_const(ecs_t* ecs, ecs_entity_ref_t ref, int component_type, bool allow_pending_add)
 {
-	ecs_query_t query = { .component_mask = mask, .entity = -1 };
+	if (ecs_is_entity_ref_valid(ecs, ref, allow_pending_add) && component_type < ecs->component_type_count)
+	{
+		component_type_t* type = &ecs->component_types[component_type];
+		int slot = get_component_slot(type, ref.entity);
+		if (slot >= 0)
+		{
+			return &type->data[type->size * slot];
+		}
+	}
+	return NULL;
+}
+
+uint32_t ecs_entity_get_version(ecs_t* ecs, ecs_entity_ref_t ref, ecs_mask_t component_mask, bool allow_pending_add)
+{
+	uint32_t version = 0;
+	if (ecs_is_entity_ref_valid(ecs, ref, allow_pending_add))
+	{
+		component_mask = ecs_mask_and(component_mask, ecs->component_masks[ref.entity]);
+		for (int c = 0; c < ecs->component_type_count; ++c)
+		{
+			if (ecs_mask_test(&component_mask, c))
+			{
+				component_type_t* type = &ecs->component_types[c];
+				uint32_t component_version = type->versions[get_component_slot(type, ref.entity)];
+				version = __max(version, component_version);
+			}
+		}
+	}
+	return version;
+}
+
+ecs_query_t ecs_query_create(ecs_t* ecs, ecs_mask_t mask)
+{
+	return query_create(ecs, mask, ecs_mask_empty(), ecs_mask_empty(), 0);
+}
+
+ecs_query_t ecs_query_create_excluding(ecs_t* ecs, ecs_mask_t mask, ecs_mask_t exclude_mask)
+{
+	return query_create(ecs, mask, exclude_mask, ecs_mask_empty(), 0);
+}
+
+ecs_query_t ecs_query_create_changed(ecs_t* ecs, ecs_mask_t mask, ecs_mask_t changed_mask, uint32_t version)
+{
+	return query_create(ecs, mask, ecs_mask_empty(), changed_mask, version);
+}
+
+static ecs_query_t query_create(ecs_t* ecs, ecs_mask_t mask, ecs_mask_t exclude_mask, ecs_mask_t changed_mask, uint32_t version)
+{
+	ecs_query_t query =
+	{
+		.component_mask = mask,
+		.care_mask = ecs_mask_or(mask, exclude_mask),
+		.changed_mask = changed_mask,
+		.changed_version = version,
+		.entity = -1,
+		.driver = -1,
+		.cursor = -1,
+	};
+
+	// Drive iteration from the smallest sparse set in the mask, if any.
+	// Otherwise walk the entity table.
+	for (int c = 0; c < ecs->component_type_count; ++c)
+	{
+		component_type_t* type = &ecs->component_types[c];
+		if (ecs_mask_test(&mask, c) && type->storage == k_ecs_storage_sparse)
+		{
+			if (query.driver < 0 || type->count < ecs->component_types[query.driver].count)
+			{
+				query.driver = c;
+			}
+		}
+	}
+
 	ecs_query_next(ecs, &query);
 	return query;
 }
@@ -151,24 +524,499 @@ bool ecs_query_is_valid(ecs_t* ecs, ecs_query_t* query)
 
 void ecs_query_next(ecs_t* ecs, ecs_query_t* query)
 {
-	for (int i = query->entity + 1; i < _countof(ecs->component_masks); ++i)
+	int count = query->driver >= 0 ? ecs->component_types[query->driver].count : ecs->high_water_mark;
+	const int* entities = query->driver >= 0 ? ecs->component_types[query->driver].packed_entities : NULL;
+
+	bool check_changed = !ecs_mask_is_empty(&query->changed_mask);
+	for (int i = query->cursor + 1; i < count; ++i)
 	{
-		if ((ecs->component_masks[i] & query->component_mask) == query->component_mask && ecs->entity_states[i] >= k_entity_active)
+		int entity = entities ? entities[i] : i;
+		if (ecs_mask_match(&ecs->component_masks[entity], &query->component_mask, &query->care_mask) && is_entity_active(ecs, entity))
 		{
-			query->entity = i;
+			if (check_changed && !is_entity_changed(ecs, entity, &query->changed_mask, query->changed_version))
+			{
+				continue;
+			}
+			query->cursor = i;
+			query->entity = entity;
 			return;
 		}
 	}
+	query->cursor = count;
 	query->entity = -1;
 }
 
 void* ecs_query_get_component(ecs_t* ecs, ecs_query_t* query, int component_type)
 {
-	char* components = ecs->components[component_type];
-	return &components[ecs->component_type_sizes[component_type] * query->entity];
+	component_type_t* type = &ecs->component_types[component_type];
+	int slot = get_component_slot(type, query->entity);
+	if (slot < 0)
+	{
+		return NULL;
+	}
+	type->versions[slot] = ecs->version;
+	return &type->data[type->size * slot];
+}
+
+const void* ecs_query_get_component_const(ecs_t* ecs, ecs_query_t* query, int component_type)
+{
+	component_type_t* type = &ecs->component_types[component_type];
+	int slot = get_component_slot(type, query->entity);
+	if (slot < 0)
+	{
+		return NULL;
+	}
+	return &type->data[type->size * slot];
 }
 
 ecs_entity_ref_t ecs_query_get_entity(ecs_t* ecs, ecs_query_t* query)
 {
 	return (ecs_entity_ref_t) { .entity = query->entity, .sequence = ecs->sequences[query->entity] };
 }
+
+ecs_view_t ecs_view_create(ecs_t* ecs, ecs_mask_t mask, ecs_mask_t write_mask)
+{
+	ecs_view_t view = { .component_mask = mask, .write_mask = write_mask, .begin = -1, .end = 0 };
+
+	// Runs index columns by entity slot, which only dense storage has.
+	ecs_mask_t access = ecs_mask_or(mask, write_mask);
+	for (int c = 0; c < ecs->component_type_count; ++c)
+	{
+		if (ecs_mask_test(&access, c) && ecs->component_types[c].storage != k_ecs_storage_dense)
+		{
+			debug_print(k_print_error, "Views cannot cover component type %s; it is not densely stored.\n", ecs->component_types[c].name);
+			view.end = ecs->high_water_mark;
+			return view;
+		}
+	}
+
+	ecs_view_next(ecs, &view);
+	return view;
+}
+
+bool ecs_view_is_valid(ecs_t* ecs, ecs_view_t* view)
+{
+	return view->begin >= 0;
+}
+
+void ecs_view_next(ecs_t* ecs, ecs_view_t* view)
+{
+	int begin = view->end;
+	while (begin < ecs->high_water_mark &&
+		!(ecs_mask_contains_all(&ecs->component_masks[begin], &view->component_mask) && is_entity_active(ecs, begin)))
+	{
+		++begin;
+	}
+	if (begin == ecs->high_water_mark)
+	{
+		view->begin = -1;
+		view->end = begin;
+		return;
+	}
+
+	int end = begin + 1;
+	while (end < ecs->high_water_mark &&
+		ecs_mask_contains_all(&ecs->component_masks[end], &view->component_mask) && is_entity_active(ecs, end))
+	{
+		++end;
+	}
+	view->begin = begin;
+	view->end = end;
+
+	for (int c = 0; c < ecs->component_type_count; ++c)
+	{
+		component_type_t* type = &ecs->component_types[c];
+		if (ecs_mask_test(&view->write_mask, c))
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				type->versions[i] = ecs->version;
+			}
+		}
+	}
+}
+
+ecs_entity_ref_t ecs_view_get_entity(ecs_t* ecs, ecs_view_t* view, int entity)
+{
+	return (ecs_entity_ref_t) { .entity = entity, .sequence = ecs->sequences[entity] };
+}
+
+void* ecs_get_component_column(ecs_t* ecs, int component_type, size_t stride)
+{
+	component_type_t* type = &ecs->component_types[component_type];
+	if (type->storage != k_ecs_storage_dense)
+	{
+		debug_print(k_print_error, "Component type %s is not densely stored.\n", type->name);
+		return NULL;
+	}
+	if (type->size != stride)
+	{
+		debug_print(k_print_error, "Component type %s has size %zu, not %zu.\n", type->name, type->size, stride);
+		return NULL;
+	}
+	return type->data;
+}
+
+void ecs_set_component_type_fixup(ecs_t* ecs, int component_type, ecs_component_fixup_t fixup, void* user)
+{
+	ecs->component_types[component_type].fixup = fixup;
+	ecs->component_types[component_type].fixup_user = user;
+}
+
+void* ecs_save(ecs_t* ecs, heap_t* heap, size_t* size)
+{
+	size_t image_size = sizeof(image_header_t) + (sizeof(int) + sizeof(entity_state_t) + sizeof(ecs_mask_t)) * ecs->entity_capacity;
+	for (int c = 0; c < ecs->component_type_count; ++c)
+	{
+		component_type_t* type = &ecs->component_types[c];
+		image_size += sizeof(image_component_t) + (type->size + sizeof(uint32_t)) * get_component_slot_count(type);
+		if (type->storage == k_ecs_storage_sparse)
+		{
+			image_size += sizeof(int) * (ecs->entity_capacity + type->count);
+		}
+	}
+
+	char* image = heap_alloc(heap, image_size, 8);
+	char* cursor = image;
+
+	image_header_t header =
+	{
+		.magic = k_image_magic,
+		.version = k_image_version,
+		.world_version = ecs->version,
+		.global_sequence = ecs->global_sequence,
+		.entity_count = ecs->entity_capacity,
+		.component_type_count = ecs->component_type_count,
+	};
+	memcpy(cursor, &header, sizeof(header)); cursor += sizeof(header);
+	memcpy(cursor, ecs->sequences, sizeof(int) * ecs->entity_capacity); cursor += sizeof(int) * ecs->entity_capacity;
+	memcpy(cursor, ecs->entity_states, sizeof(entity_state_t) * ecs->entity_capacity); cursor += sizeof(entity_state_t) * ecs->entity_capacity;
+	memcpy(cursor, ecs->component_masks, sizeof(ecs_mask_t) * ecs->entity_capacity); cursor += sizeof(ecs_mask_t) * ecs->entity_capacity;
+
+	for (int c = 0; c < ecs->component_type_count; ++c)
+	{
+		component_type_t* type = &ecs->component_types[c];
+		int slot_count = get_component_slot_count(type);
+		image_component_t desc = { .storage = type->storage, .size = (uint32_t)type->size, .count = slot_count };
+		strcpy_s(desc.name, sizeof(desc.name), type->name);
+		memcpy(cursor, &desc, sizeof(desc)); cursor += sizeof(desc);
+
+		memcpy(cursor, type->data, type->size * slot_count);
+		if (type->fixup)
+		{
+			component_fixup(ecs, type, cursor, false);
+		}
+		cursor += type->size * slot_count;
+		memcpy(cursor, type->versions, sizeof(uint32_t) * slot_count); cursor += sizeof(uint32_t) * slot_count;
+
+		if (type->storage == k_ecs_storage_sparse)
+		{
+			memcpy(cursor, type->sparse, sizeof(int) * ecs->entity_capacity); cursor += sizeof(int) * ecs->entity_capacity;
+			memcpy(cursor, type->packed_entities, sizeof(int) * type->count); cursor += sizeof(int) * type->count;
+		}
+	}
+
+	*size = image_size;
+	return image;
+}
+
+bool ecs_load(ecs_t* ecs, const void* image, size_t size)
+{
+	const char* cursor = image;
+	const char* end = cursor + size;
+
+	image_header_t header;
+	if (size < sizeof(header))
+	{
+		debug_print(k_print_error, "ECS image is truncated.\n");
+		return false;
+	}
+	memcpy(&header, cursor, sizeof(header)); cursor += sizeof(header);
+	if (header.magic != k_image_magic || header.version != k_image_version)
+	{
+		debug_print(k_print_error, "ECS image has unsupported format version.\n");
+		return false;
+	}
+	if (header.entity_count != ecs->entity_capacity || header.component_type_count != ecs->component_type_count)
+	{
+		debug_print(k_print_error, "ECS image does not match the world's layout.\n");
+		return false;
+	}
+
+	// Validate every component descriptor before touching the world, so a bad image leaves it intact.
+	const char* validate = cursor + (sizeof(int) + sizeof(entity_state_t) + sizeof(ecs_mask_t)) * ecs->entity_capacity;
+	for (int c = 0; c < ecs->component_type_count; ++c)
+	{
+		component_type_t* type = &ecs->component_types[c];
+		image_component_t desc;
+		if (validate + sizeof(desc) > end)
+		{
+			debug_print(k_print_error, "ECS image is truncated.\n");
+			return false;
+		}
+		memcpy(&desc, validate, sizeof(desc)); validate += sizeof(desc);
+		if (strcmp(desc.name, type->name) != 0 || desc.storage != (uint32_t)type->storage || desc.size != type->size ||
+			desc.count < 0 || (type->storage == k_ecs_storage_dense && desc.count != ecs->entity_capacity))
+		{
+			debug_print(k_print_error, "ECS image component type %s does not match the registered type.\n", type->name);
+			return false;
+		}
+		validate += (type->size + sizeof(uint32_t)) * desc.count;
+		if (type->storage == k_ecs_storage_sparse)
+		{
+			validate += sizeof(int) * (ecs->entity_capacity + desc.count);
+		}
+		if (validate > end)
+		{
+			debug_print(k_print_error, "ECS image is truncated.\n");
+			return false;
+		}
+	}
+
+	// Versions and sequence numbers only move forward, even when loading an older image.
+	// Every loaded component counts as written, so change queries and replication see the whole world.
+	ecs->version = __max(ecs->version, header.world_version) + 1;
+	ecs->global_sequence = __max(ecs->global_sequence, header.global_sequence);
+	memcpy(ecs->sequences, cursor, sizeof(int) * ecs->entity_capacity); cursor += sizeof(int) * ecs->entity_capacity;
+	memcpy(ecs->entity_states, cursor, sizeof(entity_state_t) * ecs->entity_capacity); cursor += sizeof(entity_state_t) * ecs->entity_capacity;
+	memcpy(ecs->component_masks, cursor, sizeof(ecs_mask_t) * ecs->entity_capacity); cursor += sizeof(ecs_mask_t) * ecs->entity_capacity;
+	rebuild_entity_lists(ecs);
+
+	for (int c = 0; c < ecs->component_type_count; ++c)
+	{
+		component_type_t* type = &ecs->component_types[c];
+		image_component_t desc;
+		memcpy(&desc, cursor, sizeof(desc)); cursor += sizeof(desc);
+
+		int slot_count = desc.count;
+		if (type->storage == k_ecs_storage_sparse)
+		{
+			if (slot_count > type->capacity)
+			{
+				type->count = 0;
+				sparse_component_reserve(ecs, type, slot_count);
+			}
+			type->count = slot_count;
+		}
+
+		memcpy(type->data, cursor, type->size * slot_count); cursor += type->size * slot_count;
+		fill_pattern((char*)type->versions, (const char*)&ecs->version, sizeof(uint32_t), slot_count); cursor += sizeof(uint32_t) * slot_count;
+
+		if (type->storage == k_ecs_storage_sparse)
+		{
+			memcpy(type->sparse, cursor, sizeof(int) * ecs->entity_capacity); cursor += sizeof(int) * ecs->entity_capacity;
+			memcpy(type->packed_entities, cursor, sizeof(int) * slot_count); cursor += sizeof(int) * slot_count;
+		}
+
+		if (type->fixup)
+		{
+			component_fixup(ecs, type, type->data, true);
+		}
+	}
+	return true;
+}
+
+static void spawn_prefab_run(ecs_t* ecs, prefab_t* prefab, int first, int count, ecs_entity_ref_t* out_refs)
+{
+	int end = first + count;
+	const ecs_mask_t* component_mask = &prefab->component_mask;
+	for (int i = first; i < end; ++i)
+	{
+		ecs->entity_states[i] = k_entity_pending_add;
+		ecs->sequences[i] = ecs->global_sequence++;
+		ecs->component_masks[i] = *component_mask;
+
+		ecs_entity_ref_t ref = { .entity = i, .sequence = ecs->sequences[i] };
+		ecs->pending_adds[ecs->pending_add_count++] = ref;
+		if (out_refs)
+		{
+			out_refs[i - first] = ref;
+		}
+	}
+
+	for (int c = 0; c < ecs->component_type_count; ++c)
+	{
+		if (!ecs_mask_test(component_mask, c))
+		{
+			continue;
+		}
+
+		component_type_t* type = &ecs->component_types[c];
+		const char* defaults = &prefab->data[prefab->offsets[c]];
+		if (type->storage == k_ecs_storage_dense)
+		{
+			fill_pattern(&type->data[type->size * first], defaults, type->size, count);
+			fill_pattern((char*)&type->versions[first], (const char*)&ecs->version, sizeof(uint32_t), count);
+		}
+		else
+		{
+			if (type->count + count > type->capacity)
+			{
+				sparse_component_reserve(ecs, type, __max(type->capacity * 2, type->count + count));
+			}
+			for (int i = first; i < end; ++i)
+			{
+				sparse_component_add(ecs, type, i);
+				int slot = type->sparse[i];
+				memcpy(&type->data[type->size * slot], defaults, type->size);
+				type->versions[slot] = ecs->version;
+			}
+		}
+	}
+}
+
+// Replicate one element count times, doubling the copied range each step.
+static void fill_pattern(char* dst, const char* pattern, size_t size, int count)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+	memcpy(dst, pattern, size);
+	size_t filled = size;
+	size_t total = size * count;
+	while (filled < total)
+	{
+		size_t chunk = __min(filled, total - filled);
+		memcpy(dst + filled, dst, chunk);
+		filled += chunk;
+	}
+}
+
+static void rebuild_entity_lists(ecs_t* ecs)
+{
+	ecs->high_water_mark = 0;
+	for (int i = ecs->entity_capacity - 1; i >= 0; --i)
+	{
+		if (ecs->entity_states[i] != k_entity_unused)
+		{
+			ecs->high_water_mark = i + 1;
+			break;
+		}
+	}
+
+	ecs->free_count = 0;
+	ecs->pending_add_count = 0;
+	ecs->pending_remove_count = 0;
+	ecs->spawned_count = 0;
+	ecs->destroyed_count = 0;
+	for (int i = ecs->high_water_mark - 1; i >= 0; --i)
+	{
+		ecs_entity_ref_t ref = { .entity = i, .sequence = ecs->sequences[i] };
+		switch (ecs->entity_states[i])
+		{
+		case k_entity_unused:
+			ecs->free_slots[ecs->free_count++] = i;
+			break;
+		case k_entity_pending_add:
+			ecs->pending_adds[ecs->pending_add_count++] = ref;
+			break;
+		case k_entity_pending_discard:
+		case k_entity_pending_remove:
+			ecs->pending_removes[ecs->pending_remove_count++] = ref;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static void component_fixup(ecs_t* ecs, component_type_t* type, char* data, bool is_load)
+{
+	if (type->storage == k_ecs_storage_sparse)
+	{
+		for (int i = 0; i < type->count; ++i)
+		{
+			type->fixup(&data[type->size * i], is_load, type->fixup_user);
+		}
+		return;
+	}
+
+	int component_type = (int)(type - ecs->component_types);
+	for (int i = 0; i < ecs->high_water_mark; ++i)
+	{
+		if (ecs->entity_states[i] != k_entity_unused && ecs_mask_test(&ecs->component_masks[i], component_type))
+		{
+			type->fixup(&data[type->size * i], is_load, type->fixup_user);
+		}
+	}
+}
+
+static bool is_entity_active(ecs_t* ecs, int entity)
+{
+	return ecs->entity_states[entity] >= k_entity_active;
+}
+
+static bool is_entity_changed(ecs_t* ecs, int entity, const ecs_mask_t* mask, uint32_t version)
+{
+	for (int c = 0; c < ecs->component_type_count; ++c)
+	{
+		if (ecs_mask_test(mask, c) && ecs_mask_test(&ecs->component_masks[entity], c))
+		{
+			component_type_t* type = &ecs->component_types[c];
+			if (type->versions[get_component_slot(type, entity)] >= version)
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+static int get_component_slot_count(component_type_t* type)
+{
+	return type->storage == k_ecs_storage_sparse ? type->count : type->capacity;
+}
+
+static int get_component_slot(component_type_t* type, int entity)
+{
+	return type->storage == k_ecs_storage_sparse ? type->sparse[entity] : entity;
+}
+
+static void sparse_component_add(ecs_t* ecs, component_type_t* type, int entity)
+{
+	if (type->count == type->capacity)
+	{
+		sparse_component_reserve(ecs, type, type->capacity * 2);
+	}
+
+	int slot = type->count++;
+	type->sparse[entity] = slot;
+	type->packed_entities[slot] = entity;
+	memset(&type->data[type->size * slot], 0, type->size);
+}
+
+static void sparse_component_reserve(ecs_t* ecs, component_type_t* type, int capacity)
+{
+	char* data = heap_alloc(ecs->heap, type->size * capacity, type->alignment);
+	memcpy(data, type->data, type->size * type->count);
+	heap_free(ecs->heap, type->data);
+	type->data = data;
+
+	uint32_t* versions = heap_alloc(ecs->heap, sizeof(uint32_t) * capacity, 8);
+	memcpy(versions, type->versions, sizeof(uint32_t) * type->count);
+	heap_free(ecs->heap, type->versions);
+	type->versions = versions;
+
+	int* packed_entities = heap_alloc(ecs->heap, sizeof(int) * capacity, 8);
+	memcpy(packed_entities, type->packed_entities, sizeof(int) * type->count);
+	heap_free(ecs->heap, type->packed_entities);
+	type->packed_entities = packed_entities;
+
+	type->capacity = capacity;
+}
+
+static void sparse_component_remove(component_type_t* type, int entity)
+{
+	int slot = type->sparse[entity];
+	int last = --type->count;
+	if (slot != last)
+	{
+		int moved_entity = type->packed_entities[last];
+		memcpy(&type->data[type->size * slot], &type->data[type->size * last], type->size);
+		type->versions[slot] = type->versions[last];
+		type->packed_entities[slot] = moved_entity;
+		type->sparse[moved_entity] = slot;
+	}
+	type->sparse[entity] = -1;
+}
@@ -3,6 +3,8 @@
 // Entity Component System
 // Framework for game entities and their components.
 
+#include "ecs_mask.h"
+
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -18,30 +20,110 @@ typedef struct ecs_entity_ref_t
 	int sequence;
 } ecs_entity_ref_t;
 
+// Storage policy for a type of component.
+typedef enum ecs_storage_t
+{
+	// One slot per entity. Best for components most entities have.
+	k_ecs_storage_dense,
+	// Packed array plus entity index map. Best for rare components.
+	k_ecs_storage_sparse,
+} ecs_storage_t;
+
+// Converts pointer-bearing component data to and from a position-independent form.
+// Called on each saved component with is_load false and on each loaded component with is_load true.
+typedef void (*ecs_component_fixup_t)(void* component, bool is_load, void* user);
+
 // Working data for an active entity query.
 typedef struct ecs_query_t
 {
-	uint64_t component_mask;
+	ecs_mask_t component_mask;
+	// Component mask plus exclude mask; see ecs_mask_match().
+	ecs_mask_t care_mask;
+	ecs_mask_t changed_mask;
+	uint32_t changed_version;
 	int entity;
+	int driver;
+	int cursor;
 } ecs_query_t;
 
+// Working data for walking runs of consecutive matching entities.
+// Each run covers entity slots [begin, end).
+typedef struct ecs_view_t
+{
+	ecs_mask_t component_mask;
+	ecs_mask_t write_mask;
+	int begin;
+	int end;
+} ecs_view_t;
+
+// Typed base pointer of a dense component column, indexed by entity slot.
+// Resolve once per view and walk [view.begin, view.end) with plain array indexing.
+// Evaluates to NULL, with an error printed, if the type is sparse or its size does not match the registered size.
+// Views reject sparse types too; check for NULL before indexing in case the size is wrong.
+#define ECS_COLUMN(ecs, type, component_type) ((type*)ecs_get_component_column((ecs), (component_type), sizeof(type)))
+
 // Create an entity component system.
-ecs_t* ecs_create(heap_t* heap);
+// Entity capacity is the maximum number of live entities.
+ecs_t* ecs_create(heap_t* heap, int entity_capacity);
 
 // Destroy an entity component system.
 void ecs_destroy(ecs_t* ecs);
 
 // Per-frame entity component system update.
+// Spawns and destroys entities queued since the last update and advances the change version of the world.
+// Cost scales with the number of queued changes, not with entity capacity.
 void ecs_update(ecs_t* ecs);
 
+// Get references to entities spawned by the last ecs_update().
+// The list is valid until the next update.
+const ecs_entity_ref_t* ecs_get_spawned_entities(ecs_t* ecs, int* count);
+
+// Get references to entities destroyed by the last ecs_update().
+// References are already invalid; use them as keys to release per-entity data.
+// Entities removed before they were ever spawned are not listed.
+// The list is valid until the next update.
+const ecs_entity_ref_t* ecs_get_destroyed_entities(ecs_t* ecs, int* count);
+
+// Get the current change version of the world.
+// Components written from now on are considered changed since this version.
+uint32_t ecs_get_version(ecs_t* ecs);
+
+// Get the maximum number of live entities.
+int ecs_get_entity_capacity(ecs_t* ecs);
+
 // Register a type of component with the entity system.
-int ecs_register_component_type(ecs_t* ecs, const char* name, size_t size_per_component, size_t alignment);
+// Up to k_ecs_mask_bits types can be registered.
+// Storage selects how component memory is laid out. See ecs_storage_t.
+// Sparse components may move in memory whenever entities are added, spawned, destroyed or loaded:
+// in ecs_entity_add(), ecs_spawn_batch(), ecs_update() and ecs_load(). Do not hold pointers to them across those calls.
+int ecs_register_component_type(ecs_t* ecs, const char* name, size_t size_per_component, size_t alignment, ecs_storage_t storage);
+
+// Register a fixup for a type of component that holds pointers or other process-specific data.
+// See ecs_component_fixup_t.
+void ecs_set_component_type_fixup(ecs_t* ecs, int component_type, ecs_component_fixup_t fixup, void* user);
 
 // Return the size of a type of component registered with the sytem.
 size_t ecs_get_component_type_size(ecs_t* ecs, int component_type);
 
 // Spawn an entity with the masked components and return a reference to it.
-ecs_entity_ref_t ecs_entity_add(ecs_t* ecs, uint64_t component_mask);
+ecs_entity_ref_t ecs_entity_add(ecs_t* ecs, ecs_mask_t component_mask);
+
+// Register a prefab: a template of component mask plus default component data.
+// Component types in the mask must already be registered.
+// Default data starts zeroed; fill it in with ecs_prefab_get_component().
+// Returns the index of the prefab, or -1 if out of space.
+int ecs_register_prefab(ecs_t* ecs, ecs_mask_t component_mask);
+
+// Get the default data of a component in a prefab, or NULL if not in its mask.
+void* ecs_prefab_get_component(ecs_t* ecs, int prefab, int component_type);
+
+// Get the component mask of a prefab.
+ecs_mask_t ecs_prefab_get_component_mask(ecs_t* ecs, int prefab);
+
+// Spawn count entities from a prefab and write references to them to out_refs, if not NULL.
+// Entities take contiguous slots when available and their components are bulk-copied from the prefab.
+// Returns the number of entities spawned; fewer than count if out of entities.
+int ecs_spawn_batch(ecs_t* ecs, int prefab, int count, ecs_entity_ref_t* out_refs);
 
 // Destroy an entity.
 // If allow_pending_add is true, can destroy an entity that is not fully spawned.
@@ -54,10 +136,29 @@ bool ecs_is_entity_ref_valid(ecs_t* ecs, ecs_entity_ref_t ref, bool allow_pendin
 // Get the memory for a component on an entity.
 // NULL is returned if the entity is not valid or the component_type is not present on the entity.
 // If allow_pending_add is true, will return component data for not fully spawned entities.
+// The component is considered written and its change version is bumped.
 void* ecs_entity_get_component(ecs_t* ecs, ecs_entity_ref_t ref, int component_type, bool allow_pending_add);
 
+// Get read-only memory for a component on an entity.
+// Same as ecs_entity_get_component() but does not bump the change version.
+const void* ecs_entity_get_component_const(ecs_t* ecs, ecs_entity_ref_t ref, int component_type, bool allow_pending_add);
+
+// Get the most recent change version of the masked components on an entity.
+// Returns zero if the entity is not valid.
+uint32_t ecs_entity_get_version(ecs_t* ecs, ecs_entity_ref_t ref, ecs_mask_t component_mask, bool allow_pending_add);
+
 // Creates a new entity query by component type mask.
-ecs_query_t ecs_query_create(ecs_t* ecs, uint64_t mask);
+// Iteration is driven by the smallest sparse component set in the mask, if any.
+ecs_query_t ecs_query_create(ecs_t* ecs, ecs_mask_t mask);
+
+// Creates a new entity query by component type mask that skips entities
+// with any component in exclude_mask.
+ecs_query_t ecs_query_create_excluding(ecs_t* ecs, ecs_mask_t mask, ecs_mask_t exclude_mask);
+
+// Creates a new entity query by component type mask that only matches entities
+// where at least one component in changed_mask was written at or after version.
+// See ecs_get_version().
+ecs_query_t ecs_query_create_changed(ecs_t* ecs, ecs_mask_t mask, ecs_mask_t changed_mask, uint32_t version);
 
 // Determines if the query points at a valid entity.
 bool ecs_query_is_valid(ecs_t* ecs, ecs_query_t* query);
@@ -65,8 +166,46 @@ bool ecs_query_is_valid(ecs_t* ecs, ecs_query_t* query);
 // Advances the query to the next matching entity, if any.
 void ecs_query_next(ecs_t* ecs, ecs_query_t* query);
 
-// Get data for a component on the entity referenced by the query, if any.
+// Get data for a component on the entity referenced by the query.
+// NULL is returned if the component is sparse and the entity does not have it, e.g. a type outside the query mask.
+// The component is considered written and its change version is bumped.
 void* ecs_query_get_component(ecs_t* ecs, ecs_query_t* query, int component_type);
 
+// Get read-only data for a component on the entity referenced by the query, if any.
+// Same as ecs_query_get_component() but does not bump the change version.
+const void* ecs_query_get_component_const(ecs_t* ecs, ecs_query_t* query, int component_type);
+
 // Get a entity reference for the current query location.
 ecs_entity_ref_t ecs_query_get_entity(ecs_t* ecs, ecs_query_t* query);
+
+// Creates a new view over runs of entities matching the component type mask.
+// Components in write_mask have their change version bumped for every run visited.
+// Views only cover densely stored types; a mask naming a sparse type is an error
+// and gives a view with no runs.
+ecs_view_t ecs_view_create(ecs_t* ecs, ecs_mask_t mask, ecs_mask_t write_mask);
+
+// Determines if the view points at a valid run of entities.
+bool ecs_view_is_valid(ecs_t* ecs, ecs_view_t* view);
+
+// Advances the view to the next run of matching entities, if any.
+void ecs_view_next(ecs_t* ecs, ecs_view_t* view);
+
+// Get an entity reference for an entity slot inside the current view run.
+ecs_entity_ref_t ecs_view_get_entity(ecs_t* ecs, ecs_view_t* view, int entity);
+
+// Get the base of a dense component column. Prefer the typed ECS_COLUMN() macro.
+// Stride must match the registered component size.
+// NULL is returned for sparse component types.
+void* ecs_get_component_column(ecs_t* ecs, int component_type, size_t stride);
+
+// Save the full state of the world to a binary image.
+// Memory for the image is allocated out of the provided heap and owned by the caller.
+// The image can be written with fs_write(), optionally compressed.
+void* ecs_save(ecs_t* ecs, heap_t* heap, size_t* size);
+
+// Restore the full state of the world from an image produced by ecs_save().
+// The world must have the same component types registered in the same order.
+// Returns false and leaves the world untouched if the image does not match.
+// The world version advances past both the world's and the image's, and every loaded component
+// is stamped with it. New entities never reuse a sequence number issued before the load.
+bool ecs_load(ecs_t* ecs, const void* image, size_t size);
@@ -0,0 +1,293 @@
+#include "ecs_bench.h"
+
+#include "bench_random.h"
+#include "debug.h"
+#include "ecs.h"
+#include "heap.h"
+#include "timer.h"
+
+#include <stdint.h>
+
+// Hardware cache-miss counters are not exposed to user mode on Windows
+// without a kernel driver, so results are reported as time only.
+// Run an optimized build; debug heap backtraces dominate allocation timings.
+
+enum
+{
+	k_bench_component_count = 4,
+	k_bench_rare_interval = 10,
+};
+
+typedef struct bench_component_t
+{
+	float value[4];
+} bench_component_t;
+
+typedef struct bench_world_t
+{
+	heap_t* heap;
+	ecs_t* ecs;
+	int component_types[k_bench_component_count];
+	int rare_type;
+	ecs_entity_ref_t* refs;
+	int count;
+	uint32_t rng;
+	// Query results land here so the compiler cannot drop the measured loops.
+	volatile float sink;
+} bench_world_t;
+
+static ecs_mask_t bench_mask(bench_world_t* world, int component_count)
+{
+	return ecs_mask_from_types(world->component_types, component_count);
+}
+
+static void bench_report(const char* name, int count, uint64_t ticks)
+{
+	double ns = (double)ticks * 1000000000.0 / (double)timer_get_ticks_per_second() / (double)__max(count, 1);
+	debug_print(k_print_info, "%-28s %8d entities %10.2f ns/entity\n", name, count, ns);
+}
+
+static void bench_spawn(bench_world_t* world, const char* name)
+{
+	ecs_mask_t full_mask = bench_mask(world, k_bench_component_count);
+
+	uint64_t t0 = timer_get_ticks();
+	for (int i = 0; i < world->count; ++i)
+	{
+		ecs_mask_t mask = full_mask;
+		if (i % k_bench_rare_interval == 0)
+		{
+			ecs_mask_set(&mask, world->rare_type);
+		}
+		world->refs[i] = ecs_entity_add(world->ecs, mask);
+	}
+	bench_report(name, world->count, timer_get_ticks() - t0);
+}
+
+// Spawn initialized entities into scratch entity systems,
+// one at a time with per-component writes and then as one prefab batch.
+static void bench_spawn_initialized(bench_world_t* world)
+{
+	ecs_mask_t mask = bench_mask(world, k_bench_component_count);
+	bench_component_t defaults = { .value = { 1.0f, 2.0f, 3.0f, 4.0f } };
+
+	ecs_t* ecs = ecs_create(world->heap, world->count);
+	for (int i = 0; i < k_bench_component_count; ++i)
+	{
+		ecs_register_component_type(ecs, "bench", sizeof(bench_component_t), _Alignof(bench_component_t), k_ecs_storage_dense);
+	}
+	uint64_t t0 = timer_get_ticks();
+	for (int i = 0; i < world->count; ++i)
+	{
+		ecs_entity_ref_t ref = ecs_entity_add(ecs, mask);
+		for (int c = 0; c < k_bench_component_count; ++c)
+		{
+			*(bench_component_t*)ecs_entity_get_component(ecs, ref, world->component_types[c], true) = defaults;
+		}
+	}
+	bench_report("spawn + init", world->count, timer_get_ticks() - t0);
+	ecs_destroy(ecs);
+
+	ecs = ecs_create(world->heap, world->count);
+	for (int i = 0; i < k_bench_component_count; ++i)
+	{
+		ecs_register_component_type(ecs, "bench", sizeof(bench_component_t), _Alignof(bench_component_t), k_ecs_storage_dense);
+	}
+	int prefab = ecs_register_prefab(ecs, mask);
+	for (int c = 0; c < k_bench_component_count; ++c)
+	{
+		*(bench_component_t*)ecs_prefab_get_component(ecs, prefab, world->component_types[c]) = defaults;
+	}
+	t0 = timer_get_ticks();
+	ecs_spawn_batch(ecs, prefab, world->count, NULL);
+	bench_report("spawn batch (prefab)", world->count, timer_get_ticks() - t0);
+	ecs_destroy(ecs);
+}
+
+static void bench_update(bench_world_t* world, const char* name)
+{
+	uint64_t t0 = timer_get_ticks();
+	ecs_update(world->ecs);
+	bench_report(name, world->count, timer_get_ticks() - t0);
+}
+
+static void bench_query(bench_world_t* world, int component_count, const char* name)
+{
+	ecs_mask_t mask = bench_mask(world, component_count);
+	float sum = 0.0f;
+	int visited = 0;
+
+	uint64_t t0 = timer_get_ticks();
+	for (ecs_query_t query = ecs_query_create(world->ecs, mask);
+		ecs_query_is_valid(world->ecs, &query);
+		ecs_query_next(world->ecs, &query))
+	{
+		for (int i = 0; i < component_count; ++i)
+		{
+			const bench_component_t* comp = ecs_query_get_component_const(world->ecs, &query, world->component_types[i]);
+			sum += comp->value[0];
+		}
+		++visited;
+	}
+	bench_report(name, visited, timer_get_ticks() - t0);
+	world->sink = sum;
+}
+
+static void bench_query_excluding(bench_world_t* world, const char* name)
+{
+	ecs_mask_t mask = bench_mask(world, 2);
+	float sum = 0.0f;
+	int visited = 0;
+
+	uint64_t t0 = timer_get_ticks();
+	for (ecs_query_t query = ecs_query_create_excluding(world->ecs, mask, ECS_MASK(world->rare_type));
+		ecs_query_is_valid(world->ecs, &query);
+		ecs_query_next(world->ecs, &query))
+	{
+		const bench_component_t* comp = ecs_query_get_component_const(world->ecs, &query, world->component_types[0]);
+		sum += comp->value[0];
+		++visited;
+	}
+	bench_report(name, visited, timer_get_ticks() - t0);
+	world->sink = sum;
+}
+
+static void bench_view(bench_world_t* world, const char* name)
+{
+	ecs_mask_t mask = bench_mask(world, k_bench_component_count);
+	const bench_component_t* columns[k_bench_component_count];
+	for (int i = 0; i < k_bench_component_count; ++i)
+	{
+		columns[i] = ECS_COLUMN(world->ecs, bench_component_t, world->component_types[i]);
+	}
+	float sum = 0.0f;
+	int visited = 0;
+
+	uint64_t t0 = timer_get_ticks();
+	for (ecs_view_t view = ecs_view_create(world->ecs, mask, ecs_mask_empty());
+		ecs_view_is_valid(world->ecs, &view);
+		ecs_view_next(world->ecs, &view))
+	{
+		for (int e = view.begin; e < view.end; ++e)
+		{
+			sum += columns[0][e].value[0] + columns[1][e].value[0] + columns[2][e].value[0] + columns[3][e].value[0];
+		}
+		visited += view.end - view.begin;
+	}
+	bench_report(name, visited, timer_get_ticks() - t0);
+	world->sink = sum;
+}
+
+static void bench_query_rare(bench_world_t* world, const char* name)
+{
+	ecs_mask_t mask = ECS_MASK(world->rare_type, world->component_types[0]);
+	float sum = 0.0f;
+	int visited = 0;
+
+	uint64_t t0 = timer_get_ticks();
+	for (ecs_query_t query = ecs_query_create(world->ecs, mask);
+		ecs_query_is_valid(world->ecs, &query);
+		ecs_query_next(world->ecs, &query))
+	{
+		const bench_component_t* comp = ecs_query_get_component_const(world->ecs, &query, world->rare_type);
+		sum += comp->value[0];
+		++visited;
+	}
+	bench_report(name, visited, timer_get_ticks() - t0);
+	world->sink = sum;
+}
+
+static void bench_random_get(bench_world_t* world, const char* name)
+{
+	float sum = 0.0f;
+
+	uint64_t t0 = timer_get_ticks();
+	for (int i = 0; i < world->count; ++i)
+	{
+		ecs_entity_ref_t ref = world->refs[bench_random(&world->rng) % world->count];
+		const bench_component_t* comp = ecs_entity_get_component_const(world->ecs, ref, world->component_types[1], false);
+		if (comp)
+		{
+			sum += comp->value[0];
+		}
+	}
+	bench_report(name, world->count, timer_get_ticks() - t0);
+	world->sink = sum;
+}
+
+// Remove a random half of the entities and respawn them with random component subsets.
+// Leaves holes and mixed masks throughout the entity table.
+static void bench_churn(bench_world_t* world)
+{
+	int removed = 0;
+	uint64_t t0 = timer_get_ticks();
+	for (int i = 0; i < world->count; ++i)
+	{
+		if (bench_random(&world->rng) & 1)
+		{
+			ecs_entity_remove(world->ecs, world->refs[i], false);
+			world->refs[i].sequence = -1;
+			++removed;
+		}
+	}
+	ecs_update(world->ecs);
+	bench_report("churn remove+update", removed, timer_get_ticks() - t0);
+
+	t0 = timer_get_ticks();
+	for (int i = 0; i < world->count; ++i)
+	{
+		if (world->refs[i].sequence == -1)
+		{
+			int component_count = 1 + bench_random(&world->rng) % k_bench_component_count;
+			world->refs[i] = ecs_entity_add(world->ecs, bench_mask(world, component_count));
+		}
+	}
+	ecs_update(world->ecs);
+	bench_report("churn respawn+update", removed, timer_get_ticks() - t0);
+}
+
+static void bench_world(heap_t* heap, int count)
+{
+	debug_print(k_print_info, "--- %d entities ---\n", count);
+
+	bench_world_t world = { .heap = heap, .count = count, .rng = 0x9e3779b9 };
+	world.ecs = ecs_create(heap, count);
+	for (int i = 0; i < k_bench_component_count; ++i)
+	{
+		world.component_types[i] = ecs_register_component_type(world.ecs, "bench", sizeof(bench_component_t), _Alignof(bench_component_t), k_ecs_storage_dense);
+	}
+	world.rare_type = ecs_register_component_type(world.ecs, "rare", sizeof(bench_component_t), _Alignof(bench_component_t), k_ecs_storage_sparse);
+	world.refs = heap_alloc(heap, sizeof(ecs_entity_ref_t) * count, 8);
+
+	bench_spawn(&world, "spawn");
+	bench_spawn_initialized(&world);
+	bench_update(&world, "update (promote spawns)");
+	bench_update(&world, "update (idle)");
+
+	bench_query(&world, 1, "query 1 component");
+	bench_query(&world, 2, "query 2 components");
+	bench_query(&world, 4, "query 4 components");
+	bench_query_excluding(&world, "query 2 excluding sparse");
+	bench_view(&world, "view 4 components");
+	bench_query_rare(&world, "query sparse component");
+	bench_random_get(&world, "random get_component");
+
+	bench_churn(&world);
+
+	bench_query(&world, 1, "query 1 component (churned)");
+	bench_query(&world, 4, "query 4 components (churned)");
+	bench_view(&world, "view 4 components (churned)");
+	bench_random_get(&world, "random get (churned)");
+
+	heap_free(heap, world.refs);
+	ecs_destroy(world.ecs);
+}
+
+void ecs_bench_run(heap_t* heap)
+{
+	const int counts[] = { 1000, 10000, 100000, 1000000 };
+	for (int i = 0; i < _countof(counts); ++i)
+	{
+		bench_world(heap, counts[i]);
+	}
+}
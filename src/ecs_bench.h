@@ -0,0 +1,10 @@
+#pragma once
+
+// Entity Component System Benchmarks
+// Measures how the entity component system scales with entity count.
+
+typedef struct heap_t heap_t;
+
+// Run the full benchmark suite and print results.
+// Worlds from 1k to 1M entities are allocated out of the provided heap.
+void ecs_bench_run(heap_t* heap);
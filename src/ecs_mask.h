@@ -0,0 +1,162 @@
+#pragma once
+
+// Entity Component Masks
+// 256-bit sets of component types with SIMD match kernels.
+// AVX2 kernels are used when compiled with /arch:AVX2, SSE2 on x86/x64 otherwise,
+// and scalar code elsewhere. A match is one xor plus one test on AVX2.
+// Kernels use unaligned loads, so masks need no more than uint64_t alignment
+// and may be embedded in heap-allocated structs and passed by value.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#define ECS_MASK_AVX2 1
+#include <immintrin.h>
+#elif defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define ECS_MASK_SSE2 1
+#include <emmintrin.h>
+#endif
+
+enum
+{
+	k_ecs_mask_bits = 256,
+};
+
+// Set of component types, one bit per type.
+typedef struct ecs_mask_t
+{
+	uint64_t bits[4];
+} ecs_mask_t;
+
+// Mask of the listed component types, e.g. ECS_MASK(transform_type, model_type).
+#define ECS_MASK(...) ecs_mask_from_types((const int[]) { __VA_ARGS__ }, (int)(sizeof((const int[]) { __VA_ARGS__ }) / sizeof(int)))
+
+// Mask with no component types.
+__forceinline ecs_mask_t ecs_mask_empty()
+{
+	return (ecs_mask_t) { .bits = { 0, 0, 0, 0 } };
+}
+
+// Mask with every component type.
+__forceinline ecs_mask_t ecs_mask_all()
+{
+	return (ecs_mask_t) { .bits = { ~0ULL, ~0ULL, ~0ULL, ~0ULL } };
+}
+
+// Add a component type to a mask.
+__forceinline void ecs_mask_set(ecs_mask_t* mask, int component_type)
+{
+	mask->bits[component_type >> 6] |= 1ULL << (component_type & 63);
+}
+
+// Remove a component type from a mask.
+__forceinline void ecs_mask_clear(ecs_mask_t* mask, int component_type)
+{
+	mask->bits[component_type >> 6] &= ~(1ULL << (component_type & 63));
+}
+
+// Determine if a component type is in a mask.
+__forceinline bool ecs_mask_test(const ecs_mask_t* mask, int component_type)
+{
+	return (mask->bits[component_type >> 6] >> (component_type & 63)) & 1;
+}
+
+// Mask of a list of component types.
+__forceinline ecs_mask_t ecs_mask_from_types(const int* component_types, int count)
+{
+	ecs_mask_t mask = ecs_mask_empty();
+	for (int i = 0; i < count; ++i)
+	{
+		ecs_mask_set(&mask, component_types[i]);
+	}
+	return mask;
+}
+
+// Union of two masks.
+__forceinline ecs_mask_t ecs_mask_or(ecs_mask_t a, ecs_mask_t b)
+{
+	return (ecs_mask_t) { .bits = { a.bits[0] | b.bits[0], a.bits[1] | b.bits[1], a.bits[2] | b.bits[2], a.bits[3] | b.bits[3] } };
+}
+
+// Intersection of two masks.
+__forceinline ecs_mask_t ecs_mask_and(ecs_mask_t a, ecs_mask_t b)
+{
+	return (ecs_mask_t) { .bits = { a.bits[0] & b.bits[0], a.bits[1] & b.bits[1], a.bits[2] & b.bits[2], a.bits[3] & b.bits[3] } };
+}
+
+// Types in a that are not in b.
+__forceinline ecs_mask_t ecs_mask_andnot(ecs_mask_t a, ecs_mask_t b)
+{
+	return (ecs_mask_t) { .bits = { a.bits[0] & ~b.bits[0], a.bits[1] & ~b.bits[1], a.bits[2] & ~b.bits[2], a.bits[3] & ~b.bits[3] } };
+}
+
+// Determine if two masks are equal.
+__forceinline bool ecs_mask_equals(const ecs_mask_t* a, const ecs_mask_t* b)
+{
+	return ((a->bits[0] ^ b->bits[0]) | (a->bits[1] ^ b->bits[1]) | (a->bits[2] ^ b->bits[2]) | (a->bits[3] ^ b->bits[3])) == 0;
+}
+
+// Determine if a mask has no component types.
+__forceinline bool ecs_mask_is_empty(const ecs_mask_t* mask)
+{
+	return (mask->bits[0] | mask->bits[1] | mask->bits[2] | mask->bits[3]) == 0;
+}
+
+// Determine if set contains every type in required.
+__forceinline bool ecs_mask_contains_all(const ecs_mask_t* set, const ecs_mask_t* required)
+{
+#if defined(ECS_MASK_AVX2)
+	return _mm256_testc_si256(_mm256_loadu_si256((const __m256i*)set->bits), _mm256_loadu_si256((const __m256i*)required->bits));
+#elif defined(ECS_MASK_SSE2)
+	__m128i lo = _mm_andnot_si128(_mm_loadu_si128((const __m128i*)&set->bits[0]), _mm_loadu_si128((const __m128i*)&required->bits[0]));
+	__m128i hi = _mm_andnot_si128(_mm_loadu_si128((const __m128i*)&set->bits[2]), _mm_loadu_si128((const __m128i*)&required->bits[2]));
+	return _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_or_si128(lo, hi), _mm_setzero_si128())) == 0xffff;
+#else
+	return ((required->bits[0] & ~set->bits[0]) | (required->bits[1] & ~set->bits[1]) |
+		(required->bits[2] & ~set->bits[2]) | (required->bits[3] & ~set->bits[3])) == 0;
+#endif
+}
+
+// Determine if set contains no type in excluded.
+__forceinline bool ecs_mask_contains_none(const ecs_mask_t* set, const ecs_mask_t* excluded)
+{
+#if defined(ECS_MASK_AVX2)
+	return _mm256_testz_si256(_mm256_loadu_si256((const __m256i*)set->bits), _mm256_loadu_si256((const __m256i*)excluded->bits));
+#elif defined(ECS_MASK_SSE2)
+	__m128i lo = _mm_and_si128(_mm_loadu_si128((const __m128i*)&set->bits[0]), _mm_loadu_si128((const __m128i*)&excluded->bits[0]));
+	__m128i hi = _mm_and_si128(_mm_loadu_si128((const __m128i*)&set->bits[2]), _mm_loadu_si128((const __m128i*)&excluded->bits[2]));
+	return _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_or_si128(lo, hi), _mm_setzero_si128())) == 0xffff;
+#else
+	return ((set->bits[0] & excluded->bits[0]) | (set->bits[1] & excluded->bits[1]) |
+		(set->bits[2] & excluded->bits[2]) | (set->bits[3] & excluded->bits[3])) == 0;
+#endif
+}
+
+// Determine if set contains at least one type in mask.
+__forceinline bool ecs_mask_contains_any(const ecs_mask_t* set, const ecs_mask_t* mask)
+{
+	return !ecs_mask_contains_none(set, mask);
+}
+
+// Determine if set contains every type in required and no type in excluded.
+// Care is required | excluded, precomputed once per query.
+// Bits of set under care must equal required, so the whole test is one xor and one test.
+__forceinline bool ecs_mask_match(const ecs_mask_t* set, const ecs_mask_t* required, const ecs_mask_t* care)
+{
+#if defined(ECS_MASK_AVX2)
+	__m256i diff = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)set->bits), _mm256_loadu_si256((const __m256i*)required->bits));
+	return _mm256_testz_si256(diff, _mm256_loadu_si256((const __m256i*)care->bits));
+#elif defined(ECS_MASK_SSE2)
+	__m128i lo = _mm_and_si128(
+		_mm_xor_si128(_mm_loadu_si128((const __m128i*)&set->bits[0]), _mm_loadu_si128((const __m128i*)&required->bits[0])),
+		_mm_loadu_si128((const __m128i*)&care->bits[0]));
+	__m128i hi = _mm_and_si128(
+		_mm_xor_si128(_mm_loadu_si128((const __m128i*)&set->bits[2]), _mm_loadu_si128((const __m128i*)&required->bits[2])),
+		_mm_loadu_si128((const __m128i*)&care->bits[2]));
+	return _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_or_si128(lo, hi), _mm_setzero_si128())) == 0xffff;
+#else
+	return (((set->bits[0] ^ required->bits[0]) & care->bits[0]) | ((set->bits[1] ^ required->bits[1]) & care->bits[1]) |
+		((set->bits[2] ^ required->bits[2]) & care->bits[2]) | ((set->bits[3] ^ required->bits[3]) & care->bits[3])) == 0;
+#endif
+}
@@ -1,18 +1,40 @@
+#include "collision.h"
+#include "debug.h"
 #include "ecs.h"
+#include "frustum.h"
 #include "fs.h"
 #include "gpu.h"
 #include "heap.h"
+#include "hierarchy.h"
 #include "render.h"
+#include "scheduler.h"
 #include "timer_object.h"
 #include "transform.h"
 #include "wm.h"
 #include "audio.h"
+#include <float.h>
 #include <stdio.h>
 
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <string.h>
 
+enum
+{
+	k_max_entities = 512,
+	// Frames between culling reports, as often as the render system reports.
+	k_cull_report_frames = 1000,
+};
+
+static const char* k_save_path = "frogger_save.bin";
+
+// Collision layers.
+enum
+{
+	k_layer_player = 1 << 0,
+	k_layer_car = 1 << 1,
+};
+
 typedef struct transform_component_t
 {
 	transform_t transform;
@@ -80,10 +102,27 @@ typedef struct frogger_game_t
 	int model_type;
 	int player_type;
 	int car_type;
+	int car_prefab;
+	hierarchy_t* hierarchy;
+	collision_t* collision;
+
+	scheduler_t* scheduler;
+
+	// Keys held last frame, so save and load only trigger on a press.
+	uint32_t last_key_mask;
+
+	// Culling scratch space: world boxes of models, their entities, and the visible subset.
+	aabb_t cull_boxes[k_max_entities];
+	ecs_entity_ref_t cull_entities[k_max_entities];
+	int cull_visible[k_max_entities];
+	// Culling totals since the last report.
+	frustum_stats_t cull_stats;
+	int cull_frames;
 
 	frogger_game_data_t game_data;
 
 	gpu_mesh_info_t square_mesh;
+	aabb_t square_mesh_bounds;
 	gpu_shader_info_t square_shader;
 	fs_work_t* vertex_shader_work;
 	fs_work_t* fragment_shader_work;
@@ -92,33 +131,16 @@ typedef struct frogger_game_t
 static void load_resources(frogger_game_t* game);
 static void unload_resources(frogger_game_t* game);
 static void spawn_player(frogger_game_t* game);
+static void create_prefabs(frogger_game_t* game);
 static void spawn_traffic(frogger_game_t* game);
 static void spawn_camera(frogger_game_t* game);
 static void update_player(frogger_game_t* game);
 static void update_traffic(frogger_game_t* game);
 static void draw_models(frogger_game_t* game);
-
-// get the poition of the 4 corner vertices[top left, bottom left, top right, bottom right] that can define the square model and save it in ret_vec
-static void get_corners(vec3f_t ret_vec[2], transform_t transform)
-{
-	
-	vec3f_t player_translation = transform.translation;
-	vec3f_t player_scale = transform.scale;
-
-	ret_vec[0] = player_translation;
-	ret_vec[1] = player_translation;
-	ret_vec[2] = player_translation;
-	ret_vec[3] = player_translation;
-
-	ret_vec[0].y -= 1 * player_scale.y;
-	ret_vec[0].z -= 1 * player_scale.z;
-	ret_vec[1].y -= 1 * player_scale.y;
-	ret_vec[1].z += 1 * player_scale.z;
-	ret_vec[2].y += 1 * player_scale.y;
-	ret_vec[2].z -= 1 * player_scale.z;
-	ret_vec[3].y += 1 * player_scale.y;
-	ret_vec[3].z += 1 * player_scale.z;
-}
+static void compute_mesh_bounds(const gpu_mesh_info_t* mesh, aabb_t* bounds);
+static const aabb_t* get_mesh_bounds(frogger_game_t* game, const gpu_mesh_info_t* mesh);
+static void model_fixup(void* component, bool is_load, void* user);
+static void add_systems(frogger_game_t* game);
 
 
 frogger_game_t* frogger_game_create(heap_t* heap, fs_t* fs, wm_window_t* window, render_t* render)
@@ -128,15 +150,21 @@ frogger_game_t* frogger_game_create(heap_t* heap, fs_t* fs, wm_window_t* window,
 	game->fs = fs;
 	game->window = window;
 	game->render = render;
+	game->last_key_mask = 0;
+	memset(&game->cull_stats, 0, sizeof(game->cull_stats));
+	game->cull_frames = 0;
 
 	game->timer = timer_object_create(heap, NULL);
 
-	game->ecs = ecs_create(heap);
-	game->transform_type = ecs_register_component_type(game->ecs, "transform", sizeof(transform_component_t), _Alignof(transform_component_t));
-	game->camera_type = ecs_register_component_type(game->ecs, "camera", sizeof(camera_component_t), _Alignof(camera_component_t));
-	game->model_type = ecs_register_component_type(game->ecs, "model", sizeof(model_component_t), _Alignof(model_component_t));
-	game->player_type = ecs_register_component_type(game->ecs, "player", sizeof(player_component_t), _Alignof(player_component_t));
-	game->car_type = ecs_register_component_type(game->ecs, "car", sizeof(car_component_t), _Alignof(car_component_t));
+	game->ecs = ecs_create(heap, k_max_entities);
+	game->transform_type = ecs_register_component_type(game->ecs, "transform", sizeof(transform_component_t), _Alignof(transform_component_t), k_ecs_storage_dense);
+	game->camera_type = ecs_register_component_type(game->ecs, "camera", sizeof(camera_component_t), _Alignof(camera_component_t), k_ecs_storage_sparse);
+	game->model_type = ecs_register_component_type(game->ecs, "model", sizeof(model_component_t), _Alignof(model_component_t), k_ecs_storage_dense);
+	game->player_type = ecs_register_component_type(game->ecs, "player", sizeof(player_component_t), _Alignof(player_component_t), k_ecs_storage_sparse);
+	game->car_type = ecs_register_component_type(game->ecs, "car", sizeof(car_component_t), _Alignof(car_component_t), k_ecs_storage_dense);
+	ecs_set_component_type_fixup(game->ecs, game->model_type, model_fixup, game);
+	game->hierarchy = hierarchy_create(heap, game->ecs, game->transform_type);
+	game->collision = collision_create(heap, game->ecs, hierarchy_get_world_transform_type(game->hierarchy));
 
 	// set player spawn position and finish line
 	game->game_data.player_spawn_pos.z = 16.0f;
@@ -178,10 +206,13 @@ frogger_game_t* frogger_game_create(heap_t* heap, fs_t* fs, wm_window_t* window,
 	game->finish = read_audio_file(heap, "audios/success-fanfare-trumpets-6185.mp3");
 
 	load_resources(game);
+	create_prefabs(game);
 	spawn_player(game);
 	spawn_traffic(game);
 	spawn_camera(game);
 
+	add_systems(game);
+
 	play_audio(game->bgm);
 	return game;
 }
@@ -189,25 +220,127 @@ frogger_game_t* frogger_game_create(heap_t* heap, fs_t* fs, wm_window_t* window,
 void frogger_game_destroy(frogger_game_t* game)
 {
 	uninit_audio_engine();
+	scheduler_destroy(game->scheduler);
+	collision_destroy(game->collision);
+	hierarchy_destroy(game->hierarchy);
 	ecs_destroy(game->ecs);
 	timer_object_destroy(game->timer);
 	unload_resources(game);
 	heap_free(game->heap, game);
 }
 
+void frogger_game_save(frogger_game_t* game, const char* path)
+{
+	size_t size = 0;
+	void* image = ecs_save(game->ecs, game->heap, &size);
+	fs_work_t* work = fs_write(game->fs, path, image, size, true);
+	fs_work_wait(work);
+	fs_work_destroy(work);
+	heap_free(game->heap, image);
+}
+
+bool frogger_game_load(frogger_game_t* game, const char* path)
+{
+	fs_work_t* work = fs_read(game->fs, path, game->heap, false, true);
+	bool loaded = fs_work_get_result(work) == 0 &&
+		ecs_load(game->ecs, fs_work_get_buffer(work), fs_work_get_size(work));
+	fs_work_destroy(work);
+	if (loaded)
+	{
+		hierarchy_reset(game->hierarchy);
+		collision_reset(game->collision);
+	}
+	return loaded;
+}
+
 void frogger_game_update(frogger_game_t* game)
 {
+	// Save and load between frames, while no system is running.
+	uint32_t key_mask = wm_get_key_mask(game->window);
+	uint32_t pressed = key_mask & ~game->last_key_mask;
+	game->last_key_mask = key_mask;
+	if (pressed & k_key_save)
+	{
+		frogger_game_save(game, k_save_path);
+	}
+	if ((pressed & k_key_load) && !frogger_game_load(game, k_save_path))
+	{
+		debug_print(k_print_warning, "No saved game loaded from %s\n", k_save_path);
+	}
+
+	scheduler_run(game->scheduler);
+	render_push_done(game->render);
+}
+
+void frogger_game_trace_schedule(frogger_game_t* game, const char* path)
+{
+	scheduler_trace_start(game->scheduler, path);
+}
+
+static void frame_begin_system(void* user)
+{
+	frogger_game_t* game = user;
 	timer_object_update(game->timer);
 	ecs_update(game->ecs);
-	update_player(game);
-	update_traffic(game);
-	draw_models(game);
-	render_push_done(game->render);
+}
+
+static void update_player_system(void* user)
+{
+	update_player(user);
+}
+
+static void update_traffic_system(void* user)
+{
+	update_traffic(user);
+}
+
+static void collision_system(void* user)
+{
+	frogger_game_t* game = user;
+	collision_update(game->collision);
+}
+
+static void hierarchy_system(void* user)
+{
+	frogger_game_t* game = user;
+	hierarchy_update(game->hierarchy);
+}
+
+static void draw_models_system(void* user)
+{
+	draw_models(user);
+}
+
+static void add_systems(frogger_game_t* game)
+{
+	ecs_mask_t transform_mask = ECS_MASK(game->transform_type);
+	int hierarchy_type = hierarchy_get_component_type(game->hierarchy);
+	int world_transform_type = hierarchy_get_world_transform_type(game->hierarchy);
+	int aabb_type = collision_get_aabb_type(game->collision);
+
+	game->scheduler = scheduler_create(game->heap, 2);
+	scheduler_add_system(game->scheduler, "frame_begin", frame_begin_system, game,
+		ecs_mask_empty(), SCHEDULER_EXCLUSIVE);
+	// update_player plays audio, which no component type covers, so it runs alone.
+	// It queries the broadphase built by the collision system on the previous frame.
+	scheduler_add_system(game->scheduler, "update_player", update_player_system, game,
+		ECS_MASK(game->player_type, aabb_type), SCHEDULER_EXCLUSIVE);
+	scheduler_add_system(game->scheduler, "update_traffic", update_traffic_system, game,
+		ECS_MASK(game->car_type), transform_mask);
+	scheduler_add_system(game->scheduler, "hierarchy", hierarchy_system, game,
+		ECS_MASK(game->transform_type, hierarchy_type), ECS_MASK(world_transform_type));
+	// Collision boxes follow the world transforms written by the hierarchy system.
+	// The broadphase grid is declared as a write of the aabb type, which every query reads.
+	scheduler_add_system(game->scheduler, "collision", collision_system, game,
+		ECS_MASK(world_transform_type), ECS_MASK(aabb_type));
+	// Render packets are not thread safe, so draw_models runs alone.
+	scheduler_add_system(game->scheduler, "draw_models", draw_models_system, game,
+		ECS_MASK(game->camera_type, game->model_type, world_transform_type), SCHEDULER_EXCLUSIVE);
 }
 
 static void load_resources(frogger_game_t* game)
 {
-	game->vertex_shader_work = fs_read(game->fs, "shaders/triangle.vert.spv", game->heap, false, false);
+	game->vertex_shader_work = fs_read(game->fs, "shaders/instanced.vert.spv", game->heap, false, false);
 	game->fragment_shader_work = fs_read(game->fs, "shaders/triangle.frag.spv", game->heap, false, false);
 	game->square_shader = (gpu_shader_info_t)
 	{
@@ -216,6 +349,7 @@ static void load_resources(frogger_game_t* game)
 		.fragment_shader_data = fs_work_get_buffer(game->fragment_shader_work),
 		.fragment_shader_size = fs_work_get_size(game->fragment_shader_work),
 		.uniform_buffer_count = 1,
+		.instance_layout = k_gpu_instance_layout_m4444_c444,
 	};
 
 	static vec3f_t square_verts[] =
@@ -253,7 +387,7 @@ static void load_resources(frogger_game_t* game)
 		.index_data = square_indices,
 		.index_data_size = sizeof(square_indices),
 	};
-
+	compute_mesh_bounds(&game->square_mesh, &game->square_mesh_bounds);
 }
 
 static void unload_resources(frogger_game_t* game)
@@ -264,10 +398,13 @@ static void unload_resources(frogger_game_t* game)
 
 static void spawn_player(frogger_game_t* game)
 {
-	uint64_t k_player_ent_mask =
-		(1ULL << game->transform_type) |
-		(1ULL << game->model_type) |
-		(1ULL << game->player_type);
+	ecs_mask_t k_player_ent_mask = ECS_MASK(
+		game->transform_type,
+		game->model_type,
+		game->player_type,
+		collision_get_aabb_type(game->collision),
+		hierarchy_get_component_type(game->hierarchy),
+		hierarchy_get_world_transform_type(game->hierarchy));
 	game->game_data.player_ent = ecs_entity_add(game->ecs, k_player_ent_mask);
 
 	transform_component_t* transform_comp = ecs_entity_get_component(game->ecs, game->game_data.player_ent, game->transform_type, true);
@@ -279,26 +416,52 @@ static void spawn_player(frogger_game_t* game)
 	model_comp->shader_info = &game->square_shader;
 	model_comp->color.y = 1.0f;
 
+	aabb_component_t* aabb_comp = ecs_entity_get_component(game->ecs, game->game_data.player_ent, collision_get_aabb_type(game->collision), true);
+	aabb_comp->local = (aabb_t) { .min = vec3f_scale(vec3f_one(), -1.0f), .max = vec3f_one() };
+	aabb_comp->layers = k_layer_player;
 }
 
-static void spawn_traffic(frogger_game_t* game)
+static void create_prefabs(frogger_game_t* game)
 {
-	uint64_t k_car_ent_mask =
-		(1ULL << game->transform_type) |
-		(1ULL << game->model_type) |
-		(1ULL << game->car_type);
+	ecs_mask_t k_car_ent_mask = ECS_MASK(
+		game->transform_type,
+		game->model_type,
+		game->car_type,
+		collision_get_aabb_type(game->collision),
+		hierarchy_get_component_type(game->hierarchy),
+		hierarchy_get_world_transform_type(game->hierarchy));
+	game->car_prefab = ecs_register_prefab(game->ecs, k_car_ent_mask);
+
+	transform_component_t* transform_comp = ecs_prefab_get_component(game->ecs, game->car_prefab, game->transform_type);
+	transform_identity(&transform_comp->transform);
+
+	hierarchy_component_t* hierarchy_comp = ecs_prefab_get_component(game->ecs, game->car_prefab, hierarchy_get_component_type(game->hierarchy));
+	hierarchy_comp->parent = (ecs_entity_ref_t) { .entity = -1, .sequence = -1 };
+
+	model_component_t* model_comp = ecs_prefab_get_component(game->ecs, game->car_prefab, game->model_type);
+	model_comp->mesh_info = &game->square_mesh;
+	model_comp->shader_info = &game->square_shader;
+
+	aabb_component_t* aabb_comp = ecs_prefab_get_component(game->ecs, game->car_prefab, collision_get_aabb_type(game->collision));
+	aabb_comp->local = (aabb_t) { .min = vec3f_scale(vec3f_one(), -1.0f), .max = vec3f_one() };
+	aabb_comp->layers = k_layer_car;
+}
 
+static void spawn_traffic(frogger_game_t* game)
+{
+	// Spawn every car in one batch, then set up what differs per car.
+	ecs_entity_ref_t cars[_countof(game->game_data.traffic) * _countof(game->game_data.traffic[0])];
+	ecs_spawn_batch(game->ecs, game->car_prefab, _countof(cars), cars);
 
 	for (int c = 0; c < 5; c++)
 	{
 
 		for (int t = 0; t < 3; t++)
 		{
-			ecs_entity_ref_t car_ent = ecs_entity_add(game->ecs, k_car_ent_mask);
+			ecs_entity_ref_t car_ent = cars[c * 3 + t];
 			game->game_data.traffic[t][c] = car_ent;
 
 			transform_component_t* transform_comp = ecs_entity_get_component(game->ecs, car_ent, game->transform_type, true);
-			transform_identity(&transform_comp->transform);
 			transform_comp->transform.translation = game->game_data.traffic_starts[t];
 
 			int dir = (int) (game->game_data.traffic_velocity[t].y / fabs(game->game_data.traffic_velocity[t].y));
@@ -321,8 +484,6 @@ static void spawn_traffic(frogger_game_t* game)
 
 
 			model_component_t* model_comp = ecs_entity_get_component(game->ecs, car_ent, game->model_type, true);
-			model_comp->mesh_info = &game->square_mesh;
-			model_comp->shader_info = &game->square_shader;
 			model_comp->color.x = (float)rand() / RAND_MAX;
 			model_comp->color.y = (float)rand() / RAND_MAX;
 			model_comp->color.z = (float)rand() / RAND_MAX;
@@ -333,8 +494,7 @@ static void spawn_traffic(frogger_game_t* game)
 
 static void spawn_camera(frogger_game_t* game)
 {
-	uint64_t k_camera_ent_mask =
-		(1ULL << game->camera_type);
+	ecs_mask_t k_camera_ent_mask = ECS_MASK(game->camera_type);
 	game->game_data.camera_ent = ecs_entity_add(game->ecs, k_camera_ent_mask);
 
 	camera_component_t* camera_comp = ecs_entity_get_component(game->ecs, game->game_data.camera_ent, game->camera_type, true);
@@ -363,35 +523,14 @@ static void update_player(frogger_game_t* game)
 		player_transform_comp->transform.translation = game->game_data.player_spawn_pos;
 	}
 	 
-	// get the poition of the 4 corner vertices of the player to compute collision
-
-	vec3f_t player_corners[4];
-	get_corners(player_corners, player_transform_comp->transform);
-
-	// collision detection: loop through all cars and check if collide with the player
-	int collide = false;
-	for (int c = 0; c < 5; c++)
+	// collision detection: ask the broadphase for any car overlapping the player
+	aabb_t player_box;
+	collision_hit_t hit;
+	if (collision_get_world_aabb(game->collision, player, &player_box) &&
+		collision_query_boxes(game->collision, &player_box, 1, k_layer_car, &hit, 1) > 0)
 	{
-		if (collide) { break; }
-		for (int t = 0; t < 3; t++)
-		{
-			transform_component_t* car_transform_comp = ecs_entity_get_component(game->ecs, game->game_data.traffic[t][c], game->transform_type, true);
-			vec3f_t car_corners[4];
-			get_corners(car_corners, car_transform_comp->transform);
-			for (int i = 0; i < 4; i++)
-			{
-				if (player_corners[i].y > car_corners[0].y &&
-					player_corners[i].z > car_corners[0].z &&
-					player_corners[i].y < car_corners[3].y &&
-					player_corners[i].z < car_corners[3].z)
-				{
-					player_transform_comp->transform.translation = game->game_data.player_spawn_pos;
-					play_audio(game->crash);
-					collide = true;
-					break;
-				}
-			}
-		}
+		player_transform_comp->transform.translation = game->game_data.player_spawn_pos;
+		play_audio(game->crash);
 	}
 
 	// player movement
@@ -478,21 +617,89 @@ static void update_traffic(frogger_game_t* game)
 
 static void draw_models(frogger_game_t* game)
 {
-	uint64_t k_camera_query_mask = (1ULL << game->camera_type);
+	frustum_stats_t stats = { 0 };
+
+	// Columns are NULL, with an error already printed, if the types are not dense or do not match.
+	int world_transform_type = hierarchy_get_world_transform_type(game->hierarchy);
+	const world_transform_component_t* world_transforms = ECS_COLUMN(game->ecs, world_transform_component_t, world_transform_type);
+	const model_component_t* models = ECS_COLUMN(game->ecs, model_component_t, game->model_type);
+	if (!world_transforms || !models)
+	{
+		return;
+	}
+
+	ecs_mask_t k_camera_query_mask = ECS_MASK(game->camera_type);
 	for (ecs_query_t camera_query = ecs_query_create(game->ecs, k_camera_query_mask);
 		ecs_query_is_valid(game->ecs, &camera_query);
 		ecs_query_next(game->ecs, &camera_query))
 	{
-		camera_component_t* camera_comp = ecs_query_get_component(game->ecs, &camera_query, game->camera_type);
+		const camera_component_t* camera_comp = ecs_query_get_component_const(game->ecs, &camera_query, game->camera_type);
+
+		mat4f_t view_projection;
+		mat4f_mul(&view_projection, &camera_comp->view, &camera_comp->projection);
+		frustum_t frustum;
+		frustum_from_matrix(&frustum, &view_projection);
 
-		uint64_t k_model_query_mask = (1ULL << game->transform_type) | (1ULL << game->model_type);
-		for (ecs_query_t query = ecs_query_create(game->ecs, k_model_query_mask);
-			ecs_query_is_valid(game->ecs, &query);
-			ecs_query_next(game->ecs, &query))
+		// Camera matrices are shared by every instanced model drawn from this camera.
+		ecs_entity_ref_t camera_ref = ecs_query_get_entity(game->ecs, &camera_query);
+		struct
 		{
-			transform_component_t* transform_comp = ecs_query_get_component(game->ecs, &query, game->transform_type);
-			model_component_t* model_comp = ecs_query_get_component(game->ecs, &query, game->model_type);
-			ecs_entity_ref_t entity_ref = ecs_query_get_entity(game->ecs, &query);
+			mat4f_t projection;
+			mat4f_t view;
+		} view_uniform_data = { camera_comp->projection, camera_comp->view };
+		gpu_uniform_buffer_info_t view_uniform_info = { .data = &view_uniform_data, sizeof(view_uniform_data) };
+
+		// Gather world boxes of every model, then cull them in one batch.
+		// Models with unknown bounds get an unbounded box and are always drawn.
+		int box_count = 0;
+		ecs_mask_t k_model_query_mask = ECS_MASK(world_transform_type, game->model_type);
+		for (ecs_view_t view = ecs_view_create(game->ecs, k_model_query_mask, ecs_mask_empty());
+			ecs_view_is_valid(game->ecs, &view);
+			ecs_view_next(game->ecs, &view))
+		{
+			for (int i = view.begin; i < view.end; ++i)
+			{
+				// Loaded images may hold models whose resources no longer exist.
+				if (!models[i].mesh_info || !models[i].shader_info)
+				{
+					continue;
+				}
+
+				const aabb_t* bounds = get_mesh_bounds(game, models[i].mesh_info);
+				if (bounds)
+				{
+					aabb_transform(&game->cull_boxes[box_count], bounds, &world_transforms[i].matrix);
+				}
+				else
+				{
+					// Large but finite, so plane distances cannot become inf - inf.
+					game->cull_boxes[box_count] = (aabb_t) { .min = vec3f_scale(vec3f_one(), -1e30f), .max = vec3f_scale(vec3f_one(), 1e30f) };
+				}
+				game->cull_entities[box_count] = ecs_view_get_entity(game->ecs, &view, i);
+				box_count++;
+			}
+		}
+
+		int visible_count = frustum_cull_boxes(&frustum, game->cull_boxes, box_count, game->cull_visible);
+		stats.tested += box_count;
+		stats.visible += visible_count;
+
+		for (int v = 0; v < visible_count; ++v)
+		{
+			ecs_entity_ref_t entity_ref = game->cull_entities[game->cull_visible[v]];
+			const world_transform_component_t* world_transform_comp = &world_transforms[entity_ref.entity];
+			const model_component_t* model_comp = &models[entity_ref.entity];
+
+			if (model_comp->shader_info->instance_layout == k_gpu_instance_layout_m4444_c444)
+			{
+				struct
+				{
+					mat4f_t model;
+					vec3f_t color;
+				} instance_data = { world_transform_comp->matrix, model_comp->color };
+				render_push_instanced_model(game->render, &camera_ref, model_comp->mesh_info, model_comp->shader_info, &view_uniform_info, &instance_data);
+				continue;
+			}
 
 			struct
 			{
@@ -506,10 +713,64 @@ static void draw_models(frogger_game_t* game)
 
 			uniform_data.projection = camera_comp->projection;
 			uniform_data.view = camera_comp->view;
-			transform_to_matrix(&transform_comp->transform, &uniform_data.model);
+			uniform_data.model = world_transform_comp->matrix;
 			gpu_uniform_buffer_info_t uniform_info = { .data = &uniform_data, sizeof(uniform_data) };
 
 			render_push_model(game->render, &entity_ref, model_comp->mesh_info, model_comp->shader_info, &uniform_info);
 		}
 	}
-}
\ No newline at end of file
+
+	game->cull_stats.tested += stats.tested;
+	game->cull_stats.visible += stats.visible;
+	if (++game->cull_frames == k_cull_report_frames)
+	{
+		debug_print(k_print_info, "Culling: %.1f of %.1f models visible per frame over %d frames.\n",
+			(double)game->cull_stats.visible / game->cull_frames, (double)game->cull_stats.tested / game->cull_frames, game->cull_frames);
+		memset(&game->cull_stats, 0, sizeof(game->cull_stats));
+		game->cull_frames = 0;
+	}
+}
+
+// Bounds of the vertex positions of a mesh.
+static void compute_mesh_bounds(const gpu_mesh_info_t* mesh, aabb_t* bounds)
+{
+	// Position leads each vertex; the layout decides what follows it.
+	size_t stride = mesh->layout == k_gpu_mesh_layout_tri_p444_c444_i2 ? sizeof(vec3f_t) * 2 : sizeof(vec3f_t);
+	size_t vertex_count = mesh->vertex_data_size / stride;
+
+	bounds->min = vec3f_scale(vec3f_one(), FLT_MAX);
+	bounds->max = vec3f_scale(vec3f_one(), -FLT_MAX);
+	for (size_t i = 0; i < vertex_count; ++i)
+	{
+		const vec3f_t* position = (const vec3f_t*)((const char*)mesh->vertex_data + stride * i);
+		bounds->min = vec3f_min(bounds->min, *position);
+		bounds->max = vec3f_max(bounds->max, *position);
+	}
+}
+
+static const aabb_t* get_mesh_bounds(frogger_game_t* game, const gpu_mesh_info_t* mesh)
+{
+	return mesh == &game->square_mesh ? &game->square_mesh_bounds : NULL;
+}
+
+// Model components point at game-owned resources; images store them as resource ids.
+static void model_fixup(void* component, bool is_load, void* user)
+{
+	frogger_game_t* game = user;
+	model_component_t* model_comp = component;
+	if (is_load)
+	{
+		// Unknown ids leave the model without resources; draw_models() skips it.
+		if ((uintptr_t)model_comp->mesh_info > 1 || (uintptr_t)model_comp->shader_info > 1)
+		{
+			debug_print(k_print_error, "Loaded model has unknown resource ids; it will not be drawn.\n");
+		}
+		model_comp->mesh_info = (uintptr_t)model_comp->mesh_info == 1 ? &game->square_mesh : NULL;
+		model_comp->shader_info = (uintptr_t)model_comp->shader_info == 1 ? &game->square_shader : NULL;
+	}
+	else
+	{
+		model_comp->mesh_info = (gpu_mesh_info_t*)(uintptr_t)(model_comp->mesh_info == &game->square_mesh);
+		model_comp->shader_info = (gpu_shader_info_t*)(uintptr_t)(model_comp->shader_info == &game->square_shader);
+	}
+}
@@ -3,6 +3,8 @@
 // Simple Test Game
 // Brings together major engine systems to make a very simple "game."
 
+#include <stdbool.h>
+
 typedef struct simple_game_t simple_game_t;
 
 typedef struct fs_t fs_t;
@@ -17,4 +19,15 @@ simple_game_t* frogger_game_create(heap_t* heap, fs_t* fs, wm_window_t* window,
 void frogger_game_destroy(simple_game_t* game);
 
 // Per-frame update for our simple test game.
+// F5 saves the world and F9 restores the last save.
 void frogger_game_update(simple_game_t* game);
+
+// Record the system schedule of every following frame.
+// A Chrome trace file is written to path when the game is destroyed.
+void frogger_game_trace_schedule(simple_game_t* game, const char* path);
+
+// Save the game world to a compressed file.
+void frogger_game_save(simple_game_t* game, const char* path);
+
+// Restore the game world from a file written by frogger_game_save().
+bool frogger_game_load(simple_game_t* game, const char* path);
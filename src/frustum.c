@@ -0,0 +1,93 @@
+#include "frustum.h"
+
+#include "simd.h"
+#include "vec3f_soa.h"
+
+void frustum_from_matrix(frustum_t* frustum, const mat4f_t* view_projection)
+{
+	// Clip coordinates are p * view_projection, so each clip component is a column.
+	// Each plane combines the w column with one other column.
+	static const float k_signs[6] = { 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f };
+	static const int k_columns[6] = { 0, 0, 1, 1, 2, 2 };
+	for (int p = 0; p < 6; ++p)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			const float* row = view_projection->data[i];
+			frustum->planes[p][i] = row[3] + k_signs[p] * row[k_columns[p]];
+		}
+	}
+
+	// Near plane is z >= 0, without the w column.
+	for (int i = 0; i < 4; ++i)
+	{
+		frustum->planes[4][i] = view_projection->data[i][2];
+	}
+}
+
+bool frustum_overlaps_box(const frustum_t* frustum, const aabb_t* box)
+{
+	vec3f_t center = vec3f_scale(vec3f_add(box->min, box->max), 0.5f);
+	vec3f_t extent = vec3f_scale(vec3f_sub(box->max, box->min), 0.5f);
+	for (int p = 0; p < 6; ++p)
+	{
+		const float* plane = frustum->planes[p];
+
+		// Distance of the box corner furthest along the plane normal.
+		float distance = plane[0] * center.x + plane[1] * center.y + plane[2] * center.z + plane[3] +
+			fabsf(plane[0]) * extent.x + fabsf(plane[1]) * extent.y + fabsf(plane[2]) * extent.z;
+		if (distance < 0.0f)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+int frustum_cull_boxes(const frustum_t* frustum, const aabb_t* boxes, int box_count, int* visible)
+{
+	vec3f_x4_t normals[6];
+	vec3f_x4_t abs_normals[6];
+	simd4f_t offsets[6];
+	for (int p = 0; p < 6; ++p)
+	{
+		const float* plane = frustum->planes[p];
+		normals[p] = vec3f_x4_splat((vec3f_t) { .x = plane[0], .y = plane[1], .z = plane[2] });
+		abs_normals[p] = vec3f_x4_splat((vec3f_t) { .x = fabsf(plane[0]), .y = fabsf(plane[1]), .z = fabsf(plane[2]) });
+		offsets[p] = simd4f_splat(plane[3]);
+	}
+
+	int visible_count = 0;
+	int i = 0;
+	simd4f_t half = simd4f_splat(0.5f);
+	for (; i + 4 <= box_count; i += 4)
+	{
+		vec3f_x4_t min = vec3f_x4_gather(&boxes[i].min, sizeof(aabb_t));
+		vec3f_x4_t max = vec3f_x4_gather(&boxes[i].max, sizeof(aabb_t));
+		vec3f_x4_t center = vec3f_x4_scale(vec3f_x4_add(min, max), half);
+		vec3f_x4_t extent = vec3f_x4_scale(vec3f_x4_sub(max, min), half);
+
+		// Smallest distance over all planes of the box corner furthest along each plane normal.
+		simd4f_t distance = simd4f_add(simd4f_add(vec3f_x4_dot(normals[0], center), offsets[0]), vec3f_x4_dot(abs_normals[0], extent));
+		for (int p = 1; p < 6; ++p)
+		{
+			simd4f_t d = simd4f_add(simd4f_add(vec3f_x4_dot(normals[p], center), offsets[p]), vec3f_x4_dot(abs_normals[p], extent));
+			distance = simd4f_min(distance, d);
+		}
+
+		float distances[4];
+		simd4f_store(distances, distance);
+		for (int lane = 0; lane < 4; ++lane)
+		{
+			visible[visible_count] = i + lane;
+			visible_count += distances[lane] >= 0.0f;
+		}
+	}
+
+	for (; i < box_count; ++i)
+	{
+		visible[visible_count] = i;
+		visible_count += frustum_overlaps_box(frustum, &boxes[i]);
+	}
+	return visible_count;
+}
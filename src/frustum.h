@@ -0,0 +1,39 @@
+#pragma once
+
+// View Frustum Culling
+// Planes of a camera's view volume and batched tests of bounding boxes against them.
+
+#include "aabb.h"
+#include "mat4f.h"
+
+#include <stdbool.h>
+
+// Six clip planes of a view volume: left, right, bottom, top, near and far.
+// A point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0.
+typedef struct frustum_t
+{
+	float planes[6][4];
+} frustum_t;
+
+// Per-frame culling counters.
+typedef struct frustum_stats_t
+{
+	// Boxes tested against a frustum.
+	int tested;
+	// Boxes found at least partly inside.
+	int visible;
+} frustum_stats_t;
+
+// Extract world space planes from a view matrix concatenated with a projection matrix,
+// e.g. mat4f_mul(&view_projection, &view, &projection).
+// Points are clipped as the GPU does: -w <= x, y <= w and 0 <= z <= w.
+void frustum_from_matrix(frustum_t* frustum, const mat4f_t* view_projection);
+
+// Determine if a world space box is at least partly inside a frustum.
+// Boxes near a frustum corner may pass while fully outside; the test never rejects a visible box.
+bool frustum_overlaps_box(const frustum_t* frustum, const aabb_t* box);
+
+// Test box_count world space boxes against a frustum, four at a time.
+// Writes the indices of boxes at least partly inside, in increasing order, to visible.
+// Visible must hold box_count entries. Returns the number of visible boxes.
+int frustum_cull_boxes(const frustum_t* frustum, const aabb_t* boxes, int box_count, int* visible);
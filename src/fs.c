@@ -26,11 +26,13 @@ typedef enum fs_work_op_t
 
 typedef struct fs_work_t
 {
+	heap_t* work_heap;
 	heap_t* heap;
 	fs_work_op_t op;
 	char path[1024];
 	bool null_terminate;
 	bool use_compression;
+	bool owns_buffer;
 	void* buffer;
 	size_t size;
 	event_t* done;
@@ -59,8 +61,10 @@ void fs_destroy(fs_t* fs)
 fs_work_t* fs_read(fs_t* fs, const char* path, heap_t* heap, bool null_terminate, bool use_compression)
 {
 	fs_work_t* work = heap_alloc(fs->heap, sizeof(fs_work_t), 8);
+	work->work_heap = fs->heap;
 	work->heap = heap;
 	work->op = k_fs_work_op_read;
+	work->owns_buffer = true;
 	strcpy_s(work->path, sizeof(work->path), path);
 	work->buffer = NULL;
 	work->size = 0;
@@ -75,8 +79,10 @@ fs_work_t* fs_read(fs_t* fs, const char* path, heap_t* heap, bool null_terminate
 fs_work_t* fs_write(fs_t* fs, const char* path, const void* buffer, size_t size, bool use_compression)
 {
 	fs_work_t* work = heap_alloc(fs->heap, sizeof(fs_work_t), 8);
+	work->work_heap = fs->heap;
 	work->heap = fs->heap;
 	work->op = k_fs_work_op_write;
+	work->owns_buffer = use_compression;
 	strcpy_s(work->path, sizeof(work->path), path);
 	work->buffer = (void*)buffer;
 	work->size = size;
@@ -143,8 +149,12 @@ void fs_work_destroy(fs_work_t* work)
 	{
 		event_wait(work->done);
 		event_destroy(work->done);
-		heap_free(work->heap, work);
-		heap_free(work->heap, work->buffer);
+		// Failed reads never allocate a buffer.
+		if (work->owns_buffer && work->buffer)
+		{
+			heap_free(work->heap, work->buffer);
+		}
+		heap_free(work->work_heap, work);
 	}
 }
 
@@ -246,11 +256,6 @@ static void file_write(fs_work_t* work)
 
 	CloseHandle(handle);
 
-	// HOMEWORK 2: Queue file write work on compression queue!
-	if (work->use_compression)
-	{
-		heap_free(work->heap, work->buffer);
-	}
 	event_signal(work->done);
 }
 
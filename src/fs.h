@@ -29,6 +29,8 @@ fs_work_t* fs_read(fs_t* fs, const char* path, heap_t* heap, bool null_terminate
 
 // Queue a file write.
 // File at the specified path will be written in full.
+// The buffer is not copied and must remain valid until the work is done,
+// unless compression is used. The caller keeps ownership of the buffer.
 // Returns a work object.
 fs_work_t* fs_write(fs_t* fs, const char* path, const void* buffer, size_t size, bool use_compression);
 
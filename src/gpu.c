@@ -1,7 +1,12 @@
+// Vulkan backend. Builds with GPU_NULL defined use gpu_null.c instead.
+#if !defined(GPU_NULL)
+
 #include "gpu.h"
 
 #include "debug.h"
+#include "fs.h"
 #include "heap.h"
+#include "timer.h"
 #include "wm.h"
 
 #define VK_USE_PLATFORM_WIN32_KHR
@@ -10,6 +15,70 @@
 #include <malloc.h>
 #include <string.h>
 
+enum
+{
+	// Bytes of uniform data each frame in flight may write.
+	k_gpu_uniform_frame_size = 1024 * 1024,
+	// Bytes of device memory allocated at once; larger buffers get a block of their own size.
+	k_gpu_memory_block_size = 32 * 1024 * 1024,
+	// Upload batches in flight, each with its own region of staging memory.
+	k_gpu_upload_batch_count = 4,
+	k_gpu_upload_batch_size = 4 * 1024 * 1024,
+};
+
+static const char* k_gpu_pipeline_cache_path = "pipeline_cache.bin";
+
+// A range of unused bytes in a memory block.
+typedef struct gpu_memory_range_t
+{
+	VkDeviceSize offset;
+	VkDeviceSize size;
+} gpu_memory_range_t;
+
+// One vkAllocateMemory allocation that buffers are placed in.
+typedef struct gpu_memory_block_t
+{
+	VkDeviceMemory memory;
+	VkDeviceSize size;
+	uint32_t type_index;
+	// Mapped for the lifetime of the block if its memory is host visible.
+	char* data;
+	// Unused ranges sorted by offset. Freed ranges merge with their neighbours,
+	// so a block holds as few ranges as its allocations allow.
+	gpu_memory_range_t* free_ranges;
+	int free_count;
+	int free_capacity;
+	int allocation_count;
+	struct gpu_memory_block_t* next;
+} gpu_memory_block_t;
+
+// Part of a memory block holding one buffer.
+typedef struct gpu_allocation_t
+{
+	gpu_memory_block_t* block;
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	// Address of the allocation if its memory is host visible, else NULL.
+	char* data;
+} gpu_allocation_t;
+
+// Copies from staging memory recorded into one command buffer and submitted together.
+typedef struct gpu_upload_batch_t
+{
+	VkCommandBuffer cmd_buffer;
+	// Signaled when the copies are done and the batch's staging region may be rewritten.
+	VkFence fence;
+	bool recording;
+	VkDeviceSize staging_used;
+} gpu_upload_batch_t;
+
+// Blocks of one memory type.
+typedef struct gpu_memory_type_t
+{
+	gpu_memory_block_t* blocks;
+	gpu_memory_stats_t stats;
+} gpu_memory_type_t;
+
 typedef struct gpu_cmd_buffer_t
 {
 	VkCommandBuffer buffer;
@@ -21,17 +90,26 @@ typedef struct gpu_cmd_buffer_t
 typedef struct gpu_descriptor_t
 {
 	VkDescriptorSet set;
+	int uniform_buffer_count;
 } gpu_descriptor_t;
 
+typedef struct gpu_instance_buffer_t
+{
+	VkBuffer buffer;
+	// Host visible, so mapped for the lifetime of the buffer.
+	gpu_allocation_t allocation;
+	size_t size;
+} gpu_instance_buffer_t;
+
 typedef struct gpu_mesh_t
 {
 	VkBuffer index_buffer;
-	VkDeviceMemory index_memory;
+	gpu_allocation_t index_allocation;
 	int index_count;
 	VkIndexType index_type;
 
 	VkBuffer vertex_buffer;
-	VkDeviceMemory vertex_memory;
+	gpu_allocation_t vertex_allocation;
 	int vertex_count;
 } gpu_mesh_t;
 
@@ -48,13 +126,6 @@ typedef struct gpu_shader_t
 	VkDescriptorSetLayout descriptor_set_layout;
 } gpu_shader_t;
 
-typedef struct gpu_uniform_buffer_t
-{
-	VkBuffer buffer;
-	VkDeviceMemory memory;
-	VkDescriptorBufferInfo descriptor;
-} gpu_uniform_buffer_t;
-
 typedef struct gpu_frame_t
 {
 	VkImage image;
@@ -62,16 +133,24 @@ typedef struct gpu_frame_t
 	VkFramebuffer frame_buffer;
 	VkFence fence;
 	gpu_cmd_buffer_t* cmd_buffer;
+	// Secondary command buffers, each allocated from its own pool so threads can record them concurrently.
+	VkCommandPool secondary_cmd_pools[k_gpu_max_secondary_cmd_buffers];
+	gpu_cmd_buffer_t secondary_cmd_buffers[k_gpu_max_secondary_cmd_buffers];
+	// Takes ownership of buffers uploaded on the transfer queue, submitted ahead of the frame.
+	VkCommandBuffer acquire_cmd_buffer;
 } gpu_frame_t;
 
 typedef struct gpu_t
 {
 	heap_t* heap;
+	fs_t* fs;
 	VkInstance instance;
 	VkPhysicalDevice physical_device;
 	VkDevice logical_device;
 	VkPhysicalDeviceMemoryProperties memory_properties;
+	gpu_memory_type_t memory_types[VK_MAX_MEMORY_TYPES];
 	VkQueue queue;
+	uint32_t queue_family_index;
 	VkSurfaceKHR surface;
 	VkSwapchainKHR swap_chain;
 
@@ -84,9 +163,39 @@ typedef struct gpu_t
 	VkCommandPool cmd_pool;
 	VkDescriptorPool descriptor_pool;
 
+	// Seeded from the last run's file, so pipelines seen before skip most of their compile.
+	VkPipelineCache pipeline_cache;
+	uint64_t pipeline_compile_ticks;
+	int pipeline_compile_count;
+
 	VkSemaphore present_complete_sema;
 	VkSemaphore render_complete_sema;
 
+	// Mesh data is uploaded on a dedicated transfer queue if the device has one, else on the graphics queue.
+	VkQueue transfer_queue;
+	uint32_t transfer_queue_family_index;
+	VkCommandPool transfer_cmd_pool;
+	// Host visible memory that uploads are copied from, k_gpu_upload_batch_size bytes per batch.
+	VkBuffer staging_buffer;
+	gpu_allocation_t staging_allocation;
+	gpu_upload_batch_t upload_batches[k_gpu_upload_batch_count];
+	int upload_batch_index;
+	// Timeline semaphore reaching each batch's serial when it completes. Frames wait for the latest serial.
+	VkSemaphore upload_sema;
+	uint64_t upload_serial;
+	// Ownership transfers of uploaded buffers to the graphics queue, recorded into the next frame.
+	VkBufferMemoryBarrier* acquire_barriers;
+	int acquire_count;
+	int acquire_capacity;
+
+	// Uniform data of all frames in flight, one k_gpu_uniform_frame_size region per frame.
+	// Mapped for the lifetime of the gpu; each frame writes its region front to back.
+	VkBuffer uniform_buffer;
+	gpu_allocation_t uniform_allocation;
+	size_t uniform_alignment;
+	size_t uniform_cursor;
+	size_t uniform_end;
+
 	VkPipelineInputAssemblyStateCreateInfo mesh_input_assembly_info[k_gpu_mesh_layout_count];
 	VkPipelineVertexInputStateCreateInfo mesh_vertex_input_info[k_gpu_mesh_layout_count];
 	VkIndexType mesh_vertex_size[k_gpu_mesh_layout_count];
@@ -101,15 +210,33 @@ typedef struct gpu_t
 	uint32_t frame_index;
 } gpu_t;
 
+static bool pipeline_cache_is_valid(const void* data, size_t size, const VkPhysicalDeviceProperties* properties);
+static void pipeline_cache_save(gpu_t* gpu);
+static void set_viewport(gpu_t* gpu, VkCommandBuffer cmd_buffer);
 static void create_mesh_layouts(gpu_t* gpu);
 static void destroy_mesh_layouts(gpu_t* gpu);
 static uint32_t get_memory_type_index(gpu_t* gpu, uint32_t bits, VkMemoryPropertyFlags properties);
-
-gpu_t* gpu_create(heap_t* heap, wm_window_t* window)
+static bool create_buffer(gpu_t* gpu, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer* buffer, gpu_allocation_t* allocation);
+static void destroy_buffer(gpu_t* gpu, VkBuffer buffer, gpu_allocation_t* allocation);
+static void upload_buffer(gpu_t* gpu, VkBuffer buffer, const void* data, VkDeviceSize size, VkAccessFlags dst_access);
+static gpu_upload_batch_t* upload_batch_begin(gpu_t* gpu);
+static void upload_batch_submit(gpu_t* gpu);
+static bool memory_alloc(gpu_t* gpu, const VkMemoryRequirements* reqs, VkMemoryPropertyFlags properties, gpu_allocation_t* allocation);
+static void memory_free(gpu_t* gpu, gpu_allocation_t* allocation);
+static gpu_memory_block_t* memory_block_create(gpu_t* gpu, uint32_t type_index, VkDeviceSize size);
+static void memory_block_destroy(gpu_t* gpu, gpu_memory_block_t* block);
+static bool memory_block_find_range(gpu_memory_block_t* block, VkDeviceSize size, VkDeviceSize alignment, int* range, VkDeviceSize* leftover);
+static VkDeviceSize memory_block_take_range(gpu_t* gpu, gpu_memory_block_t* block, int range, VkDeviceSize size, VkDeviceSize alignment);
+static void memory_block_return_range(gpu_t* gpu, gpu_memory_block_t* block, VkDeviceSize offset, VkDeviceSize size);
+static void memory_block_insert_range(gpu_t* gpu, gpu_memory_block_t* block, int index, VkDeviceSize offset, VkDeviceSize size);
+static uint32_t get_instance_attributes(gpu_instance_layout_t layout, VkVertexInputAttributeDescription* attributes);
+
+gpu_t* gpu_create(heap_t* heap, fs_t* fs, wm_window_t* window, const void* backend_config)
 {
 	gpu_t* gpu = heap_alloc(heap, sizeof(gpu_t), 8);
 	memset(gpu, 0, sizeof(*gpu));
 	gpu->heap = heap;
+	gpu->fs = fs;
 
 	//////////////////////////////////////////////////////
 	// Create VkInstance
@@ -184,7 +311,7 @@ gpu_t* gpu_create(heap_t* heap, wm_window_t* window)
 	gpu->physical_device = physical_devices[0];
 
 	//////////////////////////////////////////////////////
-	// Create a VkDevice with graphics queue
+	// Create a VkDevice with graphics and transfer queues
 	//////////////////////////////////////////////////////
 
 	uint32_t queue_family_count = 0;
@@ -211,23 +338,52 @@ gpu_t* gpu_create(heap_t* heap, wm_window_t* window)
 		return NULL;
 	}
 
+	// A queue family with transfer but not graphics support is usually a DMA engine
+	// that copies alongside rendering.
+	uint32_t transfer_queue_family_index = queue_family_index;
+	for (uint32_t i = 0; i < queue_family_count; ++i)
+	{
+		if (queue_families[i].queueCount > 0 &&
+			(queue_families[i].queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+			!(queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+		{
+			transfer_queue_family_index = i;
+			break;
+		}
+	}
+
 	float* queue_priorites = alloca(sizeof(float) * queue_count);
 	memset(queue_priorites, 0, sizeof(float) * queue_count);
 
-	VkDeviceQueueCreateInfo queue_info =
+	VkDeviceQueueCreateInfo queue_infos[2] =
 	{
-		.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-		.queueFamilyIndex = queue_family_index,
-		.queueCount = queue_count,
-		.pQueuePriorities = queue_priorites,
+		{
+			.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+			.queueFamilyIndex = queue_family_index,
+			.queueCount = queue_count,
+			.pQueuePriorities = queue_priorites,
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+			.queueFamilyIndex = transfer_queue_family_index,
+			.queueCount = 1,
+			.pQueuePriorities = queue_priorites,
+		},
+	};
+
+	VkPhysicalDeviceVulkan12Features features12 =
+	{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+		.timelineSemaphore = VK_TRUE,
 	};
 
 	const char* device_extensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 	VkDeviceCreateInfo device_info =
 	{
 		.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-		.queueCreateInfoCount = 1,
-		.pQueueCreateInfos = &queue_info,
+		.pNext = &features12,
+		.queueCreateInfoCount = transfer_queue_family_index != queue_family_index ? 2 : 1,
+		.pQueueCreateInfos = queue_infos,
 		.enabledExtensionCount = _countof(device_extensions),
 		.ppEnabledExtensionNames = device_extensions,
 	};
@@ -241,6 +397,9 @@ gpu_t* gpu_create(heap_t* heap, wm_window_t* window)
 
 	vkGetPhysicalDeviceMemoryProperties(gpu->physical_device, &gpu->memory_properties);
 	vkGetDeviceQueue(gpu->logical_device, queue_family_index, 0, &gpu->queue);
+	vkGetDeviceQueue(gpu->logical_device, transfer_queue_family_index, 0, &gpu->transfer_queue);
+	gpu->queue_family_index = queue_family_index;
+	gpu->transfer_queue_family_index = transfer_queue_family_index;
 
 	//////////////////////////////////////////////////////
 	// Create a Windows surface on which to render
@@ -546,7 +705,7 @@ gpu_t* gpu_create(heap_t* heap, wm_window_t* window)
 	VkDescriptorPoolSize descriptor_pool_sizes[1] =
 	{
 		{
-			.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+			.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
 			.descriptorCount = 512,
 		}
 	};
@@ -565,6 +724,48 @@ gpu_t* gpu_create(heap_t* heap, wm_window_t* window)
 		goto fail;
 	}
 
+	//////////////////////////////////////////////////////
+	// Create a persistently mapped VkBuffer for uniform data
+	//////////////////////////////////////////////////////
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(gpu->physical_device, &properties);
+	gpu->uniform_alignment = (size_t)properties.limits.minUniformBufferOffsetAlignment;
+
+	if (!create_buffer(gpu, (VkDeviceSize)k_gpu_uniform_frame_size * gpu->frame_count, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &gpu->uniform_buffer, &gpu->uniform_allocation))
+	{
+		gpu_destroy(gpu);
+		return NULL;
+	}
+
+	//////////////////////////////////////////////////////
+	// Create a VkPipelineCache from the last run's data
+	//////////////////////////////////////////////////////
+	fs_work_t* cache_work = NULL;
+	VkPipelineCacheCreateInfo pipeline_cache_info =
+	{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+	};
+	if (fs)
+	{
+		cache_work = fs_read(fs, k_gpu_pipeline_cache_path, heap, false, false);
+		fs_work_wait(cache_work);
+		if (fs_work_get_result(cache_work) == 0 &&
+			pipeline_cache_is_valid(fs_work_get_buffer(cache_work), fs_work_get_size(cache_work), &properties))
+		{
+			pipeline_cache_info.pInitialData = fs_work_get_buffer(cache_work);
+			pipeline_cache_info.initialDataSize = fs_work_get_size(cache_work);
+		}
+	}
+	result = vkCreatePipelineCache(gpu->logical_device, &pipeline_cache_info, NULL, &gpu->pipeline_cache);
+	fs_work_destroy(cache_work);
+	if (result)
+	{
+		function = "vkCreatePipelineCache";
+		goto fail;
+	}
+	debug_print(k_print_info, "Pipeline cache: %zu bytes loaded.\n", pipeline_cache_info.initialDataSize);
+
 	//////////////////////////////////////////////////////
 	// Create a VkCommandPool for use during the frame
 	//////////////////////////////////////////////////////
@@ -602,6 +803,42 @@ gpu_t* gpu_create(heap_t* heap, wm_window_t* window)
 			function = "vkAllocateCommandBuffers";
 			goto fail;
 		}
+		result = vkAllocateCommandBuffers(gpu->logical_device, &alloc_info, &gpu->frames[i].acquire_cmd_buffer);
+		if (result)
+		{
+			function = "vkAllocateCommandBuffers";
+			goto fail;
+		}
+
+		for (int j = 0; j < k_gpu_max_secondary_cmd_buffers; j++)
+		{
+			VkCommandPoolCreateInfo secondary_cmd_pool_info =
+			{
+				.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+				.queueFamilyIndex = queue_family_index,
+				.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+			};
+			result = vkCreateCommandPool(gpu->logical_device, &secondary_cmd_pool_info, NULL, &gpu->frames[i].secondary_cmd_pools[j]);
+			if (result)
+			{
+				function = "vkCreateCommandPool";
+				goto fail;
+			}
+
+			VkCommandBufferAllocateInfo secondary_alloc_info =
+			{
+				.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+				.commandPool = gpu->frames[i].secondary_cmd_pools[j],
+				.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+				.commandBufferCount = 1,
+			};
+			result = vkAllocateCommandBuffers(gpu->logical_device, &secondary_alloc_info, &gpu->frames[i].secondary_cmd_buffers[j].buffer);
+			if (result)
+			{
+				function = "vkAllocateCommandBuffers";
+				goto fail;
+			}
+		}
 
 		VkFenceCreateInfo fence_info =
 		{
@@ -616,6 +853,76 @@ gpu_t* gpu_create(heap_t* heap, wm_window_t* window)
 		}
 	}
 
+	//////////////////////////////////////////////////////
+	// Create staging memory and command buffers for uploads
+	//////////////////////////////////////////////////////
+	if (!create_buffer(gpu, (VkDeviceSize)k_gpu_upload_batch_size * k_gpu_upload_batch_count, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &gpu->staging_buffer, &gpu->staging_allocation))
+	{
+		gpu_destroy(gpu);
+		return NULL;
+	}
+
+	VkCommandPoolCreateInfo transfer_cmd_pool_info =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.queueFamilyIndex = transfer_queue_family_index,
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+	};
+	result = vkCreateCommandPool(gpu->logical_device, &transfer_cmd_pool_info, NULL, &gpu->transfer_cmd_pool);
+	if (result)
+	{
+		function = "vkCreateCommandPool";
+		goto fail;
+	}
+
+	for (int i = 0; i < k_gpu_upload_batch_count; i++)
+	{
+		VkCommandBufferAllocateInfo alloc_info =
+		{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.commandPool = gpu->transfer_cmd_pool,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1,
+		};
+		result = vkAllocateCommandBuffers(gpu->logical_device, &alloc_info, &gpu->upload_batches[i].cmd_buffer);
+		if (result)
+		{
+			function = "vkAllocateCommandBuffers";
+			goto fail;
+		}
+
+		VkFenceCreateInfo fence_info =
+		{
+			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+			.flags = VK_FENCE_CREATE_SIGNALED_BIT,
+		};
+		result = vkCreateFence(gpu->logical_device, &fence_info, NULL, &gpu->upload_batches[i].fence);
+		if (result)
+		{
+			function = "vkCreateFence";
+			goto fail;
+		}
+	}
+
+	VkSemaphoreTypeCreateInfo upload_sema_type_info =
+	{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		.initialValue = 0,
+	};
+	VkSemaphoreCreateInfo upload_sema_info =
+	{
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = &upload_sema_type_info,
+	};
+	result = vkCreateSemaphore(gpu->logical_device, &upload_sema_info, NULL, &gpu->upload_sema);
+	if (result)
+	{
+		function = "vkCreateSemaphore";
+		goto fail;
+	}
+
 	create_mesh_layouts(gpu);
 
 	return gpu;
@@ -632,11 +939,38 @@ void gpu_destroy(gpu_t* gpu)
 	{
 		vkQueueWaitIdle(gpu->queue);
 	}
+	if (gpu && gpu->transfer_queue)
+	{
+		vkQueueWaitIdle(gpu->transfer_queue);
+	}
 
 	if (gpu)
 	{
 		destroy_mesh_layouts(gpu);
 	}
+	if (gpu && gpu->upload_sema)
+	{
+		vkDestroySemaphore(gpu->logical_device, gpu->upload_sema, NULL);
+	}
+	for (int i = 0; gpu && i < k_gpu_upload_batch_count; i++)
+	{
+		if (gpu->upload_batches[i].fence)
+		{
+			vkDestroyFence(gpu->logical_device, gpu->upload_batches[i].fence, NULL);
+		}
+	}
+	if (gpu && gpu->transfer_cmd_pool)
+	{
+		vkDestroyCommandPool(gpu->logical_device, gpu->transfer_cmd_pool, NULL);
+	}
+	if (gpu)
+	{
+		destroy_buffer(gpu, gpu->staging_buffer, &gpu->staging_allocation);
+	}
+	if (gpu && gpu->acquire_barriers)
+	{
+		heap_free(gpu->heap, gpu->acquire_barriers);
+	}
 	if (gpu && gpu->render_complete_sema)
 	{
 		vkDestroySemaphore(gpu->logical_device, gpu->render_complete_sema, NULL);
@@ -670,6 +1004,18 @@ void gpu_destroy(gpu_t* gpu)
 				vkFreeCommandBuffers(gpu->logical_device, gpu->cmd_pool, 1, &gpu->frames[i].cmd_buffer->buffer);
 				heap_free(gpu->heap, gpu->frames[i].cmd_buffer);
 			}
+			if (gpu->frames[i].acquire_cmd_buffer)
+			{
+				vkFreeCommandBuffers(gpu->logical_device, gpu->cmd_pool, 1, &gpu->frames[i].acquire_cmd_buffer);
+			}
+			for (int j = 0; j < k_gpu_max_secondary_cmd_buffers; j++)
+			{
+				// Destroying a pool frees its command buffers.
+				if (gpu->frames[i].secondary_cmd_pools[j])
+				{
+					vkDestroyCommandPool(gpu->logical_device, gpu->frames[i].secondary_cmd_pools[j], NULL);
+				}
+			}
 			if (gpu->frames[i].frame_buffer)
 			{
 				vkDestroyFramebuffer(gpu->logical_device, gpu->frames[i].frame_buffer, NULL);
@@ -681,6 +1027,15 @@ void gpu_destroy(gpu_t* gpu)
 		}
 		heap_free(gpu->heap, gpu->frames);
 	}
+	if (gpu)
+	{
+		destroy_buffer(gpu, gpu->uniform_buffer, &gpu->uniform_allocation);
+	}
+	if (gpu && gpu->pipeline_cache)
+	{
+		pipeline_cache_save(gpu);
+		vkDestroyPipelineCache(gpu->logical_device, gpu->pipeline_cache, NULL);
+	}
 	if (gpu && gpu->descriptor_pool)
 	{
 		vkDestroyDescriptorPool(gpu->logical_device, gpu->descriptor_pool, NULL);
@@ -701,6 +1056,18 @@ void gpu_destroy(gpu_t* gpu)
 	{
 		vkDestroySurfaceKHR(gpu->instance, gpu->surface, NULL);
 	}
+	for (uint32_t i = 0; gpu && i < _countof(gpu->memory_types); ++i)
+	{
+		if (gpu->memory_types[i].stats.allocation_count)
+		{
+			debug_print(k_print_warning, "GPU memory type %u leaked %d allocations of %zu bytes\n",
+				i, gpu->memory_types[i].stats.allocation_count, gpu->memory_types[i].stats.allocated_bytes);
+		}
+		while (gpu->memory_types[i].blocks)
+		{
+			memory_block_destroy(gpu, gpu->memory_types[i].blocks);
+		}
+	}
 	if (gpu && gpu->logical_device)
 	{
 		vkDestroyDevice(gpu->logical_device, NULL);
@@ -725,6 +1092,16 @@ void gpu_wait_until_idle(gpu_t* gpu)
 	vkQueueWaitIdle(gpu->queue);
 }
 
+int gpu_get_memory_type_count(gpu_t* gpu)
+{
+	return (int)gpu->memory_properties.memoryTypeCount;
+}
+
+void gpu_get_memory_stats(gpu_t* gpu, int type_index, gpu_memory_stats_t* stats)
+{
+	*stats = gpu->memory_types[type_index].stats;
+}
+
 gpu_descriptor_t* gpu_descriptor_create(gpu_t* gpu, const gpu_descriptor_info_t* info)
 {
 	gpu_descriptor_t* descriptor = heap_alloc(gpu->heap, sizeof(gpu_descriptor_t), 8);
@@ -745,17 +1122,26 @@ gpu_descriptor_t* gpu_descriptor_create(gpu_t* gpu, const gpu_descriptor_info_t*
 		return NULL;
 	}
 
+	// Every binding reads the uniform buffer; the offset of its data is given at bind time.
+	descriptor->uniform_buffer_count = info->uniform_buffer_count;
+	VkDescriptorBufferInfo* buffer_infos = alloca(sizeof(VkDescriptorBufferInfo) * info->uniform_buffer_count);
 	VkWriteDescriptorSet* write_sets = alloca(sizeof(VkWriteDescriptorSet) * info->uniform_buffer_count);
 	for (int i = 0; i < info->uniform_buffer_count; ++i)
 	{
+		buffer_infos[i] = (VkDescriptorBufferInfo)
+		{
+			.buffer = gpu->uniform_buffer,
+			.offset = 0,
+			.range = info->uniform_sizes[i],
+		};
 		write_sets[i] = (VkWriteDescriptorSet)
 		{
 			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
 			.dstSet = descriptor->set,
-			.descriptorCount = 1,
-			.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-			.pBufferInfo = &info->uniform_buffers[i]->descriptor,
 			.dstBinding = i,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+			.pBufferInfo = &buffer_infos[i],
 		};
 	}
 	vkUpdateDescriptorSets(gpu->logical_device, info->uniform_buffer_count, write_sets, 0, NULL);
@@ -784,135 +1170,27 @@ gpu_mesh_t* gpu_mesh_create(gpu_t* gpu, const gpu_mesh_info_t* info)
 	mesh->index_count = (int)info->index_data_size / gpu->mesh_index_size[info->layout];
 	mesh->vertex_count = (int)info->vertex_data_size / gpu->mesh_vertex_size[info->layout];
 
-	// Vertex data
-	{
-		VkBufferCreateInfo vertex_buffer_info =
-		{
-			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-			.size = info->vertex_data_size,
-			.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-		};
-		VkResult result = vkCreateBuffer(gpu->logical_device, &vertex_buffer_info, NULL, &mesh->vertex_buffer);
-		if (result)
-		{
-			debug_print(k_print_error, "vkCreateBuffer failed: %d\n", result);
-			gpu_mesh_destroy(gpu, mesh);
-			return NULL;
-		}
-
-		VkMemoryRequirements mem_reqs;
-		vkGetBufferMemoryRequirements(gpu->logical_device, mesh->vertex_buffer, &mem_reqs);
-
-		VkMemoryAllocateInfo mem_alloc =
-		{
-			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-			.allocationSize = mem_reqs.size,
-			.memoryTypeIndex = get_memory_type_index(gpu, mem_reqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT),
-		};
-		result = vkAllocateMemory(gpu->logical_device, &mem_alloc, NULL, &mesh->vertex_memory);
-		if (result)
-		{
-			debug_print(k_print_error, "vkAllocateMemory failed: %d\n", result);
-			gpu_mesh_destroy(gpu, mesh);
-			return NULL;
-		}
-
-		void* vertex_dest = NULL;
-		result = vkMapMemory(gpu->logical_device, mesh->vertex_memory, 0, mem_alloc.allocationSize, 0, &vertex_dest);
-		if (result)
-		{
-			debug_print(k_print_error, "vkMapMemory failed: %d\n", result);
-			gpu_mesh_destroy(gpu, mesh);
-			return NULL;
-		}
-		memcpy(vertex_dest, info->vertex_data, info->vertex_data_size);
-		vkUnmapMemory(gpu->logical_device, mesh->vertex_memory);
-
-		result = vkBindBufferMemory(gpu->logical_device, mesh->vertex_buffer, mesh->vertex_memory, 0);
-		if (result)
-		{
-			debug_print(k_print_error, "vkBindBufferMemory failed: %d\n", result);
-			gpu_mesh_destroy(gpu, mesh);
-			return NULL;
-		}
-	}
-
-	// Index data
+	// Geometry lives in device local memory, filled through staging memory.
+	if (!create_buffer(gpu, info->vertex_data_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mesh->vertex_buffer, &mesh->vertex_allocation) ||
+		!create_buffer(gpu, info->index_data_size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &mesh->index_buffer, &mesh->index_allocation))
 	{
-		VkBufferCreateInfo index_buffer_info =
-		{
-			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-			.size = info->index_data_size,
-			.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-		};
-		VkResult result = vkCreateBuffer(gpu->logical_device, &index_buffer_info, NULL, &mesh->index_buffer);
-		if (result)
-		{
-			debug_print(k_print_error, "vkCreateBuffer failed: %d\n", result);
-			gpu_mesh_destroy(gpu, mesh);
-			return NULL;
-		}
-
-		VkMemoryRequirements mem_reqs;
-		vkGetBufferMemoryRequirements(gpu->logical_device, mesh->index_buffer, &mem_reqs);
-
-		VkMemoryAllocateInfo mem_alloc =
-		{
-			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-			.allocationSize = mem_reqs.size,
-			.memoryTypeIndex = get_memory_type_index(gpu, mem_reqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT),
-		};
-		result = vkAllocateMemory(gpu->logical_device, &mem_alloc, NULL, &mesh->index_memory);
-		if (result)
-		{
-			debug_print(k_print_error, "vkAllocateMemory failed: %d\n", result);
-			gpu_mesh_destroy(gpu, mesh);
-			return NULL;
-		}
-
-		void* index_dest = NULL;
-		result = vkMapMemory(gpu->logical_device, mesh->index_memory, 0, mem_alloc.allocationSize, 0, &index_dest);
-		if (result)
-		{
-			debug_print(k_print_error, "vkMapMemory failed: %d\n", result);
-			gpu_mesh_destroy(gpu, mesh);
-			return NULL;
-		}
-		memcpy(index_dest, info->index_data, info->index_data_size);
-		vkUnmapMemory(gpu->logical_device, mesh->index_memory);
-
-		result = vkBindBufferMemory(gpu->logical_device, mesh->index_buffer, mesh->index_memory, 0);
-		if (result)
-		{
-			debug_print(k_print_error, "vkBindBufferMemory failed: %d\n", result);
-			gpu_mesh_destroy(gpu, mesh);
-			return NULL;
-		}
+		gpu_mesh_destroy(gpu, mesh);
+		return NULL;
 	}
+	upload_buffer(gpu, mesh->vertex_buffer, info->vertex_data, info->vertex_data_size, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+	upload_buffer(gpu, mesh->index_buffer, info->index_data, info->index_data_size, VK_ACCESS_INDEX_READ_BIT);
 
 	return mesh;
 }
 
 void gpu_mesh_destroy(gpu_t* gpu, gpu_mesh_t* mesh)
 {
-	if (mesh && mesh->index_buffer)
-	{
-		vkDestroyBuffer(gpu->logical_device, mesh->index_buffer, NULL);
-	}
-	if (mesh && mesh->index_memory)
-	{
-		vkFreeMemory(gpu->logical_device, mesh->index_memory, NULL);
-	}
-	if (mesh && mesh->vertex_buffer)
-	{
-		vkDestroyBuffer(gpu->logical_device, mesh->vertex_buffer, NULL);
-	}
-	if (mesh && mesh->vertex_memory)
-	{
-		vkFreeMemory(gpu->logical_device, mesh->vertex_memory, NULL);
-	}
 	if (mesh)
 	{
+		destroy_buffer(gpu, mesh->index_buffer, &mesh->index_allocation);
+		destroy_buffer(gpu, mesh->vertex_buffer, &mesh->vertex_allocation);
 		heap_free(gpu->heap, mesh);
 	}
 }
@@ -1000,6 +1278,28 @@ gpu_pipeline_t* gpu_pipeline_create(gpu_t* gpu, const gpu_pipeline_info_t* info)
 		.pDynamicStates = dynamic_states,
 	};
 
+	// Instanced pipelines read a second vertex buffer, advanced once per instance.
+	VkPipelineVertexInputStateCreateInfo vertex_input_info = gpu->mesh_vertex_input_info[info->mesh_layout];
+	VkVertexInputBindingDescription vertex_bindings[2];
+	VkVertexInputAttributeDescription vertex_attributes[8];
+	if (info->instance_layout != k_gpu_instance_layout_none)
+	{
+		memcpy(vertex_bindings, vertex_input_info.pVertexBindingDescriptions, sizeof(VkVertexInputBindingDescription) * vertex_input_info.vertexBindingDescriptionCount);
+		vertex_bindings[vertex_input_info.vertexBindingDescriptionCount] = (VkVertexInputBindingDescription)
+		{
+			.binding = 1,
+			.stride = (uint32_t)gpu_instance_layout_get_size(info->instance_layout),
+			.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+		};
+		memcpy(vertex_attributes, vertex_input_info.pVertexAttributeDescriptions, sizeof(VkVertexInputAttributeDescription) * vertex_input_info.vertexAttributeDescriptionCount);
+		uint32_t instance_attribute_count = get_instance_attributes(info->instance_layout, &vertex_attributes[vertex_input_info.vertexAttributeDescriptionCount]);
+
+		vertex_input_info.pVertexBindingDescriptions = vertex_bindings;
+		vertex_input_info.vertexBindingDescriptionCount++;
+		vertex_input_info.pVertexAttributeDescriptions = vertex_attributes;
+		vertex_input_info.vertexAttributeDescriptionCount += instance_attribute_count;
+	}
+
 	VkPipelineLayoutCreateInfo pipeline_layout_info =
 	{
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
@@ -1021,7 +1321,7 @@ gpu_pipeline_t* gpu_pipeline_create(gpu_t* gpu, const gpu_pipeline_info_t* info)
 		.renderPass = gpu->render_pass,
 		.stageCount = _countof(shader_info),
 		.pStages = shader_info,
-		.pVertexInputState = &gpu->mesh_vertex_input_info[info->mesh_layout],
+		.pVertexInputState = &vertex_input_info,
 		.pInputAssemblyState = &gpu->mesh_input_assembly_info[info->mesh_layout],
 		.pRasterizationState = &rasterization_state_info,
 		.pColorBlendState = &color_blend_info,
@@ -1030,7 +1330,9 @@ gpu_pipeline_t* gpu_pipeline_create(gpu_t* gpu, const gpu_pipeline_info_t* info)
 		.pDepthStencilState = &depth_stencil_info,
 		.pDynamicState = &dynamic_info,
 	};
-	result = vkCreateGraphicsPipelines(gpu->logical_device, NULL, 1, &pipeline_info, NULL, &pipeline->pipe);
+	uint64_t compile_ticks = timer_get_ticks();
+	result = vkCreateGraphicsPipelines(gpu->logical_device, gpu->pipeline_cache, 1, &pipeline_info, NULL, &pipeline->pipe);
+	compile_ticks = timer_get_ticks() - compile_ticks;
 	if (result)
 	{
 		debug_print(k_print_error, "vkCreateGraphicsPipelines failed: %d\n", result);
@@ -1038,6 +1340,11 @@ gpu_pipeline_t* gpu_pipeline_create(gpu_t* gpu, const gpu_pipeline_info_t* info)
 		return NULL;
 	}
 
+	gpu->pipeline_compile_ticks += compile_ticks;
+	gpu->pipeline_compile_count++;
+	debug_print(k_print_info, "Pipeline compiled in %.3f ms; %d pipelines in %.3f ms total.\n",
+		(double)timer_ticks_to_us(compile_ticks) / 1000.0, gpu->pipeline_compile_count, (double)timer_ticks_to_us(gpu->pipeline_compile_ticks) / 1000.0);
+
 	return pipeline;
 }
 
@@ -1096,7 +1403,7 @@ gpu_shader_t* gpu_shader_create(gpu_t* gpu, const gpu_shader_info_t* info)
 		descriptor_set_layout_bindings[i] = (VkDescriptorSetLayoutBinding)
 		{
 			.binding = i,
-			.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+			.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
 			.descriptorCount = 1,
 			.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
 		};
@@ -1139,94 +1446,97 @@ void gpu_shader_destroy(gpu_t* gpu, gpu_shader_t* shader)
 	}
 }
 
-gpu_uniform_buffer_t* gpu_uniform_buffer_create(gpu_t* gpu, const gpu_uniform_buffer_info_t* info)
+bool gpu_uniform_write(gpu_t* gpu, const void* data, size_t size, uint32_t* offset)
 {
-	gpu_uniform_buffer_t* uniform_buffer = heap_alloc(gpu->heap, sizeof(gpu_uniform_buffer_t), 8);
-	memset(uniform_buffer, 0, sizeof(*uniform_buffer));
+	size_t start = (gpu->uniform_cursor + gpu->uniform_alignment - 1) & ~(gpu->uniform_alignment - 1);
+	if (start + size > gpu->uniform_end)
+	{
+		debug_print(k_print_error, "Uniform data of %zu bytes overflows the frame's %d bytes\n", size, k_gpu_uniform_frame_size);
+		return false;
+	}
+	memcpy(gpu->uniform_allocation.data + start, data, size);
+	gpu->uniform_cursor = start + size;
+	*offset = (uint32_t)start;
+	return true;
+}
 
-	VkBufferCreateInfo buffer_info =
+size_t gpu_instance_layout_get_size(gpu_instance_layout_t layout)
+{
+	switch (layout)
 	{
-		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-		.size = info->size,
-		.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-	};
-	VkResult result = vkCreateBuffer(gpu->logical_device, &buffer_info, NULL, &uniform_buffer->buffer);
-	if (result)
+	case k_gpu_instance_layout_m4444_c444:
+		return sizeof(float) * (16 + 3);
+	default:
+		return 0;
+	}
+}
+
+gpu_instance_buffer_t* gpu_instance_buffer_create(gpu_t* gpu, size_t size)
+{
+	gpu_instance_buffer_t* instance_buffer = heap_alloc(gpu->heap, sizeof(gpu_instance_buffer_t), 8);
+	memset(instance_buffer, 0, sizeof(*instance_buffer));
+	instance_buffer->size = size;
+
+	// Instance data is rewritten every frame, so keep it in host visible memory.
+	if (!create_buffer(gpu, size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&instance_buffer->buffer, &instance_buffer->allocation))
 	{
-		debug_print(k_print_error, "vkCreateBuffer failed: %d\n", result);
-		gpu_uniform_buffer_destroy(gpu, uniform_buffer);
+		gpu_instance_buffer_destroy(gpu, instance_buffer);
 		return NULL;
 	}
 
-	VkMemoryRequirements mem_reqs;
-	vkGetBufferMemoryRequirements(gpu->logical_device, uniform_buffer->buffer, &mem_reqs);
+	return instance_buffer;
+}
 
-	VkMemoryAllocateInfo mem_alloc =
+void gpu_instance_buffer_update(gpu_t* gpu, gpu_instance_buffer_t* buffer, const void* data, size_t size)
+{
+	if (size > buffer->size)
 	{
-		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-		.allocationSize = mem_reqs.size,
-		.memoryTypeIndex = get_memory_type_index(gpu, mem_reqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT),
-	};
-	result = vkAllocateMemory(gpu->logical_device, &mem_alloc, NULL, &uniform_buffer->memory);
-	if (result)
-	{
-		debug_print(k_print_error, "vkAllocateMemory failed: %d\n", result);
-		gpu_uniform_buffer_destroy(gpu, uniform_buffer);
-		return NULL;
-	}
-
-	result = vkBindBufferMemory(gpu->logical_device, uniform_buffer->buffer, uniform_buffer->memory, 0);
-	if (result)
-	{
-		debug_print(k_print_error, "vkBindBufferMemory failed: %d\n", result);
-		gpu_uniform_buffer_destroy(gpu, uniform_buffer);
-		return NULL;
+		debug_print(k_print_error, "Instance data of %zu bytes overflows buffer of %zu bytes\n", size, buffer->size);
+		size = buffer->size;
 	}
-
-	uniform_buffer->descriptor.buffer = uniform_buffer->buffer;
-	uniform_buffer->descriptor.range = info->size;
-
-	gpu_uniform_buffer_update(gpu, uniform_buffer, info->data, info->size);
-
-	return uniform_buffer;
+	memcpy(buffer->allocation.data, data, size);
 }
 
-void gpu_uniform_buffer_update(gpu_t* gpu, gpu_uniform_buffer_t* buffer, const void* data, size_t size)
+void gpu_instance_buffer_destroy(gpu_t* gpu, gpu_instance_buffer_t* buffer)
 {
-	void* dest = NULL;
-	VkResult result = vkMapMemory(gpu->logical_device, buffer->memory, 0, size, 0, &dest);
-	if (!result)
+	if (buffer)
 	{
-		memcpy(dest, data, size);
-		vkUnmapMemory(gpu->logical_device, buffer->memory);
+		destroy_buffer(gpu, buffer->buffer, &buffer->allocation);
+		heap_free(gpu->heap, buffer);
 	}
 }
 
-void gpu_uniform_buffer_destroy(gpu_t* gpu, gpu_uniform_buffer_t* buffer)
+gpu_cmd_buffer_t* gpu_frame_begin(gpu_t* gpu, bool secondary)
 {
-	if (buffer && buffer->buffer)
+	gpu_frame_t* frame = &gpu->frames[gpu->frame_index];
+
+	// Wait for the GPU to finish the last frame that used this slot
+	// before its command buffer and uniform memory are written again.
+	VkResult result = vkWaitForFences(gpu->logical_device, 1, &frame->fence, VK_TRUE, UINT64_MAX);
+	if (result)
 	{
-		vkDestroyBuffer(gpu->logical_device, buffer->buffer, NULL);
+		debug_print(k_print_error, "vkWaitForFences failed: %d\n", result);
 	}
-	if (buffer && buffer->memory)
+	result = vkResetFences(gpu->logical_device, 1, &frame->fence);
+	if (result)
 	{
-		vkFreeMemory(gpu->logical_device, buffer->memory, NULL);
+		debug_print(k_print_error, "vkResetFences failed: %d\n", result);
 	}
-	if (buffer)
+
+	gpu->uniform_cursor = (size_t)k_gpu_uniform_frame_size * gpu->frame_index;
+	gpu->uniform_end = gpu->uniform_cursor + k_gpu_uniform_frame_size;
+
+	for (int i = 0; i < k_gpu_max_secondary_cmd_buffers; i++)
 	{
-		heap_free(gpu->heap, buffer);
+		vkResetCommandPool(gpu->logical_device, frame->secondary_cmd_pools[i], 0);
 	}
-}
-
-gpu_cmd_buffer_t* gpu_frame_begin(gpu_t* gpu)
-{
-	gpu_frame_t* frame = &gpu->frames[gpu->frame_index];
 
 	VkCommandBufferBeginInfo begin_info =
 	{
 		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
 	};
-	VkResult result = vkBeginCommandBuffer(frame->cmd_buffer->buffer, &begin_info);
+	result = vkBeginCommandBuffer(frame->cmd_buffer->buffer, &begin_info);
 	if (result)
 	{
 		debug_print(k_print_error, "vkBeginCommandBuffer failed: %d\n", result);
@@ -1248,25 +1558,68 @@ gpu_cmd_buffer_t* gpu_frame_begin(gpu_t* gpu)
 		.pClearValues = clear_values,
 		.framebuffer = frame->frame_buffer,
 	};
-	vkCmdBeginRenderPass(frame->cmd_buffer->buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBeginRenderPass(frame->cmd_buffer->buffer, &render_pass_begin_info,
+		secondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
 
-	VkViewport viewport =
+	if (!secondary)
 	{
-		.height = (float)gpu->frame_height,
-		.width = (float)gpu->frame_width,
-		.minDepth = 0.0f,
-		.maxDepth = 1.0f,
-	};
-	vkCmdSetViewport(frame->cmd_buffer->buffer, 0, 1, &viewport);
+		set_viewport(gpu, frame->cmd_buffer->buffer);
+	}
 
-	VkRect2D scissor =
+	return frame->cmd_buffer;
+}
+
+gpu_cmd_buffer_t* gpu_secondary_cmd_buffer_begin(gpu_t* gpu, int index)
+{
+	gpu_frame_t* frame = &gpu->frames[gpu->frame_index];
+	gpu_cmd_buffer_t* cmd_buffer = &frame->secondary_cmd_buffers[index];
+	cmd_buffer->pipeline_layout = VK_NULL_HANDLE;
+	cmd_buffer->index_count = 0;
+	cmd_buffer->vertex_count = 0;
+
+	VkCommandBufferInheritanceInfo inheritance_info =
 	{
-		.extent.width = gpu->frame_width,
-		.extent.height = gpu->frame_height,
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+		.renderPass = gpu->render_pass,
+		.subpass = 0,
+		.framebuffer = frame->frame_buffer,
+	};
+	VkCommandBufferBeginInfo begin_info =
+	{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		.pInheritanceInfo = &inheritance_info,
 	};
-	vkCmdSetScissor(frame->cmd_buffer->buffer, 0, 1, &scissor);
+	VkResult result = vkBeginCommandBuffer(cmd_buffer->buffer, &begin_info);
+	if (result)
+	{
+		debug_print(k_print_error, "vkBeginCommandBuffer failed: %d\n", result);
+		return NULL;
+	}
 
-	return frame->cmd_buffer;
+	// Dynamic state is not inherited from the primary command buffer.
+	set_viewport(gpu, cmd_buffer->buffer);
+
+	return cmd_buffer;
+}
+
+void gpu_secondary_cmd_buffer_end(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer)
+{
+	VkResult result = vkEndCommandBuffer(cmd_buffer->buffer);
+	if (result)
+	{
+		debug_print(k_print_error, "vkEndCommandBuffer failed: %d\n", result);
+	}
+}
+
+void gpu_cmd_execute_secondary(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, gpu_cmd_buffer_t** secondary_cmd_buffers, int count)
+{
+	VkCommandBuffer* buffers = alloca(sizeof(VkCommandBuffer) * count);
+	for (int i = 0; i < count; ++i)
+	{
+		buffers[i] = secondary_cmd_buffers[i]->buffer;
+	}
+	vkCmdExecuteCommands(cmd_buffer->buffer, count, buffers);
 }
 
 void gpu_frame_end(gpu_t* gpu)
@@ -1288,27 +1641,55 @@ void gpu_frame_end(gpu_t* gpu)
 		debug_print(k_print_error, "vkAcquireNextImageKHR failed: %d\n", result);
 	}
 
-	result = vkWaitForFences(gpu->logical_device, 1, &frame->fence, VK_TRUE, UINT64_MAX);
-	if (result)
-	{
-		debug_print(k_print_error, "vkWaitForFences failed: %d\n", result);
-	}
-	result = vkResetFences(gpu->logical_device, 1, &frame->fence);
-	if (result)
+	upload_batch_submit(gpu);
+
+	// Take ownership of buffers uploaded on the transfer queue before the frame's draws read them.
+	VkCommandBuffer cmd_buffers[2];
+	uint32_t cmd_buffer_count = 0;
+	if (gpu->acquire_count)
 	{
-		debug_print(k_print_error, "vkResetFences failed: %d\n", result);
+		VkCommandBufferBeginInfo acquire_begin_info =
+		{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		};
+		result = vkBeginCommandBuffer(frame->acquire_cmd_buffer, &acquire_begin_info);
+		if (result)
+		{
+			debug_print(k_print_error, "vkBeginCommandBuffer failed: %d\n", result);
+		}
+		vkCmdPipelineBarrier(frame->acquire_cmd_buffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+			0, NULL, gpu->acquire_count, gpu->acquire_barriers, 0, NULL);
+		result = vkEndCommandBuffer(frame->acquire_cmd_buffer);
+		if (result)
+		{
+			debug_print(k_print_error, "vkEndCommandBuffer failed: %d\n", result);
+		}
+		cmd_buffers[cmd_buffer_count++] = frame->acquire_cmd_buffer;
+		gpu->acquire_count = 0;
 	}
+	cmd_buffers[cmd_buffer_count++] = frame->cmd_buffer->buffer;
 
-	VkPipelineStageFlags wait_stage_mask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	// Vertex input waits for every upload submitted so far.
+	VkSemaphore wait_semas[2] = { gpu->present_complete_sema, gpu->upload_sema };
+	VkPipelineStageFlags wait_stage_masks[2] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT };
+	uint64_t wait_values[2] = { 0, gpu->upload_serial };
+	VkTimelineSemaphoreSubmitInfo timeline_info =
+	{
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.waitSemaphoreValueCount = _countof(wait_values),
+		.pWaitSemaphoreValues = wait_values,
+	};
 	VkSubmitInfo submit_info =
 	{
 		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.pWaitDstStageMask = &wait_stage_mask,
-		.waitSemaphoreCount = 1,
+		.pNext = &timeline_info,
+		.pWaitDstStageMask = wait_stage_masks,
+		.waitSemaphoreCount = _countof(wait_semas),
 		.signalSemaphoreCount = 1,
-		.pCommandBuffers = &frame->cmd_buffer->buffer,
-		.commandBufferCount = 1,
-		.pWaitSemaphores = &gpu->present_complete_sema,
+		.pCommandBuffers = cmd_buffers,
+		.commandBufferCount = cmd_buffer_count,
+		.pWaitSemaphores = wait_semas,
 		.pSignalSemaphores = &gpu->render_complete_sema,
 	};
 	result = vkQueueSubmit(gpu->queue, 1, &submit_info, frame->fence);
@@ -1339,9 +1720,9 @@ void gpu_cmd_pipeline_bind(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, gpu_pipelin
 	cmd_buffer->pipeline_layout = pipeline->pipeline_layout;
 }
 
-void gpu_cmd_descriptor_bind(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, gpu_descriptor_t* descriptor)
+void gpu_cmd_descriptor_bind(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, gpu_descriptor_t* descriptor, const uint32_t* uniform_offsets)
 {
-	vkCmdBindDescriptorSets(cmd_buffer->buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, cmd_buffer->pipeline_layout, 0, 1, &descriptor->set, 0, NULL);
+	vkCmdBindDescriptorSets(cmd_buffer->buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, cmd_buffer->pipeline_layout, 0, 1, &descriptor->set, descriptor->uniform_buffer_count, uniform_offsets);
 }
 
 void gpu_cmd_mesh_bind(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, gpu_mesh_t* mesh)
@@ -1379,6 +1760,80 @@ void gpu_cmd_draw(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer)
 	}
 }
 
+void gpu_cmd_instance_buffer_bind(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, gpu_instance_buffer_t* buffer, size_t offset)
+{
+	VkDeviceSize vk_offset = offset;
+	vkCmdBindVertexBuffers(cmd_buffer->buffer, 1, 1, &buffer->buffer, &vk_offset);
+}
+
+void gpu_cmd_draw_instanced(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, int first_instance, int instance_count)
+{
+	if (cmd_buffer->index_count)
+	{
+		vkCmdDrawIndexed(cmd_buffer->buffer, cmd_buffer->index_count, instance_count, 0, 0, first_instance);
+	}
+	else if (cmd_buffer->vertex_count)
+	{
+		vkCmdDraw(cmd_buffer->buffer, cmd_buffer->vertex_count, instance_count, 0, first_instance);
+	}
+}
+
+static void set_viewport(gpu_t* gpu, VkCommandBuffer cmd_buffer)
+{
+	VkViewport viewport =
+	{
+		.height = (float)gpu->frame_height,
+		.width = (float)gpu->frame_width,
+		.minDepth = 0.0f,
+		.maxDepth = 1.0f,
+	};
+	vkCmdSetViewport(cmd_buffer, 0, 1, &viewport);
+
+	VkRect2D scissor =
+	{
+		.extent.width = gpu->frame_width,
+		.extent.height = gpu->frame_height,
+	};
+	vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);
+}
+
+static bool pipeline_cache_is_valid(const void* data, size_t size, const VkPhysicalDeviceProperties* properties)
+{
+	// Data from another device or driver version is useless at best, so check the header before handing it to the driver.
+	VkPipelineCacheHeaderVersionOne header;
+	if (size < sizeof(header))
+	{
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+	return header.headerSize >= sizeof(header) &&
+		header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		header.vendorID == properties->vendorID &&
+		header.deviceID == properties->deviceID &&
+		memcmp(header.pipelineCacheUUID, properties->pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+static void pipeline_cache_save(gpu_t* gpu)
+{
+	size_t size = 0;
+	if (!gpu->fs || vkGetPipelineCacheData(gpu->logical_device, gpu->pipeline_cache, &size, NULL) || !size)
+	{
+		return;
+	}
+	void* data = heap_alloc(gpu->heap, size, 8);
+	if (vkGetPipelineCacheData(gpu->logical_device, gpu->pipeline_cache, &size, data) == VK_SUCCESS)
+	{
+		fs_work_t* work = fs_write(gpu->fs, k_gpu_pipeline_cache_path, data, size, false);
+		fs_work_wait(work);
+		if (fs_work_get_result(work))
+		{
+			debug_print(k_print_warning, "Pipeline cache could not be saved: %d\n", fs_work_get_result(work));
+		}
+		fs_work_destroy(work);
+	}
+	heap_free(gpu->heap, data);
+}
+
 static void create_mesh_layouts(gpu_t* gpu)
 {
 	// k_gpu_mesh_layout_tri_p444_i2
@@ -1479,6 +1934,35 @@ static void destroy_mesh_layouts(gpu_t* gpu)
 	}
 }
 
+// Fill in the vertex attributes of an instance layout, read from binding 1. Returns the attribute count.
+static uint32_t get_instance_attributes(gpu_instance_layout_t layout, VkVertexInputAttributeDescription* attributes)
+{
+	switch (layout)
+	{
+	case k_gpu_instance_layout_m4444_c444:
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			attributes[i] = (VkVertexInputAttributeDescription)
+			{
+				.binding = 1,
+				.location = 2 + i,
+				.format = VK_FORMAT_R32G32B32A32_SFLOAT,
+				.offset = sizeof(float) * 4 * i,
+			};
+		}
+		attributes[4] = (VkVertexInputAttributeDescription)
+		{
+			.binding = 1,
+			.location = 6,
+			.format = VK_FORMAT_R32G32B32_SFLOAT,
+			.offset = sizeof(float) * 16,
+		};
+		return 5;
+	default:
+		return 0;
+	}
+}
+
 static uint32_t get_memory_type_index(gpu_t* gpu, uint32_t bits, VkMemoryPropertyFlags properties)
 {
 	for (uint32_t i = 0; i < gpu->memory_properties.memoryTypeCount; ++i)
@@ -1494,3 +1978,408 @@ static uint32_t get_memory_type_index(gpu_t* gpu, uint32_t bits, VkMemoryPropert
 	debug_print(k_print_error, "Unable to find memory of type: %x\n", bits);
 	return 0;
 }
+
+static bool create_buffer(gpu_t* gpu, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer* buffer, gpu_allocation_t* allocation)
+{
+	VkBufferCreateInfo buffer_info =
+	{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = size,
+		.usage = usage,
+	};
+	VkResult result = vkCreateBuffer(gpu->logical_device, &buffer_info, NULL, buffer);
+	if (result)
+	{
+		debug_print(k_print_error, "vkCreateBuffer failed: %d\n", result);
+		return false;
+	}
+
+	VkMemoryRequirements mem_reqs;
+	vkGetBufferMemoryRequirements(gpu->logical_device, *buffer, &mem_reqs);
+	if (!memory_alloc(gpu, &mem_reqs, properties, allocation))
+	{
+		return false;
+	}
+
+	result = vkBindBufferMemory(gpu->logical_device, *buffer, allocation->block->memory, allocation->offset);
+	if (result)
+	{
+		debug_print(k_print_error, "vkBindBufferMemory failed: %d\n", result);
+		return false;
+	}
+	return true;
+}
+
+static void destroy_buffer(gpu_t* gpu, VkBuffer buffer, gpu_allocation_t* allocation)
+{
+	if (buffer)
+	{
+		vkDestroyBuffer(gpu->logical_device, buffer, NULL);
+	}
+	if (allocation->block)
+	{
+		memory_free(gpu, allocation);
+	}
+}
+
+static void upload_buffer(gpu_t* gpu, VkBuffer buffer, const void* data, VkDeviceSize size, VkAccessFlags dst_access)
+{
+	// Copy through staging memory, a batch's region at a time.
+	gpu_upload_batch_t* batch = NULL;
+	VkDeviceSize offset = 0;
+	while (offset < size)
+	{
+		batch = upload_batch_begin(gpu);
+		if (batch->staging_used == k_gpu_upload_batch_size)
+		{
+			upload_batch_submit(gpu);
+			continue;
+		}
+
+		VkDeviceSize chunk = __min(size - offset, k_gpu_upload_batch_size - batch->staging_used);
+		VkDeviceSize staging_offset = (VkDeviceSize)k_gpu_upload_batch_size * gpu->upload_batch_index + batch->staging_used;
+		memcpy(gpu->staging_allocation.data + staging_offset, (const char*)data + offset, chunk);
+
+		VkBufferCopy region =
+		{
+			.srcOffset = staging_offset,
+			.dstOffset = offset,
+			.size = chunk,
+		};
+		vkCmdCopyBuffer(batch->cmd_buffer, gpu->staging_buffer, buffer, 1, &region);
+		batch->staging_used += chunk;
+		offset += chunk;
+	}
+	if (!batch)
+	{
+		return;
+	}
+
+	// On the graphics queue, make the copies visible to vertex input.
+	// On a transfer queue, release the buffer to the graphics queue, which acquires it in the next frame.
+	bool release = gpu->transfer_queue_family_index != gpu->queue_family_index;
+	VkBufferMemoryBarrier barrier =
+	{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = release ? 0 : dst_access,
+		.srcQueueFamilyIndex = release ? gpu->transfer_queue_family_index : VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = release ? gpu->queue_family_index : VK_QUEUE_FAMILY_IGNORED,
+		.buffer = buffer,
+		.offset = 0,
+		.size = VK_WHOLE_SIZE,
+	};
+	vkCmdPipelineBarrier(batch->cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		release ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+		0, NULL, 1, &barrier, 0, NULL);
+
+	if (release)
+	{
+		if (gpu->acquire_count == gpu->acquire_capacity)
+		{
+			int capacity = __max(gpu->acquire_capacity * 2, 16);
+			VkBufferMemoryBarrier* barriers = heap_alloc(gpu->heap, sizeof(VkBufferMemoryBarrier) * capacity, 8);
+			if (gpu->acquire_barriers)
+			{
+				memcpy(barriers, gpu->acquire_barriers, sizeof(VkBufferMemoryBarrier) * gpu->acquire_count);
+				heap_free(gpu->heap, gpu->acquire_barriers);
+			}
+			gpu->acquire_barriers = barriers;
+			gpu->acquire_capacity = capacity;
+		}
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = dst_access;
+		gpu->acquire_barriers[gpu->acquire_count++] = barrier;
+	}
+}
+
+static gpu_upload_batch_t* upload_batch_begin(gpu_t* gpu)
+{
+	gpu_upload_batch_t* batch = &gpu->upload_batches[gpu->upload_batch_index];
+	if (!batch->recording)
+	{
+		// The batch's staging region may still be read by its last submission.
+		VkResult result = vkWaitForFences(gpu->logical_device, 1, &batch->fence, VK_TRUE, UINT64_MAX);
+		if (result)
+		{
+			debug_print(k_print_error, "vkWaitForFences failed: %d\n", result);
+		}
+		result = vkResetFences(gpu->logical_device, 1, &batch->fence);
+		if (result)
+		{
+			debug_print(k_print_error, "vkResetFences failed: %d\n", result);
+		}
+
+		VkCommandBufferBeginInfo begin_info =
+		{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		};
+		result = vkBeginCommandBuffer(batch->cmd_buffer, &begin_info);
+		if (result)
+		{
+			debug_print(k_print_error, "vkBeginCommandBuffer failed: %d\n", result);
+		}
+		batch->staging_used = 0;
+		batch->recording = true;
+	}
+	return batch;
+}
+
+static void upload_batch_submit(gpu_t* gpu)
+{
+	gpu_upload_batch_t* batch = &gpu->upload_batches[gpu->upload_batch_index];
+	if (!batch->recording)
+	{
+		return;
+	}
+
+	VkResult result = vkEndCommandBuffer(batch->cmd_buffer);
+	if (result)
+	{
+		debug_print(k_print_error, "vkEndCommandBuffer failed: %d\n", result);
+	}
+
+	gpu->upload_serial++;
+	VkTimelineSemaphoreSubmitInfo timeline_info =
+	{
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.signalSemaphoreValueCount = 1,
+		.pSignalSemaphoreValues = &gpu->upload_serial,
+	};
+	VkSubmitInfo submit_info =
+	{
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = &timeline_info,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &batch->cmd_buffer,
+		.signalSemaphoreCount = 1,
+		.pSignalSemaphores = &gpu->upload_sema,
+	};
+	result = vkQueueSubmit(gpu->transfer_queue, 1, &submit_info, batch->fence);
+	if (result)
+	{
+		debug_print(k_print_error, "vkQueueSubmit failed: %d\n", result);
+	}
+
+	batch->recording = false;
+	gpu->upload_batch_index = (gpu->upload_batch_index + 1) % k_gpu_upload_batch_count;
+}
+
+static bool memory_alloc(gpu_t* gpu, const VkMemoryRequirements* reqs, VkMemoryPropertyFlags properties, gpu_allocation_t* allocation)
+{
+	uint32_t type_index = get_memory_type_index(gpu, reqs->memoryTypeBits, properties);
+	gpu_memory_type_t* type = &gpu->memory_types[type_index];
+
+	// Best fit: the free range leaving the least space unused, across all blocks of the type.
+	// Small ranges fill first, leaving large ones whole for large buffers.
+	gpu_memory_block_t* best_block = NULL;
+	int best_range = -1;
+	VkDeviceSize best_leftover = UINT64_MAX;
+	for (gpu_memory_block_t* block = type->blocks; block; block = block->next)
+	{
+		int range;
+		VkDeviceSize leftover;
+		if (memory_block_find_range(block, reqs->size, reqs->alignment, &range, &leftover) && leftover < best_leftover)
+		{
+			best_block = block;
+			best_range = range;
+			best_leftover = leftover;
+		}
+	}
+	if (!best_block)
+	{
+		best_block = memory_block_create(gpu, type_index, __max(reqs->size, k_gpu_memory_block_size));
+		if (!best_block)
+		{
+			return false;
+		}
+		best_range = 0;
+	}
+
+	allocation->block = best_block;
+	allocation->offset = memory_block_take_range(gpu, best_block, best_range, reqs->size, reqs->alignment);
+	allocation->size = reqs->size;
+	allocation->data = best_block->data ? best_block->data + allocation->offset : NULL;
+
+	best_block->allocation_count++;
+	type->stats.allocation_count++;
+	type->stats.allocated_bytes += reqs->size;
+	return true;
+}
+
+static void memory_free(gpu_t* gpu, gpu_allocation_t* allocation)
+{
+	gpu_memory_block_t* block = allocation->block;
+	gpu_memory_type_t* type = &gpu->memory_types[block->type_index];
+
+	memory_block_return_range(gpu, block, allocation->offset, allocation->size);
+	block->allocation_count--;
+	type->stats.allocation_count--;
+	type->stats.allocated_bytes -= allocation->size;
+
+	// Give empty blocks back to the driver, but keep the last one of a type to avoid churn.
+	if (!block->allocation_count && (type->blocks != block || block->next))
+	{
+		memory_block_destroy(gpu, block);
+	}
+
+	memset(allocation, 0, sizeof(*allocation));
+}
+
+static gpu_memory_block_t* memory_block_create(gpu_t* gpu, uint32_t type_index, VkDeviceSize size)
+{
+	gpu_memory_block_t* block = heap_alloc(gpu->heap, sizeof(gpu_memory_block_t), 8);
+	memset(block, 0, sizeof(*block));
+	block->size = size;
+	block->type_index = type_index;
+
+	VkMemoryAllocateInfo mem_alloc =
+	{
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.allocationSize = size,
+		.memoryTypeIndex = type_index,
+	};
+	VkResult result = vkAllocateMemory(gpu->logical_device, &mem_alloc, NULL, &block->memory);
+	if (result)
+	{
+		debug_print(k_print_error, "vkAllocateMemory failed: %d\n", result);
+		heap_free(gpu->heap, block);
+		return NULL;
+	}
+
+	// Memory can only be mapped once, so host visible blocks stay mapped for all their allocations.
+	if (gpu->memory_properties.memoryTypes[type_index].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		result = vkMapMemory(gpu->logical_device, block->memory, 0, VK_WHOLE_SIZE, 0, (void**)&block->data);
+		if (result)
+		{
+			debug_print(k_print_error, "vkMapMemory failed: %d\n", result);
+			vkFreeMemory(gpu->logical_device, block->memory, NULL);
+			heap_free(gpu->heap, block);
+			return NULL;
+		}
+	}
+
+	memory_block_insert_range(gpu, block, 0, 0, size);
+
+	gpu_memory_type_t* type = &gpu->memory_types[type_index];
+	block->next = type->blocks;
+	type->blocks = block;
+	type->stats.block_count++;
+	type->stats.block_bytes += size;
+	return block;
+}
+
+static void memory_block_destroy(gpu_t* gpu, gpu_memory_block_t* block)
+{
+	gpu_memory_type_t* type = &gpu->memory_types[block->type_index];
+	gpu_memory_block_t** link = &type->blocks;
+	while (*link != block)
+	{
+		link = &(*link)->next;
+	}
+	*link = block->next;
+	type->stats.block_count--;
+	type->stats.block_bytes -= block->size;
+
+	if (block->data)
+	{
+		vkUnmapMemory(gpu->logical_device, block->memory);
+	}
+	vkFreeMemory(gpu->logical_device, block->memory, NULL);
+	heap_free(gpu->heap, block->free_ranges);
+	heap_free(gpu->heap, block);
+}
+
+static bool memory_block_find_range(gpu_memory_block_t* block, VkDeviceSize size, VkDeviceSize alignment, int* range, VkDeviceSize* leftover)
+{
+	bool found = false;
+	for (int i = 0; i < block->free_count; ++i)
+	{
+		gpu_memory_range_t* r = &block->free_ranges[i];
+		VkDeviceSize start = (r->offset + alignment - 1) & ~(alignment - 1);
+		if (start + size <= r->offset + r->size && (!found || r->size - size < *leftover))
+		{
+			*range = i;
+			*leftover = r->size - size;
+			found = true;
+		}
+	}
+	return found;
+}
+
+static VkDeviceSize memory_block_take_range(gpu_t* gpu, gpu_memory_block_t* block, int range, VkDeviceSize size, VkDeviceSize alignment)
+{
+	gpu_memory_range_t r = block->free_ranges[range];
+	VkDeviceSize start = (r.offset + alignment - 1) & ~(alignment - 1);
+	VkDeviceSize end = start + size;
+
+	// The range splits into the alignment padding before the allocation and the remainder after it.
+	memmove(&block->free_ranges[range], &block->free_ranges[range + 1], sizeof(gpu_memory_range_t) * (block->free_count - range - 1));
+	block->free_count--;
+	if (end < r.offset + r.size)
+	{
+		memory_block_insert_range(gpu, block, range, end, r.offset + r.size - end);
+	}
+	if (start > r.offset)
+	{
+		memory_block_insert_range(gpu, block, range, r.offset, start - r.offset);
+	}
+	return start;
+}
+
+static void memory_block_return_range(gpu_t* gpu, gpu_memory_block_t* block, VkDeviceSize offset, VkDeviceSize size)
+{
+	int index = 0;
+	while (index < block->free_count && block->free_ranges[index].offset < offset)
+	{
+		index++;
+	}
+
+	// Merge with the free ranges on either side, if they touch.
+	bool merge_prev = index > 0 &&
+		block->free_ranges[index - 1].offset + block->free_ranges[index - 1].size == offset;
+	bool merge_next = index < block->free_count &&
+		offset + size == block->free_ranges[index].offset;
+	if (merge_prev && merge_next)
+	{
+		block->free_ranges[index - 1].size += size + block->free_ranges[index].size;
+		memmove(&block->free_ranges[index], &block->free_ranges[index + 1], sizeof(gpu_memory_range_t) * (block->free_count - index - 1));
+		block->free_count--;
+	}
+	else if (merge_prev)
+	{
+		block->free_ranges[index - 1].size += size;
+	}
+	else if (merge_next)
+	{
+		block->free_ranges[index].offset = offset;
+		block->free_ranges[index].size += size;
+	}
+	else
+	{
+		memory_block_insert_range(gpu, block, index, offset, size);
+	}
+}
+
+static void memory_block_insert_range(gpu_t* gpu, gpu_memory_block_t* block, int index, VkDeviceSize offset, VkDeviceSize size)
+{
+	if (block->free_count == block->free_capacity)
+	{
+		int capacity = __max(block->free_capacity * 2, 16);
+		gpu_memory_range_t* ranges = heap_alloc(gpu->heap, sizeof(gpu_memory_range_t) * capacity, 8);
+		if (block->free_ranges)
+		{
+			memcpy(ranges, block->free_ranges, sizeof(gpu_memory_range_t) * block->free_count);
+			heap_free(gpu->heap, block->free_ranges);
+		}
+		block->free_ranges = ranges;
+		block->free_capacity = capacity;
+	}
+	memmove(&block->free_ranges[index + 1], &block->free_ranges[index], sizeof(gpu_memory_range_t) * (block->free_count - index));
+	block->free_ranges[index] = (gpu_memory_range_t) { .offset = offset, .size = size };
+	block->free_count++;
+}
+
+#endif // !GPU_NULL
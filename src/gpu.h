@@ -1,22 +1,31 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef struct gpu_t gpu_t;
 typedef struct gpu_cmd_buffer_t gpu_cmd_buffer_t;
 typedef struct gpu_descriptor_t gpu_descriptor_t;
+typedef struct gpu_instance_buffer_t gpu_instance_buffer_t;
 typedef struct gpu_mesh_t gpu_mesh_t;
 typedef struct gpu_pipeline_t gpu_pipeline_t;
 typedef struct gpu_shader_t gpu_shader_t;
-typedef struct gpu_uniform_buffer_t gpu_uniform_buffer_t;
 
+typedef struct fs_t fs_t;
 typedef struct heap_t heap_t;
 typedef struct wm_window_t wm_window_t;
 
+enum
+{
+	// Secondary command buffers each frame can record, one per recording thread.
+	k_gpu_max_secondary_cmd_buffers = 8,
+};
+
 typedef struct gpu_descriptor_info_t
 {
 	gpu_shader_t* shader;
-	gpu_uniform_buffer_t** uniform_buffers;
+	// Size in bytes of the uniform data read by each binding.
+	const size_t* uniform_sizes;
 	int uniform_buffer_count;
 } gpu_descriptor_info_t;
 
@@ -28,6 +37,18 @@ typedef enum gpu_mesh_layout_t
 	k_gpu_mesh_layout_count,
 } gpu_mesh_layout_t;
 
+// Per-instance vertex data read by instanced shaders, bound alongside the mesh.
+// Attributes follow the mesh attributes, starting at location 2.
+typedef enum gpu_instance_layout_t
+{
+	// Not instanced.
+	k_gpu_instance_layout_none,
+	// Model matrix as four vec4 rows at locations 2-5, color as a vec3 at location 6.
+	k_gpu_instance_layout_m4444_c444,
+
+	k_gpu_instance_layout_count,
+} gpu_instance_layout_t;
+
 typedef struct gpu_mesh_info_t
 {
 	gpu_mesh_layout_t layout;
@@ -41,6 +62,7 @@ typedef struct gpu_pipeline_info_t
 {
 	gpu_shader_t* shader;
 	gpu_mesh_layout_t mesh_layout;
+	gpu_instance_layout_t instance_layout;
 } gpu_pipeline_info_t;
 
 typedef struct gpu_shader_info_t
@@ -50,6 +72,8 @@ typedef struct gpu_shader_info_t
 	void* fragment_shader_data;
 	size_t fragment_shader_size;
 	int uniform_buffer_count;
+	// Per-instance data the vertex shader expects, if any.
+	gpu_instance_layout_t instance_layout;
 } gpu_shader_info_t;
 
 typedef struct gpu_uniform_buffer_info_t
@@ -58,10 +82,24 @@ typedef struct gpu_uniform_buffer_info_t
 	size_t size;
 } gpu_uniform_buffer_info_t;
 
+// Device memory use of one memory type.
+// Buffers are placed in large blocks of device memory rather than allocated one by one.
+typedef struct gpu_memory_stats_t
+{
+	int block_count;
+	size_t block_bytes;
+	int allocation_count;
+	size_t allocated_bytes;
+} gpu_memory_stats_t;
+
 // Create an instance of Vulkan on the provided window.
-gpu_t* gpu_create(heap_t* heap, wm_window_t* window);
+// Compiled pipelines are cached in a file through the file system, loaded here and saved on destroy.
+// The file system may be NULL to compile every pipeline from scratch.
+// Backend config is read by backends that take one, e.g. a gpu_null_config_t for the null backend,
+// and ignored by Vulkan. May be NULL for defaults.
+gpu_t* gpu_create(heap_t* heap, fs_t* fs, wm_window_t* window, const void* backend_config);
 
-// Destroy the previously created Vulkan.
+// Destroy the previously created Vulkan, saving the pipeline cache.
 void gpu_destroy(gpu_t* gpu);
 
 // Get the number of frames in the swapchain.
@@ -70,7 +108,14 @@ int gpu_get_frame_count(gpu_t* gpu);
 // Wait for the GPU to be done all queued work.
 void gpu_wait_until_idle(gpu_t* gpu);
 
-// Binds uniform buffers (and textures if we had them) to a given shader layout.
+// Get the number of device memory types.
+int gpu_get_memory_type_count(gpu_t* gpu);
+
+// Get the device memory use of a memory type.
+void gpu_get_memory_stats(gpu_t* gpu, int type_index, gpu_memory_stats_t* stats);
+
+// Binds uniform data (and textures if we had them) to a given shader layout.
+// Uniform data is read from the frame's uniform memory at offsets given when the descriptor is bound.
 gpu_descriptor_t* gpu_descriptor_create(gpu_t* gpu, const gpu_descriptor_info_t* info);
 
 // Destroys a descriptor.
@@ -94,23 +139,43 @@ gpu_shader_t* gpu_shader_create(gpu_t* gpu, const gpu_shader_info_t* info);
 // Destroy a shader.
 void gpu_shader_destroy(gpu_t* gpu, gpu_shader_t* shader);
 
-// Create a uniform buffer with specified size and contents.
-// Will be consumed by a shader.
-gpu_uniform_buffer_t* gpu_uniform_buffer_create(gpu_t* gpu, const gpu_uniform_buffer_info_t* info);
+// Copy uniform data into the current frame's uniform memory, a persistently mapped buffer region
+// per frame in flight. Call between gpu_frame_begin() and gpu_frame_end(); the data lives until the frame ends.
+// Writes the offset to bind the data at and returns true, or returns false if the frame is out of uniform memory.
+bool gpu_uniform_write(gpu_t* gpu, const void* data, size_t size, uint32_t* offset);
+
+// Get the size in bytes of one instance in a layout.
+size_t gpu_instance_layout_get_size(gpu_instance_layout_t layout);
 
-// Modify an existing uniform buffer.
-void gpu_uniform_buffer_update(gpu_t* gpu, gpu_uniform_buffer_t* buffer, const void* data, size_t size);
+// Create a buffer of per-instance vertex data with the given capacity in bytes.
+gpu_instance_buffer_t* gpu_instance_buffer_create(gpu_t* gpu, size_t size);
 
-// Destroy a uniform buffer.
-void gpu_uniform_buffer_destroy(gpu_t* gpu, gpu_uniform_buffer_t* buffer);
+// Modify an existing instance buffer, starting at its beginning.
+void gpu_instance_buffer_update(gpu_t* gpu, gpu_instance_buffer_t* buffer, const void* data, size_t size);
 
-// Start a new frame of rendering. May wait on a prior frame to complete.
+// Destroy an instance buffer.
+void gpu_instance_buffer_destroy(gpu_t* gpu, gpu_instance_buffer_t* buffer);
+
+// Start a new frame of rendering. Waits for the GPU to finish the frame that last used the same resources.
 // Returns a command buffer for all rendering in that frame.
-gpu_cmd_buffer_t* gpu_frame_begin(gpu_t* gpu);
+// With secondary set, the frame's draws must be recorded into secondary command buffers,
+// and the returned command buffer only executes them.
+gpu_cmd_buffer_t* gpu_frame_begin(gpu_t* gpu, bool secondary);
 
 // Finish rendering frame.
 void gpu_frame_end(gpu_t* gpu);
 
+// Start recording a secondary command buffer of the current frame.
+// Each index has its own command pool, so different indices may be recorded on different threads at once.
+// Pipeline, mesh and descriptor binds do not carry over between command buffers.
+gpu_cmd_buffer_t* gpu_secondary_cmd_buffer_begin(gpu_t* gpu, int index);
+
+// Finish recording a secondary command buffer.
+void gpu_secondary_cmd_buffer_end(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer);
+
+// Execute secondary command buffers in order from a frame's command buffer.
+void gpu_cmd_execute_secondary(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, gpu_cmd_buffer_t** secondary_cmd_buffers, int count);
+
 // Set the current pipeline for this command buffer.
 void gpu_cmd_pipeline_bind(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, gpu_pipeline_t* pipeline);
 
@@ -118,7 +183,16 @@ void gpu_cmd_pipeline_bind(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, gpu_pipelin
 void gpu_cmd_mesh_bind(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, gpu_mesh_t* mesh);
 
 // Set the current descriptor for this command buffer.
-void gpu_cmd_descriptor_bind(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, gpu_descriptor_t* descriptor);
+// Each binding reads uniform data at the matching offset returned by gpu_uniform_write().
+void gpu_cmd_descriptor_bind(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, gpu_descriptor_t* descriptor, const uint32_t* uniform_offsets);
+
+// Set the current instance buffer for this command buffer, with instance 0 at a byte offset.
+// Stays bound across pipeline and mesh binds.
+void gpu_cmd_instance_buffer_bind(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, gpu_instance_buffer_t* buffer, size_t offset);
 
 // Draw given current pipeline, mesh, and descriptor.
 void gpu_cmd_draw(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer);
+
+// Draw instance_count copies of the current mesh, reading instances from the current instance buffer
+// starting at first_instance. The current pipeline must have an instance layout.
+void gpu_cmd_draw_instanced(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, int first_instance, int instance_count);
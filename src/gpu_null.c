@@ -0,0 +1,422 @@
+#if defined(GPU_NULL)
+
+#include "gpu.h"
+#include "gpu_null.h"
+
+#include "debug.h"
+#include "heap.h"
+#include "thread.h"
+#include "timer.h"
+
+#include <string.h>
+
+enum
+{
+	// Bytes of uniform data each frame in flight may write, as in gpu.c.
+	k_gpu_uniform_frame_size = 1024 * 1024,
+	k_gpu_uniform_alignment = 256,
+};
+
+typedef struct gpu_cmd_buffer_t
+{
+	// Only the command counts are used.
+	gpu_null_counters_t counters;
+	int command_count;
+	gpu_null_command_t* log;
+	int log_count;
+	int log_capacity;
+} gpu_cmd_buffer_t;
+
+typedef struct gpu_descriptor_t
+{
+	int uniform_buffer_count;
+} gpu_descriptor_t;
+
+typedef struct gpu_instance_buffer_t
+{
+	char* data;
+	size_t size;
+} gpu_instance_buffer_t;
+
+typedef struct gpu_mesh_t
+{
+	gpu_mesh_layout_t layout;
+	size_t index_data_size;
+} gpu_mesh_t;
+
+typedef struct gpu_pipeline_t
+{
+	gpu_shader_t* shader;
+} gpu_pipeline_t;
+
+typedef struct gpu_shader_t
+{
+	int uniform_buffer_count;
+} gpu_shader_t;
+
+typedef struct gpu_t
+{
+	heap_t* heap;
+	gpu_null_config_t config;
+	gpu_null_counters_t* counters;
+	gpu_null_counters_t local_counters;
+	int live_objects;
+
+	gpu_cmd_buffer_t cmd_buffer;
+	gpu_cmd_buffer_t secondary_cmd_buffers[k_gpu_max_secondary_cmd_buffers];
+
+	// Uniform data is copied like gpu.c does, so its cost shows up in measurements.
+	char* uniform_data;
+	size_t uniform_cursor;
+	size_t uniform_end;
+
+	int frame_index;
+} gpu_t;
+
+static void wait_us(uint32_t us);
+static void cmd_buffer_reset(gpu_cmd_buffer_t* cmd_buffer);
+static void cmd_buffer_record(gpu_cmd_buffer_t* cmd_buffer, gpu_null_command_type_t type, const void* object, uint32_t offset, int count);
+static void cmd_buffer_add_counts(gpu_null_counters_t* dst, const gpu_null_counters_t* src);
+
+gpu_t* gpu_create(heap_t* heap, fs_t* fs, wm_window_t* window, const void* backend_config)
+{
+	gpu_t* gpu = heap_alloc(heap, sizeof(gpu_t), 8);
+	memset(gpu, 0, sizeof(*gpu));
+	gpu->heap = heap;
+	gpu->config = backend_config ? *(const gpu_null_config_t*)backend_config : (gpu_null_config_t) { .frame_count = 2 };
+	gpu->config.frame_count = __max(gpu->config.frame_count, 1);
+	gpu->counters = gpu->config.counters ? gpu->config.counters : &gpu->local_counters;
+
+	if (gpu->config.command_log && gpu->config.command_log_capacity > 0)
+	{
+		size_t log_size = sizeof(gpu_null_command_t) * gpu->config.command_log_capacity;
+		gpu->cmd_buffer.log = heap_alloc(heap, log_size, 8);
+		gpu->cmd_buffer.log_capacity = gpu->config.command_log_capacity;
+		for (int i = 0; i < _countof(gpu->secondary_cmd_buffers); ++i)
+		{
+			gpu->secondary_cmd_buffers[i].log = heap_alloc(heap, log_size, 8);
+			gpu->secondary_cmd_buffers[i].log_capacity = gpu->config.command_log_capacity;
+		}
+	}
+
+	gpu->uniform_data = heap_alloc(heap, (size_t)k_gpu_uniform_frame_size * gpu->config.frame_count, k_gpu_uniform_alignment);
+	return gpu;
+}
+
+void gpu_destroy(gpu_t* gpu)
+{
+	if (gpu)
+	{
+		if (gpu->live_objects)
+		{
+			debug_print(k_print_warning, "Null GPU destroyed with %d objects alive\n", gpu->live_objects);
+		}
+		if (gpu->cmd_buffer.log)
+		{
+			heap_free(gpu->heap, gpu->cmd_buffer.log);
+			for (int i = 0; i < _countof(gpu->secondary_cmd_buffers); ++i)
+			{
+				heap_free(gpu->heap, gpu->secondary_cmd_buffers[i].log);
+			}
+		}
+		heap_free(gpu->heap, gpu->uniform_data);
+		heap_free(gpu->heap, gpu);
+	}
+}
+
+int gpu_get_frame_count(gpu_t* gpu)
+{
+	return gpu->config.frame_count;
+}
+
+void gpu_wait_until_idle(gpu_t* gpu)
+{
+}
+
+int gpu_get_memory_type_count(gpu_t* gpu)
+{
+	return 0;
+}
+
+void gpu_get_memory_stats(gpu_t* gpu, int type_index, gpu_memory_stats_t* stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+
+gpu_descriptor_t* gpu_descriptor_create(gpu_t* gpu, const gpu_descriptor_info_t* info)
+{
+	gpu_descriptor_t* descriptor = heap_alloc(gpu->heap, sizeof(gpu_descriptor_t), 8);
+	descriptor->uniform_buffer_count = info->uniform_buffer_count;
+	gpu->counters->descriptor_creates++;
+	gpu->live_objects++;
+	return descriptor;
+}
+
+void gpu_descriptor_destroy(gpu_t* gpu, gpu_descriptor_t* descriptor)
+{
+	if (descriptor)
+	{
+		heap_free(gpu->heap, descriptor);
+		gpu->counters->descriptor_destroys++;
+		gpu->live_objects--;
+	}
+}
+
+gpu_mesh_t* gpu_mesh_create(gpu_t* gpu, const gpu_mesh_info_t* info)
+{
+	wait_us(gpu->config.mesh_create_us);
+	gpu_mesh_t* mesh = heap_alloc(gpu->heap, sizeof(gpu_mesh_t), 8);
+	mesh->layout = info->layout;
+	mesh->index_data_size = info->index_data_size;
+	gpu->counters->mesh_creates++;
+	gpu->live_objects++;
+	return mesh;
+}
+
+void gpu_mesh_destroy(gpu_t* gpu, gpu_mesh_t* mesh)
+{
+	if (mesh)
+	{
+		heap_free(gpu->heap, mesh);
+		gpu->counters->mesh_destroys++;
+		gpu->live_objects--;
+	}
+}
+
+gpu_pipeline_t* gpu_pipeline_create(gpu_t* gpu, const gpu_pipeline_info_t* info)
+{
+	wait_us(gpu->config.pipeline_create_us);
+	gpu_pipeline_t* pipeline = heap_alloc(gpu->heap, sizeof(gpu_pipeline_t), 8);
+	pipeline->shader = info->shader;
+	gpu->counters->pipeline_creates++;
+	gpu->live_objects++;
+	return pipeline;
+}
+
+void gpu_pipeline_destroy(gpu_t* gpu, gpu_pipeline_t* pipeline)
+{
+	if (pipeline)
+	{
+		heap_free(gpu->heap, pipeline);
+		gpu->counters->pipeline_destroys++;
+		gpu->live_objects--;
+	}
+}
+
+gpu_shader_t* gpu_shader_create(gpu_t* gpu, const gpu_shader_info_t* info)
+{
+	wait_us(gpu->config.shader_create_us);
+	gpu_shader_t* shader = heap_alloc(gpu->heap, sizeof(gpu_shader_t), 8);
+	shader->uniform_buffer_count = info->uniform_buffer_count;
+	gpu->counters->shader_creates++;
+	gpu->live_objects++;
+	return shader;
+}
+
+void gpu_shader_destroy(gpu_t* gpu, gpu_shader_t* shader)
+{
+	if (shader)
+	{
+		heap_free(gpu->heap, shader);
+		gpu->counters->shader_destroys++;
+		gpu->live_objects--;
+	}
+}
+
+bool gpu_uniform_write(gpu_t* gpu, const void* data, size_t size, uint32_t* offset)
+{
+	size_t start = (gpu->uniform_cursor + k_gpu_uniform_alignment - 1) & ~((size_t)k_gpu_uniform_alignment - 1);
+	if (start + size > gpu->uniform_end)
+	{
+		debug_print(k_print_error, "Uniform data of %zu bytes overflows the frame's %d bytes\n", size, k_gpu_uniform_frame_size);
+		return false;
+	}
+	memcpy(gpu->uniform_data + start, data, size);
+	gpu->uniform_cursor = start + size;
+	*offset = (uint32_t)start;
+	gpu->counters->uniform_writes++;
+	return true;
+}
+
+size_t gpu_instance_layout_get_size(gpu_instance_layout_t layout)
+{
+	switch (layout)
+	{
+	case k_gpu_instance_layout_m4444_c444:
+		return sizeof(float) * (16 + 3);
+	default:
+		return 0;
+	}
+}
+
+gpu_instance_buffer_t* gpu_instance_buffer_create(gpu_t* gpu, size_t size)
+{
+	gpu_instance_buffer_t* instance_buffer = heap_alloc(gpu->heap, sizeof(gpu_instance_buffer_t), 8);
+	instance_buffer->data = heap_alloc(gpu->heap, size, 16);
+	instance_buffer->size = size;
+	gpu->counters->instance_buffer_creates++;
+	gpu->live_objects++;
+	return instance_buffer;
+}
+
+void gpu_instance_buffer_update(gpu_t* gpu, gpu_instance_buffer_t* buffer, const void* data, size_t size)
+{
+	if (size > buffer->size)
+	{
+		debug_print(k_print_error, "Instance data of %zu bytes overflows buffer of %zu bytes\n", size, buffer->size);
+		size = buffer->size;
+	}
+	memcpy(buffer->data, data, size);
+	gpu->counters->instance_buffer_updates++;
+}
+
+void gpu_instance_buffer_destroy(gpu_t* gpu, gpu_instance_buffer_t* buffer)
+{
+	if (buffer)
+	{
+		heap_free(gpu->heap, buffer->data);
+		heap_free(gpu->heap, buffer);
+		gpu->counters->instance_buffer_destroys++;
+		gpu->live_objects--;
+	}
+}
+
+gpu_cmd_buffer_t* gpu_frame_begin(gpu_t* gpu, bool secondary)
+{
+	wait_us(gpu->config.frame_wait_us);
+
+	gpu->uniform_cursor = (size_t)gpu->frame_index * k_gpu_uniform_frame_size;
+	gpu->uniform_end = gpu->uniform_cursor + k_gpu_uniform_frame_size;
+
+	cmd_buffer_reset(&gpu->cmd_buffer);
+	return &gpu->cmd_buffer;
+}
+
+void gpu_frame_end(gpu_t* gpu)
+{
+	gpu_cmd_buffer_t* cmd_buffer = &gpu->cmd_buffer;
+	cmd_buffer_add_counts(gpu->counters, &cmd_buffer->counters);
+	gpu->counters->last_frame_commands = cmd_buffer->command_count;
+	gpu->counters->frames++;
+	if (cmd_buffer->log)
+	{
+		memcpy(gpu->config.command_log, cmd_buffer->log, sizeof(gpu_null_command_t) * cmd_buffer->log_count);
+	}
+
+	gpu->frame_index = (gpu->frame_index + 1) % gpu->config.frame_count;
+}
+
+gpu_cmd_buffer_t* gpu_secondary_cmd_buffer_begin(gpu_t* gpu, int index)
+{
+	gpu_cmd_buffer_t* cmd_buffer = &gpu->secondary_cmd_buffers[index];
+	cmd_buffer_reset(cmd_buffer);
+	return cmd_buffer;
+}
+
+void gpu_secondary_cmd_buffer_end(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer)
+{
+}
+
+void gpu_cmd_execute_secondary(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, gpu_cmd_buffer_t** secondary_cmd_buffers, int count)
+{
+	cmd_buffer_record(cmd_buffer, k_gpu_null_command_execute_secondary, NULL, 0, count);
+	gpu->counters->secondary_cmd_buffers += count;
+
+	// Splice the secondary commands in so the log reads in execution order.
+	for (int i = 0; i < count; ++i)
+	{
+		gpu_cmd_buffer_t* secondary = secondary_cmd_buffers[i];
+		cmd_buffer_add_counts(&cmd_buffer->counters, &secondary->counters);
+		cmd_buffer->command_count += secondary->command_count;
+		if (cmd_buffer->log)
+		{
+			int copy_count = __min(secondary->log_count, cmd_buffer->log_capacity - cmd_buffer->log_count);
+			memcpy(cmd_buffer->log + cmd_buffer->log_count, secondary->log, sizeof(gpu_null_command_t) * copy_count);
+			cmd_buffer->log_count += copy_count;
+		}
+	}
+}
+
+void gpu_cmd_pipeline_bind(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, gpu_pipeline_t* pipeline)
+{
+	cmd_buffer->counters.pipeline_binds++;
+	cmd_buffer_record(cmd_buffer, k_gpu_null_command_pipeline_bind, pipeline, 0, 0);
+}
+
+void gpu_cmd_mesh_bind(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, gpu_mesh_t* mesh)
+{
+	cmd_buffer->counters.mesh_binds++;
+	cmd_buffer_record(cmd_buffer, k_gpu_null_command_mesh_bind, mesh, 0, 0);
+}
+
+void gpu_cmd_descriptor_bind(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, gpu_descriptor_t* descriptor, const uint32_t* uniform_offsets)
+{
+	cmd_buffer->counters.descriptor_binds++;
+	cmd_buffer_record(cmd_buffer, k_gpu_null_command_descriptor_bind, descriptor, uniform_offsets[0], descriptor->uniform_buffer_count);
+}
+
+void gpu_cmd_instance_buffer_bind(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, gpu_instance_buffer_t* buffer, size_t offset)
+{
+	cmd_buffer->counters.instance_buffer_binds++;
+	cmd_buffer_record(cmd_buffer, k_gpu_null_command_instance_buffer_bind, buffer, (uint32_t)offset, 0);
+}
+
+void gpu_cmd_draw(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer)
+{
+	cmd_buffer->counters.draws++;
+	cmd_buffer_record(cmd_buffer, k_gpu_null_command_draw, NULL, 0, 1);
+}
+
+void gpu_cmd_draw_instanced(gpu_t* gpu, gpu_cmd_buffer_t* cmd_buffer, int first_instance, int instance_count)
+{
+	cmd_buffer->counters.instanced_draws++;
+	cmd_buffer->counters.instances += instance_count;
+	cmd_buffer_record(cmd_buffer, k_gpu_null_command_draw_instanced, NULL, first_instance, instance_count);
+}
+
+static void wait_us(uint32_t us)
+{
+	if (!us)
+	{
+		return;
+	}
+
+	// Sleeps are only as fine as the OS scheduler tick, so spin out the remainder.
+	uint64_t end = timer_get_ticks() + us * timer_get_ticks_per_second() / 1000000;
+	if (us >= 2000)
+	{
+		thread_sleep(us / 1000 - 1);
+	}
+	while (timer_get_ticks() < end)
+	{
+	}
+}
+
+static void cmd_buffer_reset(gpu_cmd_buffer_t* cmd_buffer)
+{
+	memset(&cmd_buffer->counters, 0, sizeof(cmd_buffer->counters));
+	cmd_buffer->command_count = 0;
+	cmd_buffer->log_count = 0;
+}
+
+static void cmd_buffer_record(gpu_cmd_buffer_t* cmd_buffer, gpu_null_command_type_t type, const void* object, uint32_t offset, int count)
+{
+	cmd_buffer->command_count++;
+	if (cmd_buffer->log && cmd_buffer->log_count < cmd_buffer->log_capacity)
+	{
+		cmd_buffer->log[cmd_buffer->log_count++] = (gpu_null_command_t) { .type = type, .object = object, .offset = offset, .count = count };
+	}
+}
+
+static void cmd_buffer_add_counts(gpu_null_counters_t* dst, const gpu_null_counters_t* src)
+{
+	dst->pipeline_binds += src->pipeline_binds;
+	dst->mesh_binds += src->mesh_binds;
+	dst->descriptor_binds += src->descriptor_binds;
+	dst->instance_buffer_binds += src->instance_buffer_binds;
+	dst->draws += src->draws;
+	dst->instanced_draws += src->instanced_draws;
+	dst->instances += src->instances;
+}
+
+#endif // GPU_NULL
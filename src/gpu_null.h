@@ -0,0 +1,82 @@
+#pragma once
+
+// Null GPU Backend
+// Implements gpu.h without a device or a window, in place of gpu.c when built with GPU_NULL defined.
+// Calls are counted, the commands of the last frame can be logged, and creating objects
+// or waiting for a frame can be made to take time, so the CPU side of rendering can be measured headless.
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum gpu_null_command_type_t
+{
+	k_gpu_null_command_pipeline_bind,
+	k_gpu_null_command_mesh_bind,
+	k_gpu_null_command_descriptor_bind,
+	k_gpu_null_command_instance_buffer_bind,
+	k_gpu_null_command_draw,
+	k_gpu_null_command_draw_instanced,
+	k_gpu_null_command_execute_secondary,
+} gpu_null_command_type_t;
+
+// A command recorded into a command buffer.
+typedef struct gpu_null_command_t
+{
+	gpu_null_command_type_t type;
+	// Object bound, or NULL.
+	const void* object;
+	// Uniform offset, instance buffer offset or first instance.
+	uint32_t offset;
+	// Instances drawn, or secondary command buffers executed.
+	int count;
+} gpu_null_command_t;
+
+// Running totals of calls made to the backend.
+typedef struct gpu_null_counters_t
+{
+	int frames;
+	int shader_creates;
+	int shader_destroys;
+	int pipeline_creates;
+	int pipeline_destroys;
+	int mesh_creates;
+	int mesh_destroys;
+	int descriptor_creates;
+	int descriptor_destroys;
+	int instance_buffer_creates;
+	int instance_buffer_destroys;
+	int instance_buffer_updates;
+	int uniform_writes;
+	int secondary_cmd_buffers;
+
+	int pipeline_binds;
+	int mesh_binds;
+	int descriptor_binds;
+	int instance_buffer_binds;
+	int draws;
+	int instanced_draws;
+	int instances;
+
+	// Commands of the last finished frame, including those dropped from a full log.
+	int last_frame_commands;
+} gpu_null_counters_t;
+
+// Behavior of a null device, passed to gpu_create() as its backend config.
+// Without one, devices have two frames in flight, take no time and count nothing.
+typedef struct gpu_null_config_t
+{
+	// Frames in flight, as a swapchain would have.
+	int frame_count;
+	// Time gpu_frame_begin() takes, as if waiting for the GPU to finish an earlier frame.
+	uint32_t frame_wait_us;
+	// Time creating each kind of object takes.
+	uint32_t shader_create_us;
+	uint32_t pipeline_create_us;
+	uint32_t mesh_create_us;
+	// Totals are added here as frames finish and objects come and go. May be NULL.
+	// The backend runs on the render thread; read them once it has stopped.
+	gpu_null_counters_t* counters;
+	// Commands of the last finished frame are copied here in execution order. May be NULL.
+	gpu_null_command_t* command_log;
+	int command_log_capacity;
+} gpu_null_config_t;
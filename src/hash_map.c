@@ -0,0 +1,127 @@
+#include "hash_map.h"
+
+#include "heap.h"
+
+#include <string.h>
+
+typedef struct hash_map_entry_t
+{
+	uint64_t key;
+	uint32_t value;
+	bool used;
+} hash_map_entry_t;
+
+typedef struct hash_map_t
+{
+	heap_t* heap;
+	hash_map_entry_t* entries;
+	uint32_t mask;
+	int capacity;
+	int count;
+} hash_map_t;
+
+static uint32_t hash_key(uint64_t key);
+static uint32_t find_slot(hash_map_t* map, uint64_t key);
+
+hash_map_t* hash_map_create(heap_t* heap, int capacity)
+{
+	uint32_t table_size = 1;
+	while (table_size < (uint32_t)capacity * 2)
+	{
+		table_size <<= 1;
+	}
+
+	hash_map_t* map = heap_alloc(heap, sizeof(hash_map_t), 8);
+	map->heap = heap;
+	map->entries = heap_alloc(heap, sizeof(hash_map_entry_t) * table_size, 8);
+	memset(map->entries, 0, sizeof(hash_map_entry_t) * table_size);
+	map->mask = table_size - 1;
+	map->capacity = capacity;
+	map->count = 0;
+	return map;
+}
+
+void hash_map_destroy(hash_map_t* map)
+{
+	heap_free(map->heap, map->entries);
+	heap_free(map->heap, map);
+}
+
+bool hash_map_find(hash_map_t* map, uint64_t key, uint32_t* value)
+{
+	hash_map_entry_t* entry = &map->entries[find_slot(map, key)];
+	if (!entry->used)
+	{
+		return false;
+	}
+	*value = entry->value;
+	return true;
+}
+
+bool hash_map_insert(hash_map_t* map, uint64_t key, uint32_t value)
+{
+	hash_map_entry_t* entry = &map->entries[find_slot(map, key)];
+	if (!entry->used)
+	{
+		if (map->count >= map->capacity)
+		{
+			return false;
+		}
+		entry->key = key;
+		entry->used = true;
+		map->count++;
+	}
+	entry->value = value;
+	return true;
+}
+
+bool hash_map_remove(hash_map_t* map, uint64_t key)
+{
+	uint32_t hole = find_slot(map, key);
+	if (!map->entries[hole].used)
+	{
+		return false;
+	}
+
+	// Move back any later entry of the probe run that may fill the hole:
+	// one whose home slot is not cyclically between the hole and the entry itself.
+	for (uint32_t i = (hole + 1) & map->mask; map->entries[i].used; i = (i + 1) & map->mask)
+	{
+		uint32_t home = hash_key(map->entries[i].key) & map->mask;
+		if (((i - home) & map->mask) >= ((i - hole) & map->mask))
+		{
+			map->entries[hole] = map->entries[i];
+			hole = i;
+		}
+	}
+	map->entries[hole].used = false;
+	map->count--;
+	return true;
+}
+
+int hash_map_get_count(hash_map_t* map)
+{
+	return map->count;
+}
+
+// Mix all key bits into the low bits used to pick a slot, so keys like aligned pointers spread evenly.
+static uint32_t hash_key(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdull;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ull;
+	key ^= key >> 33;
+	return (uint32_t)key;
+}
+
+// Slot holding a key, or the empty slot ending its probe run.
+static uint32_t find_slot(hash_map_t* map, uint64_t key)
+{
+	uint32_t i = hash_key(key) & map->mask;
+	while (map->entries[i].used && map->entries[i].key != key)
+	{
+		i = (i + 1) & map->mask;
+	}
+	return i;
+}
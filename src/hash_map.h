@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Hash Map container
+// Maps 64-bit keys to 32-bit values with open addressing and linear probing.
+// Removal shifts later entries back instead of leaving tombstones,
+// so lookups stay short however many insertions and removals a map sees.
+// Not thread-safe.
+
+// Handle to a hash map.
+typedef struct hash_map_t hash_map_t;
+
+typedef struct heap_t heap_t;
+
+// Create a hash map able to hold capacity entries.
+// The table is sized so it is never more than half full.
+hash_map_t* hash_map_create(heap_t* heap, int capacity);
+
+// Destroy a previously created hash map.
+void hash_map_destroy(hash_map_t* map);
+
+// Find the value of a key.
+// Returns false if the key is not in the map.
+bool hash_map_find(hash_map_t* map, uint64_t key, uint32_t* value);
+
+// Add a key, or replace the value of a key already in the map.
+// Returns false if the map is full.
+bool hash_map_insert(hash_map_t* map, uint64_t key, uint32_t value);
+
+// Remove a key.
+// Returns false if the key is not in the map.
+bool hash_map_remove(hash_map_t* map, uint64_t key);
+
+// Get the number of entries in the map.
+int hash_map_get_count(hash_map_t* map);
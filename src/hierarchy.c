@@ -0,0 +1,451 @@
+#include "hierarchy.h"
+
+#include "debug.h"
+#include "heap.h"
+#include "transform.h"
+
+#include <string.h>
+
+typedef struct hierarchy_t
+{
+	heap_t* heap;
+	ecs_t* ecs;
+	int transform_type;
+	int hierarchy_type;
+	int world_transform_type;
+
+	// Changes stamped at or after this version have not been processed yet.
+	uint32_t last_version;
+
+	// Nodes in parent-first order: parents[i] < i for every node.
+	// Each array has a back buffer used when reordering.
+	int capacity;
+	int node_count;
+	ecs_entity_ref_t* refs[2];
+	int* parents[2];
+	mat4f_t* worlds[2];
+	bool* dirty[2];
+	bool order_dirty;
+
+	// Node index of each entity slot, or -1.
+	int* entity_nodes;
+
+	// Children whose parent was still pending when their link was resolved.
+	// Retried every update until the parent becomes a node or goes away.
+	ecs_entity_ref_t* pending_children;
+	int pending_child_count;
+
+	// Scratch space for reordering.
+	int* depths;
+	int* remap;
+	int* stack;
+
+	// Scratch space for batched local matrix conversion.
+	int* dirty_nodes;
+	transform_t* local_transforms;
+	mat4f_t* local_matrices;
+} hierarchy_t;
+
+static bool has_node_components(hierarchy_t* hierarchy, ecs_entity_ref_t ref);
+static void add_node(hierarchy_t* hierarchy, ecs_entity_ref_t ref);
+static void remove_destroyed_nodes(hierarchy_t* hierarchy);
+static void update_parents(hierarchy_t* hierarchy);
+static void link_parent(hierarchy_t* hierarchy, int node);
+static int find_node(hierarchy_t* hierarchy, ecs_entity_ref_t ref);
+static void sort_nodes(hierarchy_t* hierarchy);
+static void propagate_transforms(hierarchy_t* hierarchy);
+
+hierarchy_t* hierarchy_create(heap_t* heap, ecs_t* ecs, int transform_type)
+{
+	hierarchy_t* hierarchy = heap_alloc(heap, sizeof(hierarchy_t), 8);
+	memset(hierarchy, 0, sizeof(*hierarchy));
+	hierarchy->heap = heap;
+	hierarchy->ecs = ecs;
+	hierarchy->transform_type = transform_type;
+	hierarchy->hierarchy_type = ecs_register_component_type(ecs, "hierarchy", sizeof(hierarchy_component_t), _Alignof(hierarchy_component_t), k_ecs_storage_dense);
+	hierarchy->world_transform_type = ecs_register_component_type(ecs, "world_transform", sizeof(world_transform_component_t), _Alignof(world_transform_component_t), k_ecs_storage_dense);
+
+	int capacity = ecs_get_entity_capacity(ecs);
+	hierarchy->capacity = capacity;
+	for (int i = 0; i < 2; ++i)
+	{
+		hierarchy->refs[i] = heap_alloc(heap, sizeof(ecs_entity_ref_t) * capacity, 8);
+		hierarchy->parents[i] = heap_alloc(heap, sizeof(int) * capacity, 8);
+		hierarchy->worlds[i] = heap_alloc(heap, sizeof(mat4f_t) * capacity, 16);
+		hierarchy->dirty[i] = heap_alloc(heap, sizeof(bool) * capacity, 8);
+	}
+	hierarchy->entity_nodes = heap_alloc(heap, sizeof(int) * capacity, 8);
+	memset(hierarchy->entity_nodes, 0xff, sizeof(int) * capacity);
+	hierarchy->pending_children = heap_alloc(heap, sizeof(ecs_entity_ref_t) * capacity, 8);
+	hierarchy->depths = heap_alloc(heap, sizeof(int) * (capacity + 1), 8);
+	hierarchy->remap = heap_alloc(heap, sizeof(int) * capacity, 8);
+	hierarchy->stack = heap_alloc(heap, sizeof(int) * capacity, 8);
+	hierarchy->dirty_nodes = heap_alloc(heap, sizeof(int) * capacity, 8);
+	hierarchy->local_transforms = heap_alloc(heap, sizeof(transform_t) * capacity, 16);
+	hierarchy->local_matrices = heap_alloc(heap, sizeof(mat4f_t) * capacity, 16);
+	return hierarchy;
+}
+
+void hierarchy_destroy(hierarchy_t* hierarchy)
+{
+	heap_free(hierarchy->heap, hierarchy->local_matrices);
+	heap_free(hierarchy->heap, hierarchy->local_transforms);
+	heap_free(hierarchy->heap, hierarchy->dirty_nodes);
+	heap_free(hierarchy->heap, hierarchy->stack);
+	heap_free(hierarchy->heap, hierarchy->remap);
+	heap_free(hierarchy->heap, hierarchy->depths);
+	heap_free(hierarchy->heap, hierarchy->pending_children);
+	heap_free(hierarchy->heap, hierarchy->entity_nodes);
+	for (int i = 0; i < 2; ++i)
+	{
+		heap_free(hierarchy->heap, hierarchy->dirty[i]);
+		heap_free(hierarchy->heap, hierarchy->worlds[i]);
+		heap_free(hierarchy->heap, hierarchy->parents[i]);
+		heap_free(hierarchy->heap, hierarchy->refs[i]);
+	}
+	heap_free(hierarchy->heap, hierarchy);
+}
+
+int hierarchy_get_component_type(hierarchy_t* hierarchy)
+{
+	return hierarchy->hierarchy_type;
+}
+
+int hierarchy_get_world_transform_type(hierarchy_t* hierarchy)
+{
+	return hierarchy->world_transform_type;
+}
+
+void hierarchy_update(hierarchy_t* hierarchy)
+{
+	remove_destroyed_nodes(hierarchy);
+
+	int spawned_count = 0;
+	const ecs_entity_ref_t* spawned = ecs_get_spawned_entities(hierarchy->ecs, &spawned_count);
+	for (int i = 0; i < spawned_count; ++i)
+	{
+		if (has_node_components(hierarchy, spawned[i]))
+		{
+			add_node(hierarchy, spawned[i]);
+		}
+	}
+
+	update_parents(hierarchy);
+	if (hierarchy->order_dirty)
+	{
+		sort_nodes(hierarchy);
+	}
+	propagate_transforms(hierarchy);
+
+	hierarchy->last_version = ecs_get_version(hierarchy->ecs);
+}
+
+void hierarchy_reset(hierarchy_t* hierarchy)
+{
+	hierarchy->node_count = 0;
+	hierarchy->pending_child_count = 0;
+	memset(hierarchy->entity_nodes, 0xff, sizeof(int) * hierarchy->capacity);
+
+	ecs_mask_t mask = ECS_MASK(hierarchy->hierarchy_type);
+	for (ecs_query_t query = ecs_query_create(hierarchy->ecs, mask);
+		ecs_query_is_valid(hierarchy->ecs, &query);
+		ecs_query_next(hierarchy->ecs, &query))
+	{
+		ecs_entity_ref_t ref = ecs_query_get_entity(hierarchy->ecs, &query);
+		if (has_node_components(hierarchy, ref))
+		{
+			add_node(hierarchy, ref);
+		}
+	}
+
+	// Treat every link and transform as changed on the next update.
+	hierarchy->last_version = 0;
+}
+
+static bool has_node_components(hierarchy_t* hierarchy, ecs_entity_ref_t ref)
+{
+	return ecs_entity_get_component_const(hierarchy->ecs, ref, hierarchy->hierarchy_type, false) &&
+		ecs_entity_get_component_const(hierarchy->ecs, ref, hierarchy->transform_type, false) &&
+		ecs_entity_get_component_const(hierarchy->ecs, ref, hierarchy->world_transform_type, false);
+}
+
+static void add_node(hierarchy_t* hierarchy, ecs_entity_ref_t ref)
+{
+	int node = hierarchy->entity_nodes[ref.entity];
+	if (node >= 0 && hierarchy->refs[0][node].sequence == ref.sequence)
+	{
+		return;
+	}
+
+	// New nodes start as roots at the end, which keeps the order valid.
+	node = hierarchy->node_count++;
+	hierarchy->refs[0][node] = ref;
+	hierarchy->parents[0][node] = -1;
+	hierarchy->dirty[0][node] = true;
+	hierarchy->entity_nodes[ref.entity] = node;
+}
+
+static void remove_destroyed_nodes(hierarchy_t* hierarchy)
+{
+	int destroyed_count = 0;
+	const ecs_entity_ref_t* destroyed = ecs_get_destroyed_entities(hierarchy->ecs, &destroyed_count);
+
+	int removed = 0;
+	for (int i = 0; i < destroyed_count; ++i)
+	{
+		int node = hierarchy->entity_nodes[destroyed[i].entity];
+		if (node >= 0 && hierarchy->refs[0][node].sequence == destroyed[i].sequence)
+		{
+			hierarchy->refs[0][node].entity = -1;
+			hierarchy->entity_nodes[destroyed[i].entity] = -1;
+			++removed;
+		}
+	}
+	if (!removed)
+	{
+		return;
+	}
+
+	// Stable compaction keeps parents ahead of children.
+	ecs_entity_ref_t* refs = hierarchy->refs[0];
+	int* parents = hierarchy->parents[0];
+	mat4f_t* worlds = hierarchy->worlds[0];
+	bool* dirty = hierarchy->dirty[0];
+	int count = 0;
+	for (int i = 0; i < hierarchy->node_count; ++i)
+	{
+		if (refs[i].entity < 0)
+		{
+			hierarchy->remap[i] = -1;
+			continue;
+		}
+
+		int parent = parents[i] >= 0 ? hierarchy->remap[parents[i]] : -1;
+		hierarchy->remap[i] = count;
+		refs[count] = refs[i];
+		parents[count] = parent;
+		worlds[count] = worlds[i];
+		dirty[count] = dirty[i] || (parents[i] >= 0 && parent < 0);
+		hierarchy->entity_nodes[refs[count].entity] = count;
+		++count;
+	}
+	hierarchy->node_count = count;
+}
+
+static void update_parents(hierarchy_t* hierarchy)
+{
+	ecs_mask_t mask = ECS_MASK(hierarchy->hierarchy_type);
+
+	// Retry children left waiting on a pending parent, unless their link changed
+	// and the pass below visits them anyway. Entries that are still waiting are re-added in place.
+	int pending_count = hierarchy->pending_child_count;
+	hierarchy->pending_child_count = 0;
+	for (int p = 0; p < pending_count; ++p)
+	{
+		ecs_entity_ref_t ref = hierarchy->pending_children[p];
+		int node = find_node(hierarchy, ref);
+		if (node >= 0 && ecs_entity_get_version(hierarchy->ecs, ref, mask, false) < hierarchy->last_version)
+		{
+			link_parent(hierarchy, node);
+		}
+	}
+
+	for (ecs_query_t query = ecs_query_create_changed(hierarchy->ecs, mask, mask, hierarchy->last_version);
+		ecs_query_is_valid(hierarchy->ecs, &query);
+		ecs_query_next(hierarchy->ecs, &query))
+	{
+		int node = find_node(hierarchy, ecs_query_get_entity(hierarchy->ecs, &query));
+		if (node >= 0)
+		{
+			link_parent(hierarchy, node);
+		}
+	}
+}
+
+static void link_parent(hierarchy_t* hierarchy, int node)
+{
+	ecs_entity_ref_t ref = hierarchy->refs[0][node];
+	const hierarchy_component_t* hierarchy_comp = ecs_entity_get_component_const(hierarchy->ecs, ref, hierarchy->hierarchy_type, false);
+	int parent = -1;
+	if (ecs_is_entity_ref_valid(hierarchy->ecs, hierarchy_comp->parent, false))
+	{
+		parent = find_node(hierarchy, hierarchy_comp->parent);
+	}
+	else if (ecs_is_entity_ref_valid(hierarchy->ecs, hierarchy_comp->parent, true))
+	{
+		// The parent becomes a node once it is spawned; stay a root until then.
+		hierarchy->pending_children[hierarchy->pending_child_count++] = ref;
+	}
+	if (parent == node)
+	{
+		debug_print(k_print_warning, "Entity %d is its own parent.\n", ref.entity);
+		parent = -1;
+	}
+
+	if (parent != hierarchy->parents[0][node])
+	{
+		hierarchy->parents[0][node] = parent;
+		hierarchy->dirty[0][node] = true;
+		hierarchy->order_dirty |= parent > node;
+	}
+}
+
+static int find_node(hierarchy_t* hierarchy, ecs_entity_ref_t ref)
+{
+	int node = hierarchy->entity_nodes[ref.entity];
+	return node >= 0 && hierarchy->refs[0][node].sequence == ref.sequence ? node : -1;
+}
+
+static void sort_nodes(hierarchy_t* hierarchy)
+{
+	int count = hierarchy->node_count;
+	int* parents = hierarchy->parents[0];
+	int* depths = hierarchy->depths;
+
+	// Compute each node's depth by walking up to the nearest node of known depth.
+	for (int i = 0; i < count; ++i)
+	{
+		depths[i] = -1;
+	}
+	int max_depth = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		int stack_size = 0;
+		int node = i;
+		while (depths[node] == -1)
+		{
+			depths[node] = -2;
+			hierarchy->stack[stack_size++] = node;
+			if (parents[node] < 0)
+			{
+				break;
+			}
+			node = parents[node];
+		}
+		if (stack_size == 0)
+		{
+			continue;
+		}
+
+		int top = hierarchy->stack[stack_size - 1];
+		int depth = 0;
+		if (depths[node] >= 0)
+		{
+			depth = depths[node] + 1;
+		}
+		else if (parents[top] >= 0)
+		{
+			debug_print(k_print_warning, "Hierarchy cycle through entity %d; detaching it.\n", hierarchy->refs[0][top].entity);
+			parents[top] = -1;
+			hierarchy->dirty[0][top] = true;
+		}
+		for (int s = stack_size - 1; s >= 0; --s)
+		{
+			depths[hierarchy->stack[s]] = depth++;
+		}
+		max_depth = __max(max_depth, depth - 1);
+	}
+
+	// Counting sort by depth gives breadth-first order.
+	int* offsets = hierarchy->stack;
+	memset(offsets, 0, sizeof(int) * (max_depth + 1));
+	for (int i = 0; i < count; ++i)
+	{
+		offsets[depths[i]]++;
+	}
+	for (int d = 0, offset = 0; d <= max_depth; ++d)
+	{
+		int level_count = offsets[d];
+		offsets[d] = offset;
+		offset += level_count;
+	}
+	for (int i = 0; i < count; ++i)
+	{
+		hierarchy->remap[i] = offsets[depths[i]]++;
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		int n = hierarchy->remap[i];
+		hierarchy->refs[1][n] = hierarchy->refs[0][i];
+		hierarchy->parents[1][n] = parents[i] >= 0 ? hierarchy->remap[parents[i]] : -1;
+		hierarchy->worlds[1][n] = hierarchy->worlds[0][i];
+		hierarchy->dirty[1][n] = hierarchy->dirty[0][i];
+		hierarchy->entity_nodes[hierarchy->refs[0][i].entity] = n;
+	}
+
+	// Swap the back buffers in.
+	ecs_entity_ref_t* refs = hierarchy->refs[1];
+	hierarchy->refs[1] = hierarchy->refs[0];
+	hierarchy->refs[0] = refs;
+	int* new_parents = hierarchy->parents[1];
+	hierarchy->parents[1] = hierarchy->parents[0];
+	hierarchy->parents[0] = new_parents;
+	mat4f_t* worlds = hierarchy->worlds[1];
+	hierarchy->worlds[1] = hierarchy->worlds[0];
+	hierarchy->worlds[0] = worlds;
+	bool* dirty = hierarchy->dirty[1];
+	hierarchy->dirty[1] = hierarchy->dirty[0];
+	hierarchy->dirty[0] = dirty;
+
+	hierarchy->order_dirty = false;
+}
+
+static void propagate_transforms(hierarchy_t* hierarchy)
+{
+	const ecs_entity_ref_t* refs = hierarchy->refs[0];
+	const int* parents = hierarchy->parents[0];
+	mat4f_t* worlds = hierarchy->worlds[0];
+	bool* dirty = hierarchy->dirty[0];
+	ecs_mask_t transform_mask = ECS_MASK(hierarchy->transform_type);
+
+	// Mark nodes whose local transform changed.
+	for (ecs_query_t query = ecs_query_create_changed(hierarchy->ecs, ECS_MASK(hierarchy->transform_type, hierarchy->hierarchy_type), transform_mask, hierarchy->last_version);
+		ecs_query_is_valid(hierarchy->ecs, &query);
+		ecs_query_next(hierarchy->ecs, &query))
+	{
+		int node = find_node(hierarchy, ecs_query_get_entity(hierarchy->ecs, &query));
+		if (node >= 0)
+		{
+			dirty[node] = true;
+		}
+	}
+
+	// Gather local transforms of dirty nodes and their descendants, still in parent-first order.
+	int dirty_count = 0;
+	for (int i = 0; i < hierarchy->node_count; ++i)
+	{
+		int parent = parents[i];
+		if (!dirty[i] && !(parent >= 0 && dirty[parent]))
+		{
+			continue;
+		}
+		dirty[i] = true;
+
+		const transform_t* local = ecs_entity_get_component_const(hierarchy->ecs, refs[i], hierarchy->transform_type, false);
+		hierarchy->local_transforms[dirty_count] = *local;
+		hierarchy->dirty_nodes[dirty_count] = i;
+		dirty_count++;
+	}
+
+	transform_to_matrix_batch(hierarchy->local_transforms, sizeof(transform_t), dirty_count, hierarchy->local_matrices, sizeof(mat4f_t));
+
+	for (int n = 0; n < dirty_count; ++n)
+	{
+		int i = hierarchy->dirty_nodes[n];
+		int parent = parents[i];
+		if (parent >= 0)
+		{
+			mat4f_mul(&worlds[i], &hierarchy->local_matrices[n], &worlds[parent]);
+		}
+		else
+		{
+			worlds[i] = hierarchy->local_matrices[n];
+		}
+
+		world_transform_component_t* world_comp = ecs_entity_get_component(hierarchy->ecs, refs[i], hierarchy->world_transform_type, false);
+		world_comp->matrix = worlds[i];
+	}
+
+	memset(dirty, 0, sizeof(bool) * hierarchy->node_count);
+}
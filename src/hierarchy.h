@@ -0,0 +1,51 @@
+#pragma once
+
+// Scene Hierarchy
+// Parent/child relationships between entities and world transform propagation.
+// Nodes are kept in parent-first order so world matrices are computed in one linear pass.
+
+#include "ecs.h"
+#include "mat4f.h"
+
+typedef struct heap_t heap_t;
+
+// Handle to a hierarchy system.
+typedef struct hierarchy_t hierarchy_t;
+
+// Parent link of an entity.
+// An invalid parent reference makes the entity a root.
+typedef struct hierarchy_component_t
+{
+	ecs_entity_ref_t parent;
+} hierarchy_component_t;
+
+// World space matrix of an entity.
+// Written by hierarchy_update(); treat as read-only.
+typedef struct world_transform_component_t
+{
+	mat4f_t matrix;
+} world_transform_component_t;
+
+// Create a hierarchy system and register its component types with the entity system.
+// Transform type is the local transform component; it must begin with a transform_t.
+hierarchy_t* hierarchy_create(heap_t* heap, ecs_t* ecs, int transform_type);
+
+// Destroy a hierarchy system.
+void hierarchy_destroy(hierarchy_t* hierarchy);
+
+// Get the component type holding hierarchy_component_t.
+int hierarchy_get_component_type(hierarchy_t* hierarchy);
+
+// Get the component type holding world_transform_component_t.
+int hierarchy_get_world_transform_type(hierarchy_t* hierarchy);
+
+// Per-frame hierarchy update. Call once after each ecs_update().
+// Entities with transform, hierarchy and world transform components are tracked.
+// Picks up spawned and destroyed entities and parent changes,
+// then recomputes world matrices of entities whose transform or ancestors changed.
+// Children of destroyed entities become roots. A child whose parent is still pending
+// stays a root until the parent has been spawned, then is attached.
+void hierarchy_update(hierarchy_t* hierarchy);
+
+// Rebuild all nodes from the entity system, e.g. after ecs_load().
+void hierarchy_reset(hierarchy_t* hierarchy);
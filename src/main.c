@@ -1,13 +1,20 @@
+#include "collision_bench.h"
 #include "debug.h"
+#include "ecs_bench.h"
 #include "fs.h"
 #include "heap.h"
+#include "mat4f_bench.h"
 #include "render.h"
+#include "render_bench.h"
 #include "frogger_game.h"
 #include "timer.h"
 #include "wm.h"
 
 #include "cpp_test.h"
 
+#include <stdbool.h>
+#include <string.h>
+
 int main(int argc, const char* argv[])
 {
 	debug_set_print_mask(k_print_info | k_print_warning | k_print_error);
@@ -16,14 +23,45 @@ int main(int argc, const char* argv[])
 	timer_startup();
 
 	heap_t* heap = heap_create(2 * 1024 * 1024);
+
+	// Run benchmarks instead of the game: ga2022.exe bench
+	bool bench = argc > 1 && strcmp(argv[1], "bench") == 0;
+#if defined(GPU_NULL)
+	// The Bench configuration builds the null GPU backend, which cannot show the game.
+	bench = true;
+#endif
+	if (bench)
+	{
+		// Benchmarks cross-check their results; any mismatch fails the run.
+		bool valid = true;
+		valid &= mat4f_bench_run(heap);
+		ecs_bench_run(heap);
+		valid &= collision_bench_run(heap);
+		valid &= render_bench_run(heap);
+		heap_destroy(heap);
+		if (!valid)
+		{
+			debug_print(k_print_error, "Benchmark validation failed.\n");
+			return 1;
+		}
+		return 0;
+	}
+
 	fs_t* fs = fs_create(heap, 8);
 	wm_window_t* window = wm_create(heap);
 
 #if 1
-	render_t* render = render_create(heap, window);
+	// Let the game run up to two frames ahead of rendering, and record large frames on four workers.
+	render_t* render = render_create(heap, fs, window, 2, 4, NULL);
 
 	simple_game_t* game = frogger_game_create(heap, fs, window, render);
 
+	// Trace the system schedule: ga2022.exe trace
+	if (argc > 1 && strcmp(argv[1], "trace") == 0)
+	{
+		frogger_game_trace_schedule(game, "schedule_trace.json");
+	}
+
 	while (!wm_pump(window))
 	{
 		frogger_game_update(game);
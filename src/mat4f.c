@@ -1,12 +1,11 @@
 #include "mat4f.h"
 
 #include "quatf.h"
+#include "simd.h"
 #include "vec3f.h"
 
 #include <string.h>
 
-#include <xmmintrin.h>
-
 void mat4f_make_identity(mat4f_t* m)
 {
 	memset(m, 0, sizeof(*m));
@@ -80,62 +79,248 @@ void mat4f_rotate(mat4f_t* m, const quatf_t* q)
 
 void mat4f_mul(mat4f_t* result, const mat4f_t* a, const mat4f_t* b)
 {
+#if defined(SIMD_AVX)
+	// Two result rows per 256-bit register; each 128-bit lane holds one row.
+	__m256 b0 = _mm256_broadcast_ps((const __m128*)b->data[0]);
+	__m256 b1 = _mm256_broadcast_ps((const __m128*)b->data[1]);
+	__m256 b2 = _mm256_broadcast_ps((const __m128*)b->data[2]);
+	__m256 b3 = _mm256_broadcast_ps((const __m128*)b->data[3]);
+	__m256 a01 = _mm256_loadu_ps(a->data[0]);
+	__m256 a23 = _mm256_loadu_ps(a->data[2]);
+
+	__m256 r01 = _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x00), b0);
+	r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x55), b1));
+	r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0xaa), b2));
+	r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0xff), b3));
+
+	__m256 r23 = _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0x00), b0);
+	r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0x55), b1));
+	r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0xaa), b2));
+	r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0xff), b3));
+
+	_mm256_storeu_ps(result->data[0], r01);
+	_mm256_storeu_ps(result->data[2], r23);
+#else
+	// Row i of the result is row i of a weighting the rows of b.
+	simd4f_t b0 = simd4f_load(b->data[0]);
+	simd4f_t b1 = simd4f_load(b->data[1]);
+	simd4f_t b2 = simd4f_load(b->data[2]);
+	simd4f_t b3 = simd4f_load(b->data[3]);
+	simd4f_t rows[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		simd4f_t row = simd4f_load(a->data[i]);
+		simd4f_t r = simd4f_mul(simd4f_splat_lane(row, 0), b0);
+		r = simd4f_madd(simd4f_splat_lane(row, 1), b1, r);
+		r = simd4f_madd(simd4f_splat_lane(row, 2), b2, r);
+		r = simd4f_madd(simd4f_splat_lane(row, 3), b3, r);
+		rows[i] = r;
+	}
+	for (int i = 0; i < 4; ++i)
+	{
+		simd4f_store(result->data[i], rows[i]);
+	}
+#endif
+}
+
+void mat4f_mul_scalar(mat4f_t* result, const mat4f_t* a, const mat4f_t* b)
+{
+	mat4f_t tmp;
 	for (int i = 0; i < 4; ++i)
 	{
 		for (int j = 0; j < 4; ++j)
 		{
-			float tmp = 0.0f;
+			tmp.data[i][j] = 0.0f;
 			for (int k = 0; k < 4; ++k)
 			{
-				tmp += a->data[i][k] * b->data[k][j];
+				tmp.data[i][j] += a->data[i][k] * b->data[k][j];
 			}
-			result->data[i][j] = tmp;
 		}
 	}
+	*result = tmp;
 }
 
 void mat4f_mul_inplace(mat4f_t* result, const mat4f_t* m)
 {
-	mat4f_t tmp = *result;
-	mat4f_mul(result, &tmp, m);
+	mat4f_mul(result, result, m);
 }
 
 void mat4f_transform(const mat4f_t* m, const vec3f_t* in, vec3f_t* out)
 {
-#if 1
-	out->x = in->x * m->data[0][0] + in->y * m->data[1][0] + in->z * m->data[2][0] + m->data[3][0];
-	out->y = in->x * m->data[0][1] + in->y * m->data[1][1] + in->z * m->data[2][1] + m->data[3][1];
-	out->z = in->x * m->data[0][2] + in->y * m->data[1][2] + in->z * m->data[2][2] + m->data[3][2];
-#else
-	__m128 column0 = _mm_load_ps((float*)&m->data[0]);
-	__m128 x = _mm_load_ps1(&in->x);
-	__m128 x_result = _mm_mul_ps(x, column0);
+	simd4f_t r = simd4f_load(m->data[3]);
+	r = simd4f_madd(simd4f_splat(in->x), simd4f_load(m->data[0]), r);
+	r = simd4f_madd(simd4f_splat(in->y), simd4f_load(m->data[1]), r);
+	r = simd4f_madd(simd4f_splat(in->z), simd4f_load(m->data[2]), r);
+
+	// vec3f_t is 12 bytes; a full 16-byte store would overrun it.
+	float tmp[4];
+	simd4f_store(tmp, r);
+	out->x = tmp[0];
+	out->y = tmp[1];
+	out->z = tmp[2];
+}
 
-	__m128 column1 = _mm_load_ps((float*)&m->data[1]);
-	__m128 y = _mm_load_ps1(&in->y);
-	__m128 y_result = _mm_mul_ps(y, column1);
+void mat4f_transform_scalar(const mat4f_t* m, const vec3f_t* in, vec3f_t* out)
+{
+	vec3f_t tmp;
+	tmp.x = in->x * m->data[0][0] + in->y * m->data[1][0] + in->z * m->data[2][0] + m->data[3][0];
+	tmp.y = in->x * m->data[0][1] + in->y * m->data[1][1] + in->z * m->data[2][1] + m->data[3][1];
+	tmp.z = in->x * m->data[0][2] + in->y * m->data[1][2] + in->z * m->data[2][2] + m->data[3][2];
+	*out = tmp;
+}
 
-	__m128 column2 = _mm_load_ps((float*)&m->data[2]);
-	__m128 z = _mm_load_ps1(&in->z);
-	__m128 z_result = _mm_mul_ps(z, column2);
+void mat4f_transform_inplace(const mat4f_t* m, vec3f_t* v)
+{
+	mat4f_transform(m, v, v);
+}
 
-	__m128 x_plus_y = _mm_add_ps(x_result, y_result);
-	__m128 x_plus_y_plus_z = _mm_add_ps(x_plus_y, z_result);
-	__m128 column3 = _mm_load_ps((float*)&m->data[3]);
+void mat4f_transpose(mat4f_t* m)
+{
+	simd4f_t r0 = simd4f_load(m->data[0]);
+	simd4f_t r1 = simd4f_load(m->data[1]);
+	simd4f_t r2 = simd4f_load(m->data[2]);
+	simd4f_t r3 = simd4f_load(m->data[3]);
+	simd4f_transpose(&r0, &r1, &r2, &r3);
+	simd4f_store(m->data[0], r0);
+	simd4f_store(m->data[1], r1);
+	simd4f_store(m->data[2], r2);
+	simd4f_store(m->data[3], r3);
+}
 
-	__m128 result = _mm_add_ps(x_plus_y_plus_z, column3);
+void mat4f_transpose_scalar(mat4f_t* m)
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		for (int j = i + 1; j < 4; ++j)
+		{
+			float tmp = m->data[i][j];
+			m->data[i][j] = m->data[j][i];
+			m->data[j][i] = tmp;
+		}
+	}
+}
 
-	_mm_storeu_ps(&out->x, result);
-#endif
+// 2x2 matrix helpers for block-wise inversion.
+// A 2x2 matrix is packed in one vector as (m00, m01, m10, m11).
+
+// Compute a * b.
+static simd4f_t mat2_mul(simd4f_t a, simd4f_t b)
+{
+	return simd4f_madd(a, simd4f_shuffle(b, b, 0, 3, 0, 3),
+		simd4f_mul(simd4f_shuffle(a, a, 1, 0, 3, 2), simd4f_shuffle(b, b, 2, 1, 2, 1)));
 }
 
-void mat4f_transform_inplace(const mat4f_t* m, vec3f_t* v)
+// Compute adjugate(a) * b.
+static simd4f_t mat2_adj_mul(simd4f_t a, simd4f_t b)
 {
-	vec3f_t tmp = *v;
-	mat4f_transform(m, &tmp, v);
+	return simd4f_nmadd(simd4f_shuffle(a, a, 1, 1, 2, 2), simd4f_shuffle(b, b, 2, 3, 0, 1),
+		simd4f_mul(simd4f_shuffle(a, a, 3, 3, 0, 0), b));
+}
+
+// Compute a * adjugate(b).
+static simd4f_t mat2_mul_adj(simd4f_t a, simd4f_t b)
+{
+	return simd4f_nmadd(simd4f_shuffle(a, a, 1, 0, 3, 2), simd4f_shuffle(b, b, 2, 1, 2, 1),
+		simd4f_mul(a, simd4f_shuffle(b, b, 3, 0, 3, 0)));
 }
 
 bool mat4f_invert(mat4f_t* m)
+{
+	// Block-wise inverse of [A B; C D] built from 2x2 adjugates.
+	simd4f_t r0 = simd4f_load(m->data[0]);
+	simd4f_t r1 = simd4f_load(m->data[1]);
+	simd4f_t r2 = simd4f_load(m->data[2]);
+	simd4f_t r3 = simd4f_load(m->data[3]);
+
+	simd4f_t a = simd4f_shuffle(r0, r1, 0, 1, 0, 1);
+	simd4f_t b = simd4f_shuffle(r0, r1, 2, 3, 2, 3);
+	simd4f_t c = simd4f_shuffle(r2, r3, 0, 1, 0, 1);
+	simd4f_t d = simd4f_shuffle(r2, r3, 2, 3, 2, 3);
+
+	// Determinants of A, B, C and D.
+	simd4f_t det_sub = simd4f_sub(
+		simd4f_mul(simd4f_shuffle(r0, r2, 0, 2, 0, 2), simd4f_shuffle(r1, r3, 1, 3, 1, 3)),
+		simd4f_mul(simd4f_shuffle(r0, r2, 1, 3, 1, 3), simd4f_shuffle(r1, r3, 0, 2, 0, 2)));
+	simd4f_t det_a = simd4f_splat_lane(det_sub, 0);
+	simd4f_t det_b = simd4f_splat_lane(det_sub, 1);
+	simd4f_t det_c = simd4f_splat_lane(det_sub, 2);
+	simd4f_t det_d = simd4f_splat_lane(det_sub, 3);
+
+	simd4f_t d_c = mat2_adj_mul(d, c);
+	simd4f_t a_b = mat2_adj_mul(a, b);
+
+	simd4f_t x = simd4f_sub(simd4f_mul(det_d, a), mat2_mul(b, d_c));
+	simd4f_t w = simd4f_sub(simd4f_mul(det_a, d), mat2_mul(c, a_b));
+	simd4f_t y = simd4f_sub(simd4f_mul(det_b, c), mat2_mul_adj(d, a_b));
+	simd4f_t z = simd4f_sub(simd4f_mul(det_c, b), mat2_mul_adj(a, d_c));
+
+	// det(M) = det(A) det(D) + det(B) det(C) - trace(adj(A)B adj(D)C).
+	simd4f_t tr = simd4f_mul(a_b, simd4f_shuffle(d_c, d_c, 0, 2, 1, 3));
+	tr = simd4f_add(tr, simd4f_shuffle(tr, tr, 2, 3, 0, 1));
+	tr = simd4f_add(tr, simd4f_shuffle(tr, tr, 1, 0, 3, 2));
+	float det = simd4f_get_x(simd4f_sub(simd4f_madd(det_a, det_d, simd4f_mul(det_b, det_c)), tr));
+	if (det == 0.0f)
+	{
+		return false;
+	}
+
+	simd4f_t inv_det = simd4f_div(simd4f_set(1.0f, -1.0f, -1.0f, 1.0f), simd4f_splat(det));
+	x = simd4f_mul(x, inv_det);
+	y = simd4f_mul(y, inv_det);
+	z = simd4f_mul(z, inv_det);
+	w = simd4f_mul(w, inv_det);
+
+	simd4f_store(m->data[0], simd4f_shuffle(x, y, 3, 1, 3, 1));
+	simd4f_store(m->data[1], simd4f_shuffle(x, y, 2, 0, 2, 0));
+	simd4f_store(m->data[2], simd4f_shuffle(z, w, 3, 1, 3, 1));
+	simd4f_store(m->data[3], simd4f_shuffle(z, w, 2, 0, 2, 0));
+	return true;
+}
+
+bool mat4f_invert_affine(mat4f_t* m)
+{
+	simd4f_t r0 = simd4f_load(m->data[0]);
+	simd4f_t r1 = simd4f_load(m->data[1]);
+	simd4f_t r2 = simd4f_load(m->data[2]);
+	simd4f_t r3 = simd4f_load(m->data[3]);
+
+	// Rows of the upper 3x3 are scaled, orthogonal axes; its inverse is
+	// the transpose with each axis divided by its squared length.
+	simd4f_t t0 = r0;
+	simd4f_t t1 = r1;
+	simd4f_t t2 = r2;
+	simd4f_t t3 = simd4f_zero();
+	simd4f_transpose(&t0, &t1, &t2, &t3);
+
+	simd4f_t size_sq = simd4f_mul(t0, t0);
+	size_sq = simd4f_madd(t1, t1, size_sq);
+	size_sq = simd4f_madd(t2, t2, size_sq);
+
+	float sizes[4];
+	simd4f_store(sizes, size_sq);
+	if (sizes[0] == 0.0f || sizes[1] == 0.0f || sizes[2] == 0.0f)
+	{
+		return false;
+	}
+	simd4f_t inv_size_sq = simd4f_div(simd4f_splat(1.0f), simd4f_set(sizes[0], sizes[1], sizes[2], 1.0f));
+	t0 = simd4f_mul(t0, inv_size_sq);
+	t1 = simd4f_mul(t1, inv_size_sq);
+	t2 = simd4f_mul(t2, inv_size_sq);
+
+	// Inverse translation is -t * inverse(upper 3x3).
+	simd4f_t t = simd4f_mul(simd4f_splat_lane(r3, 0), t0);
+	t = simd4f_madd(simd4f_splat_lane(r3, 1), t1, t);
+	t = simd4f_madd(simd4f_splat_lane(r3, 2), t2, t);
+	t = simd4f_sub(simd4f_set(0.0f, 0.0f, 0.0f, 1.0f), t);
+
+	simd4f_store(m->data[0], t0);
+	simd4f_store(m->data[1], t1);
+	simd4f_store(m->data[2], t2);
+	simd4f_store(m->data[3], t);
+	return true;
+}
+
+bool mat4f_invert_scalar(mat4f_t* m)
 {
 	float s[6];
 	s[0] = m->data[0][0] * m->data[1][1] - m->data[1][0] * m->data[0][1];
@@ -36,6 +36,7 @@ void mat4f_scale(mat4f_t* m, const vec3f_t* s);
 void mat4f_rotate(mat4f_t* m, const quatf_t* q);
 
 // Concatenate matrices a and b to get matrix result.
+// Result may be the same matrix as a or b.
 void mat4f_mul(mat4f_t* result, const mat4f_t* a, const mat4f_t* b);
 
 // Concatenate matrices result and m and store in result.
@@ -47,10 +48,24 @@ void mat4f_transform(const mat4f_t* m, const vec3f_t* in, vec3f_t* out);
 // Multiples vector v by matrix m and stores the result back in v.
 void mat4f_transform_inplace(const mat4f_t* m, vec3f_t* v);
 
+// Transpose matrix m.
+void mat4f_transpose(mat4f_t* m);
+
 // Attempt to compute a matrix inverse.
 // Returns true on success, returns false if the determinant is zero.
 bool mat4f_invert(mat4f_t* m);
 
+// Attempt to compute the inverse of a matrix made of rotation, scale and translation only.
+// Faster than mat4f_invert(); results are wrong for matrices with shear or projection.
+// Returns true on success, returns false if an axis has zero scale.
+bool mat4f_invert_affine(mat4f_t* m);
+
+// Scalar reference versions of the SIMD kernels above, used to validate them.
+void mat4f_mul_scalar(mat4f_t* result, const mat4f_t* a, const mat4f_t* b);
+void mat4f_transform_scalar(const mat4f_t* m, const vec3f_t* in, vec3f_t* out);
+void mat4f_transpose_scalar(mat4f_t* m);
+bool mat4f_invert_scalar(mat4f_t* m);
+
 // Given a field of view angle in radians, width/height aspect ratio, and depth near+far distances, compute a perspective projection matrix.
 void mat4f_make_perspective(mat4f_t* m, float angle, float aspect, float z_near, float z_far);
 
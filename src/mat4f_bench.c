@@ -0,0 +1,471 @@
+#include "mat4f_bench.h"
+
+#include "bench_random.h"
+#include "debug.h"
+#include "heap.h"
+#include "mat4f.h"
+#include "math.h"
+#include "quatf.h"
+#include "simd.h"
+#include "timer.h"
+#include "transform.h"
+#include "vec3f.h"
+#include "vec3f_soa.h"
+#include "vec4f.h"
+
+#include <stdint.h>
+#include <string.h>
+
+enum
+{
+	k_bench_matrix_count = 4096,
+	k_bench_iterations = 256,
+	k_validate_count = 10000,
+};
+
+static void make_random_matrix(mat4f_t* m, uint32_t* state)
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		for (int j = 0; j < 4; ++j)
+		{
+			m->data[i][j] = bench_randomf(state, -4.0f, 4.0f);
+		}
+	}
+}
+
+static void make_random_transform(transform_t* transform, uint32_t* state)
+{
+	transform->translation = (vec3f_t) { .x = bench_randomf(state, -100.0f, 100.0f), .y = bench_randomf(state, -100.0f, 100.0f), .z = bench_randomf(state, -100.0f, 100.0f) };
+	transform->scale = (vec3f_t) { .x = bench_randomf(state, 0.1f, 10.0f), .y = bench_randomf(state, 0.1f, 10.0f), .z = bench_randomf(state, 0.1f, 10.0f) };
+	transform->rotation = quatf_from_eulers((vec3f_t) { .x = bench_randomf(state, -3.0f, 3.0f), .y = bench_randomf(state, -3.0f, 3.0f), .z = bench_randomf(state, -3.0f, 3.0f) });
+}
+
+// Rotation, positive scale and translation only; valid input for mat4f_invert_affine().
+static void make_random_affine(mat4f_t* m, uint32_t* state)
+{
+	transform_t transform;
+	make_random_transform(&transform, state);
+	transform_to_matrix(&transform, m);
+}
+
+static bool matrices_nearly_equal(const mat4f_t* a, const mat4f_t* b, float tolerance)
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		for (int j = 0; j < 4; ++j)
+		{
+			float diff = fabsf(a->data[i][j] - b->data[i][j]);
+			if (diff > tolerance * __max(1.0f, fabsf(b->data[i][j])))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static bool validate(const char* name, bool ok, int* failures)
+{
+	if (!ok)
+	{
+		if (*failures < 8)
+		{
+			debug_print(k_print_error, "%s does not match the scalar reference.\n", name);
+		}
+		++*failures;
+	}
+	return ok;
+}
+
+static vec3f_t make_random_vec3f(uint32_t* state, float range)
+{
+	return (vec3f_t) { .x = bench_randomf(state, -range, range), .y = bench_randomf(state, -range, range), .z = bench_randomf(state, -range, range) };
+}
+
+static bool vec3f_nearly_equal(vec3f_t a, vec3f_t b, float tolerance)
+{
+	return fabsf(a.x - b.x) <= tolerance * __max(1.0f, fabsf(b.x)) &&
+		fabsf(a.y - b.y) <= tolerance * __max(1.0f, fabsf(b.y)) &&
+		fabsf(a.z - b.z) <= tolerance * __max(1.0f, fabsf(b.z));
+}
+
+static bool quatf_nearly_equal(quatf_t a, quatf_t b, float tolerance)
+{
+	return vec3f_nearly_equal(a.v3, b.v3, tolerance) && fabsf(a.w - b.w) <= tolerance * __max(1.0f, fabsf(b.w));
+}
+
+static void validate_vectors(uint32_t* rng, int* failures)
+{
+	vec3f_t a[8], b[8], out[8];
+	quatf_t q[8], r[8], q_out[8];
+	for (int i = 0; i < 8; ++i)
+	{
+		a[i] = make_random_vec3f(rng, 10.0f);
+		b[i] = make_random_vec3f(rng, 10.0f);
+		q[i] = quatf_from_eulers(make_random_vec3f(rng, 3.0f));
+		r[i] = quatf_from_eulers(make_random_vec3f(rng, 3.0f));
+	}
+
+	vec4f_t a4 = vec4f_from_vec3f(a[0], 0.0f);
+	vec4f_t b4 = vec4f_from_vec3f(b[0], 0.0f);
+	vec4f_t q4 = vec4f_from_quatf(q[0]);
+	validate("vec4f_dot3", almost_equalf(vec4f_dot3(a4, b4) / 100.0f, vec3f_dot(a[0], b[0]) / 100.0f), failures);
+	validate("vec4f_cross3", vec3f_nearly_equal(vec4f_to_vec3f(vec4f_cross3(a4, b4)), vec3f_cross(a[0], b[0]), 1e-5f), failures);
+	validate("vec4f_norm3", vec3f_nearly_equal(vec4f_to_vec3f(vec4f_norm3(a4)), vec3f_norm(a[0]), 1e-5f), failures);
+	validate("vec4f_quat_rotate", vec3f_nearly_equal(vec4f_to_vec3f(vec4f_quat_rotate(q4, a4)), quatf_rotate_vec(q[0], a[0]), 1e-5f), failures);
+	validate("vec4f_quat_mul", quatf_nearly_equal(vec4f_to_quatf(vec4f_quat_mul(q4, vec4f_from_quatf(r[0]))), quatf_mul(q[0], r[0]), 1e-5f), failures);
+
+	vec3f_x4_t a_x4 = vec3f_x4_gather(a, sizeof(vec3f_t));
+	vec3f_x4_t b_x4 = vec3f_x4_gather(b, sizeof(vec3f_t));
+	quatf_x4_t q_x4 = quatf_x4_gather(q, sizeof(quatf_t));
+	float dots[8];
+	simd4f_store(dots, vec3f_x4_dot(a_x4, b_x4));
+	vec3f_x4_scatter(out, sizeof(vec3f_t), vec3f_x4_cross(a_x4, b_x4));
+	for (int i = 0; i < 4; ++i)
+	{
+		validate("vec3f_x4_dot", almost_equalf(dots[i] / 100.0f, vec3f_dot(a[i], b[i]) / 100.0f), failures);
+		validate("vec3f_x4_cross", vec3f_nearly_equal(out[i], vec3f_cross(a[i], b[i]), 1e-5f), failures);
+	}
+	vec3f_x4_scatter(out, sizeof(vec3f_t), vec3f_x4_norm(a_x4));
+	for (int i = 0; i < 4; ++i)
+	{
+		validate("vec3f_x4_norm", vec3f_nearly_equal(out[i], vec3f_norm(a[i]), 1e-5f), failures);
+	}
+	vec3f_x4_scatter(out, sizeof(vec3f_t), vec3f_x4_quat_rotate(q_x4, a_x4));
+	quatf_x4_scatter(q_out, sizeof(quatf_t), quatf_x4_mul(q_x4, quatf_x4_gather(r, sizeof(quatf_t))));
+	for (int i = 0; i < 4; ++i)
+	{
+		validate("vec3f_x4_quat_rotate", vec3f_nearly_equal(out[i], quatf_rotate_vec(q[i], a[i]), 1e-5f), failures);
+		validate("quatf_x4_mul", quatf_nearly_equal(q_out[i], quatf_mul(q[i], r[i]), 1e-5f), failures);
+	}
+
+	vec3f_x8_t a_x8 = vec3f_x8_gather(a, sizeof(vec3f_t));
+	vec3f_x8_t b_x8 = vec3f_x8_gather(b, sizeof(vec3f_t));
+	quatf_x8_t q_x8 = quatf_x8_gather(q, sizeof(quatf_t));
+	simd8f_store(dots, vec3f_x8_dot(a_x8, b_x8));
+	vec3f_x8_scatter(out, sizeof(vec3f_t), vec3f_x8_cross(a_x8, b_x8));
+	for (int i = 0; i < 8; ++i)
+	{
+		validate("vec3f_x8_dot", almost_equalf(dots[i] / 100.0f, vec3f_dot(a[i], b[i]) / 100.0f), failures);
+		validate("vec3f_x8_cross", vec3f_nearly_equal(out[i], vec3f_cross(a[i], b[i]), 1e-5f), failures);
+	}
+	vec3f_x8_scatter(out, sizeof(vec3f_t), vec3f_x8_norm(a_x8));
+	for (int i = 0; i < 8; ++i)
+	{
+		validate("vec3f_x8_norm", vec3f_nearly_equal(out[i], vec3f_norm(a[i]), 1e-5f), failures);
+	}
+	vec3f_x8_scatter(out, sizeof(vec3f_t), vec3f_x8_quat_rotate(q_x8, a_x8));
+	quatf_x8_scatter(q_out, sizeof(quatf_t), quatf_x8_mul(q_x8, quatf_x8_gather(r, sizeof(quatf_t))));
+	for (int i = 0; i < 8; ++i)
+	{
+		validate("vec3f_x8_quat_rotate", vec3f_nearly_equal(out[i], quatf_rotate_vec(q[i], a[i]), 1e-5f), failures);
+		validate("quatf_x8_mul", quatf_nearly_equal(q_out[i], quatf_mul(q[i], r[i]), 1e-5f), failures);
+	}
+
+	transform_t transforms[4], round_trip[4];
+	transform_x4_t transform_x4;
+	for (int i = 0; i < 4; ++i)
+	{
+		make_random_transform(&transforms[i], rng);
+	}
+	transform_x4_gather(&transform_x4, transforms, sizeof(transform_t));
+	transform_x4_scatter(round_trip, sizeof(transform_t), &transform_x4);
+	validate("transform_x4_scatter", memcmp(transforms, round_trip, sizeof(transforms)) == 0, failures);
+	vec3f_x4_scatter(out, sizeof(vec3f_t), transform_x4_transform_vec3(&transform_x4, a_x4));
+	for (int i = 0; i < 4; ++i)
+	{
+		validate("transform_x4_transform_vec3", vec3f_nearly_equal(out[i], transform_transform_vec3(&transforms[i], a[i]), 1e-4f), failures);
+	}
+}
+
+static bool validate_kernels()
+{
+	uint32_t rng = 0x2545f491;
+	int failures = 0;
+	for (int n = 0; n < k_validate_count; ++n)
+	{
+		mat4f_t a, b, simd, scalar;
+		make_random_matrix(&a, &rng);
+		make_random_matrix(&b, &rng);
+
+		mat4f_mul(&simd, &a, &b);
+		mat4f_mul_scalar(&scalar, &a, &b);
+		validate("mat4f_mul", matrices_nearly_equal(&simd, &scalar, 1e-5f), &failures);
+
+		simd = a;
+		mat4f_mul(&simd, &simd, &b);
+		validate("mat4f_mul aliased", matrices_nearly_equal(&simd, &scalar, 1e-5f), &failures);
+
+		vec3f_t v = { .x = bench_randomf(&rng, -10.0f, 10.0f), .y = bench_randomf(&rng, -10.0f, 10.0f), .z = bench_randomf(&rng, -10.0f, 10.0f) };
+		vec3f_t v_simd, v_scalar;
+		mat4f_transform(&a, &v, &v_simd);
+		mat4f_transform_scalar(&a, &v, &v_scalar);
+		validate("mat4f_transform", almost_equalf(v_simd.x, v_scalar.x) && almost_equalf(v_simd.y, v_scalar.y) && almost_equalf(v_simd.z, v_scalar.z), &failures);
+
+		simd = a;
+		scalar = a;
+		mat4f_transpose(&simd);
+		mat4f_transpose_scalar(&scalar);
+		validate("mat4f_transpose", matrices_nearly_equal(&simd, &scalar, 0.0f), &failures);
+
+		// Skip badly conditioned matrices; both inverses lose too much precision to compare.
+		simd = a;
+		scalar = a;
+		bool simd_ok = mat4f_invert(&simd);
+		bool scalar_ok = mat4f_invert_scalar(&scalar);
+		if (simd_ok && scalar_ok)
+		{
+			mat4f_t identity, check;
+			mat4f_make_identity(&identity);
+			mat4f_mul_scalar(&check, &a, &scalar);
+			if (matrices_nearly_equal(&check, &identity, 1e-4f))
+			{
+				validate("mat4f_invert", matrices_nearly_equal(&simd, &scalar, 1e-3f), &failures);
+			}
+		}
+		else
+		{
+			validate("mat4f_invert", simd_ok == scalar_ok, &failures);
+		}
+
+		transform_t transforms[7];
+		mat4f_t batch[7];
+		for (int i = 0; i < _countof(transforms); ++i)
+		{
+			make_random_transform(&transforms[i], &rng);
+		}
+		transform_to_matrix_batch(transforms, sizeof(transform_t), _countof(transforms), batch, sizeof(mat4f_t));
+		for (int i = 0; i < _countof(transforms); ++i)
+		{
+			transform_to_matrix(&transforms[i], &scalar);
+			validate("transform_to_matrix_batch", matrices_nearly_equal(&batch[i], &scalar, 1e-5f), &failures);
+		}
+
+		make_random_affine(&a, &rng);
+		simd = a;
+		scalar = a;
+		validate("mat4f_invert_affine", mat4f_invert_affine(&simd) && mat4f_invert_scalar(&scalar), &failures);
+		validate("mat4f_invert_affine", matrices_nearly_equal(&simd, &scalar, 1e-3f), &failures);
+
+		validate_vectors(&rng, &failures);
+	}
+
+	if (failures)
+	{
+		debug_print(k_print_error, "Math validation: %d failures in %d runs.\n", failures, k_validate_count);
+	}
+	else
+	{
+		debug_print(k_print_info, "Math validation: %s kernels match the scalar reference.\n", simd_get_instruction_set());
+	}
+	return failures == 0;
+}
+
+static void bench_report(const char* name, uint64_t ticks)
+{
+	double ns = (double)ticks * 1000000000.0 / (double)timer_get_ticks_per_second() / (double)(k_bench_matrix_count * k_bench_iterations);
+	debug_print(k_print_info, "%-28s %10.2f ns/op\n", name, ns);
+}
+
+typedef void (*bench_mul_func_t)(mat4f_t* result, const mat4f_t* a, const mat4f_t* b);
+typedef void (*bench_transform_func_t)(const mat4f_t* m, const vec3f_t* in, vec3f_t* out);
+typedef void (*bench_unary_func_t)(mat4f_t* m);
+typedef bool (*bench_invert_func_t)(mat4f_t* m);
+
+// Bench functions return a sample of their results for the caller to keep.
+static float bench_mul(const char* name, bench_mul_func_t func, const mat4f_t* a, const mat4f_t* b, mat4f_t* out)
+{
+	uint64_t t0 = timer_get_ticks();
+	for (int it = 0; it < k_bench_iterations; ++it)
+	{
+		for (int i = 0; i < k_bench_matrix_count; ++i)
+		{
+			func(&out[i], &a[i], &b[i]);
+		}
+	}
+	bench_report(name, timer_get_ticks() - t0);
+	return out[k_bench_matrix_count / 2].data[1][2];
+}
+
+static float bench_transform(const char* name, bench_transform_func_t func, const mat4f_t* a, vec3f_t* v)
+{
+	uint64_t t0 = timer_get_ticks();
+	for (int it = 0; it < k_bench_iterations; ++it)
+	{
+		for (int i = 0; i < k_bench_matrix_count; ++i)
+		{
+			func(&a[i], &v[i], &v[i]);
+		}
+	}
+	bench_report(name, timer_get_ticks() - t0);
+	return v[k_bench_matrix_count / 2].y;
+}
+
+static float bench_unary(const char* name, bench_unary_func_t func, mat4f_t* m)
+{
+	uint64_t t0 = timer_get_ticks();
+	for (int it = 0; it < k_bench_iterations; ++it)
+	{
+		for (int i = 0; i < k_bench_matrix_count; ++i)
+		{
+			func(&m[i]);
+		}
+	}
+	bench_report(name, timer_get_ticks() - t0);
+	return m[k_bench_matrix_count / 2].data[1][2];
+}
+
+static float bench_transform_to_matrix(const transform_t* transforms, mat4f_t* out)
+{
+	uint64_t t0 = timer_get_ticks();
+	for (int it = 0; it < k_bench_iterations; ++it)
+	{
+		for (int i = 0; i < k_bench_matrix_count; ++i)
+		{
+			transform_to_matrix(&transforms[i], &out[i]);
+		}
+	}
+	bench_report("transform_to_matrix", timer_get_ticks() - t0);
+
+	t0 = timer_get_ticks();
+	for (int it = 0; it < k_bench_iterations; ++it)
+	{
+		transform_to_matrix_batch(transforms, sizeof(transform_t), k_bench_matrix_count, out, sizeof(mat4f_t));
+	}
+	bench_report("transform_to_matrix_batch", timer_get_ticks() - t0);
+	return out[k_bench_matrix_count / 2].data[1][2];
+}
+
+static float bench_quat_rotate(const quatf_t* q, vec3f_t* v, float* soa)
+{
+	uint64_t t0 = timer_get_ticks();
+	for (int it = 0; it < k_bench_iterations; ++it)
+	{
+		for (int i = 0; i < k_bench_matrix_count; ++i)
+		{
+			v[i] = quatf_rotate_vec(q[i], v[i]);
+		}
+	}
+	bench_report("quat_rotate (scalar)", timer_get_ticks() - t0);
+
+	t0 = timer_get_ticks();
+	for (int it = 0; it < k_bench_iterations; ++it)
+	{
+		for (int i = 0; i < k_bench_matrix_count; ++i)
+		{
+			v[i] = vec4f_to_vec3f(vec4f_quat_rotate(vec4f_from_quatf(q[i]), vec4f_from_vec3f(v[i], 0.0f)));
+		}
+	}
+	bench_report("quat_rotate (vec4f)", timer_get_ticks() - t0);
+
+	t0 = timer_get_ticks();
+	for (int it = 0; it < k_bench_iterations; ++it)
+	{
+		for (int i = 0; i < k_bench_matrix_count; i += 4)
+		{
+			vec3f_x4_t r = vec3f_x4_quat_rotate(quatf_x4_gather(&q[i], sizeof(quatf_t)), vec3f_x4_gather(&v[i], sizeof(vec3f_t)));
+			vec3f_x4_scatter(&v[i], sizeof(vec3f_t), r);
+		}
+	}
+	bench_report("quat_rotate (x4)", timer_get_ticks() - t0);
+
+	t0 = timer_get_ticks();
+	for (int it = 0; it < k_bench_iterations; ++it)
+	{
+		for (int i = 0; i < k_bench_matrix_count; i += 8)
+		{
+			vec3f_x8_t r = vec3f_x8_quat_rotate(quatf_x8_gather(&q[i], sizeof(quatf_t)), vec3f_x8_gather(&v[i], sizeof(vec3f_t)));
+			vec3f_x8_scatter(&v[i], sizeof(vec3f_t), r);
+		}
+	}
+	bench_report("quat_rotate (x8)", timer_get_ticks() - t0);
+
+	// Already in SoA layout: no gather or scatter.
+	float* x = soa;
+	float* y = x + k_bench_matrix_count;
+	float* z = y + k_bench_matrix_count;
+	float* qx = z + k_bench_matrix_count;
+	float* qy = qx + k_bench_matrix_count;
+	float* qz = qy + k_bench_matrix_count;
+	float* qw = qz + k_bench_matrix_count;
+	for (int i = 0; i < k_bench_matrix_count; ++i)
+	{
+		x[i] = v[i].x; y[i] = v[i].y; z[i] = v[i].z;
+		qx[i] = q[i].x; qy[i] = q[i].y; qz[i] = q[i].z; qw[i] = q[i].w;
+	}
+	t0 = timer_get_ticks();
+	for (int it = 0; it < k_bench_iterations; ++it)
+	{
+		for (int i = 0; i < k_bench_matrix_count; i += 8)
+		{
+			quatf_x8_t r = { simd8f_load(&qx[i]), simd8f_load(&qy[i]), simd8f_load(&qz[i]), simd8f_load(&qw[i]) };
+			vec3f_x8_store(&x[i], &y[i], &z[i], vec3f_x8_quat_rotate(r, vec3f_x8_load(&x[i], &y[i], &z[i])));
+		}
+	}
+	bench_report("quat_rotate (x8 soa)", timer_get_ticks() - t0);
+	return x[k_bench_matrix_count / 2] + v[k_bench_matrix_count / 2].y;
+}
+
+static float bench_invert(const char* name, bench_invert_func_t func, mat4f_t* m)
+{
+	// Inverting in place repeatedly toggles between the matrix and its inverse.
+	int failed = 0;
+	uint64_t t0 = timer_get_ticks();
+	for (int it = 0; it < k_bench_iterations; ++it)
+	{
+		for (int i = 0; i < k_bench_matrix_count; ++i)
+		{
+			failed += !func(&m[i]);
+		}
+	}
+	bench_report(name, timer_get_ticks() - t0);
+	return m[k_bench_matrix_count / 2].data[1][2] + (float)failed;
+}
+
+bool mat4f_bench_run(heap_t* heap)
+{
+	bool valid = validate_kernels();
+
+	mat4f_t* a = heap_alloc(heap, sizeof(mat4f_t) * k_bench_matrix_count, 16);
+	mat4f_t* b = heap_alloc(heap, sizeof(mat4f_t) * k_bench_matrix_count, 16);
+	mat4f_t* out = heap_alloc(heap, sizeof(mat4f_t) * k_bench_matrix_count, 16);
+	vec3f_t* v = heap_alloc(heap, sizeof(vec3f_t) * k_bench_matrix_count, 16);
+	transform_t* transforms = heap_alloc(heap, sizeof(transform_t) * k_bench_matrix_count, 16);
+	quatf_t* q = heap_alloc(heap, sizeof(quatf_t) * k_bench_matrix_count, 16);
+	float* soa = heap_alloc(heap, sizeof(float) * 7 * k_bench_matrix_count, 32);
+
+	uint32_t rng = 0x9e3779b9;
+	for (int i = 0; i < k_bench_matrix_count; ++i)
+	{
+		make_random_affine(&a[i], &rng);
+		make_random_affine(&b[i], &rng);
+		make_random_transform(&transforms[i], &rng);
+		q[i] = transforms[i].rotation;
+		v[i] = make_random_vec3f(&rng, 1.0f);
+	}
+
+	// Results land here so the compiler cannot drop the measured loops.
+	volatile float sink = 0.0f;
+	debug_print(k_print_info, "--- mat4f (%s) ---\n", simd_get_instruction_set());
+	sink += bench_mul("mul (scalar)", mat4f_mul_scalar, a, b, out);
+	sink += bench_mul("mul", mat4f_mul, a, b, out);
+	sink += bench_transform("transform (scalar)", mat4f_transform_scalar, a, v);
+	sink += bench_transform("transform", mat4f_transform, a, v);
+	sink += bench_unary("transpose (scalar)", mat4f_transpose_scalar, out);
+	sink += bench_unary("transpose", mat4f_transpose, out);
+	sink += bench_transform_to_matrix(transforms, out);
+	sink += bench_invert("invert (scalar)", mat4f_invert_scalar, a);
+	sink += bench_invert("invert", mat4f_invert, a);
+	sink += bench_invert("invert_affine", mat4f_invert_affine, b);
+	sink += bench_quat_rotate(q, v, soa);
+
+	heap_free(heap, soa);
+	heap_free(heap, q);
+	heap_free(heap, transforms);
+	heap_free(heap, v);
+	heap_free(heap, out);
+	heap_free(heap, b);
+	heap_free(heap, a);
+	return valid;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// Math Benchmarks
+// Validates the SIMD matrix and vector kernels against their scalar reference versions
+// and measures both.
+
+#include <stdbool.h>
+
+typedef struct heap_t heap_t;
+
+// Run validation and benchmarks and print results.
+// Returns false if any SIMD kernel disagrees with its scalar reference.
+bool mat4f_bench_run(heap_t* heap);
@@ -26,8 +26,8 @@ enum
 
 typedef struct entity_type_t
 {
-	uint64_t component_mask;
-	uint64_t replicated_component_mask;
+	int prefab;
+	ecs_mask_t replicated_component_mask;
 	net_configure_entity_callback_t configure_callback;
 	void* configure_callback_data;
 	size_t replicated_size;
@@ -45,6 +45,9 @@ typedef struct snapshot_t
 {
 	int sequence;
 	int size;
+	uint32_t ecs_version;
+	int entity_count;
+	uint32_t entity_versions[k_max_entities];
 	char data[k_net_mtu];
 } snapshot_t;
 
@@ -190,18 +193,18 @@ void net_disconnect_all(net_t* net)
 	mutex_unlock(net->connections_mutex);
 }
 
-void net_state_register_entity_type(net_t* net, int type, uint64_t component_mask, uint64_t replicated_component_mask, net_configure_entity_callback_t configure_callback, void* configure_callback_data)
+void net_state_register_entity_type(net_t* net, int type, int prefab, ecs_mask_t replicated_component_mask, net_configure_entity_callback_t configure_callback, void* configure_callback_data)
 {
 	if (type < _countof(net->entity_types))
 	{
-		net->entity_types[type].component_mask = component_mask;
+		net->entity_types[type].prefab = prefab;
 		net->entity_types[type].replicated_component_mask = replicated_component_mask;
 		net->entity_types[type].configure_callback = configure_callback;
 		net->entity_types[type].configure_callback_data = configure_callback_data;
 		net->entity_types[type].replicated_size = 0;
-		for (int i = 0; i < sizeof(replicated_component_mask) * 8; ++i)
+		for (int i = 0; i < k_ecs_mask_bits; ++i)
 		{
-			if (replicated_component_mask & (1ULL << i))
+			if (ecs_mask_test(&replicated_component_mask, i))
 			{
 				net->entity_types[type].replicated_size += ecs_get_component_type_size(net->ecs, i);
 			}
@@ -416,6 +419,8 @@ static void snapshot_entities(net_t* net)
 {
 	snapshot_t* snapshot = &net->snapshots[net->sequence % _countof(net->snapshots)];
 	snapshot->sequence = net->sequence;
+	snapshot->ecs_version = ecs_get_version(net->ecs);
+	snapshot->entity_count = 0;
 
 	char* cur = snapshot->data;
 	const char* end = &snapshot->data[_countof(snapshot->data)];
@@ -432,17 +437,19 @@ static void snapshot_entities(net_t* net)
 			memcpy(cur, &header, sizeof(header));
 			cur += sizeof(header);
 
-			uint64_t mask = net->entity_types[type].replicated_component_mask;
-			for (int c = 0; c < sizeof(mask) * 8; ++c)
+			ecs_mask_t mask = net->entity_types[type].replicated_component_mask;
+			for (int c = 0; c < k_ecs_mask_bits; ++c)
 			{
-				if (mask & (1ULL << c))
+				if (ecs_mask_test(&mask, c))
 				{
-					void* component_data = ecs_entity_get_component(net->ecs, net->entities[i].ref, c, true);
+					const void* component_data = ecs_entity_get_component_const(net->ecs, net->entities[i].ref, c, true);
 					size_t component_size = ecs_get_component_type_size(net->ecs, c);
 					memcpy(cur, component_data, component_size);
 					cur += component_size;
 				}
 			}
+
+			snapshot->entity_versions[snapshot->entity_count++] = ecs_entity_get_version(net->ecs, net->entities[i].ref, mask, true);
 		}
 	}
 	snapshot->size = (int)(cur - snapshot->data);
@@ -465,6 +472,7 @@ static size_t packet_add_entities(connection_t* connection, char* packet, size_t
 	}
 
 	char* packet_iter = packet;
+	int entity_index = 0;
 
 	while (cur_iter < cur_end)
 	{
@@ -484,10 +492,19 @@ static size_t packet_add_entities(connection_t* connection, char* packet, size_t
 			memcpy(&ack_header, ack_iter, sizeof(ack_header));
 			if (ack_header.sequence == cur_header.sequence)
 			{
-				diff = memcmp(cur_iter, &ack_iter[sizeof(ack_header)], ent_size) != 0;
+				// Components not written since the acked snapshot was taken can't differ from it.
+				if (cur_snapshot->entity_versions[entity_index] < ack_snapshot->ecs_version)
+				{
+					diff = false;
+				}
+				else
+				{
+					diff = memcmp(cur_iter, &ack_iter[sizeof(ack_header)], ent_size) != 0;
+				}
 				ack_iter += sizeof(ack_header) + ent_size;
 			}
 		}
+		++entity_index;
 
 		*packet_iter++ = diff;
 
@@ -547,9 +564,15 @@ static void packet_read_entities(connection_t* connection, char* packet, size_t
 
 		if (!ecs_is_entity_ref_valid(net->ecs, ref, true))
 		{
-			ref = ecs_entity_add(net->ecs, net->entity_types[header.type].component_mask);
-			void* configure_callback_data = net->entity_types[header.type].configure_callback_data;
-			net->entity_types[header.type].configure_callback(net->ecs, ref, header.type, configure_callback_data);
+			if (ecs_spawn_batch(net->ecs, net->entity_types[header.type].prefab, 1, &ref) == 0)
+			{
+				break;
+			}
+			if (net->entity_types[header.type].configure_callback)
+			{
+				void* configure_callback_data = net->entity_types[header.type].configure_callback_data;
+				net->entity_types[header.type].configure_callback(net->ecs, ref, header.type, configure_callback_data);
+			}
 
 			for (int i = 0; i < _countof(connection->entities); ++i)
 			{
@@ -567,10 +590,10 @@ static void packet_read_entities(connection_t* connection, char* packet, size_t
 		bool diff = *iter++ != 0;
 		if (diff)
 		{
-			uint64_t mask = net->entity_types[header.type].replicated_component_mask;
-			for (int i = 0; i < sizeof(mask) * 8; ++i)
+			const ecs_mask_t* mask = &net->entity_types[header.type].replicated_component_mask;
+			for (int i = 0; i < k_ecs_mask_bits; ++i)
 			{
-				if (mask & (1ULL << i))
+				if (ecs_mask_test(mask, i))
 				{
 					void* component_data = ecs_entity_get_component(net->ecs, ref, i, true);
 					size_t component_size = ecs_get_component_type_size(net->ecs, i);
@@ -25,7 +25,7 @@ void net_update(net_t* net);
 void net_connect(net_t* net, const net_address_t* address);
 void net_disconnect_all(net_t* net);
 
-void net_state_register_entity_type(net_t* net, int type, uint64_t component_mask, uint64_t replicated_component_mask, net_configure_entity_callback_t configure_callback, void* configure_callback_data);
+void net_state_register_entity_type(net_t* net, int type, int prefab, ecs_mask_t replicated_component_mask, net_configure_entity_callback_t configure_callback, void* configure_callback_data);
 void net_state_register_entity_instance(net_t* net, int type, ecs_entity_ref_t entity);
 
 bool net_string_to_address(const char* str, net_address_t* address);
@@ -1,10 +1,15 @@
 #include "render.h"
 
+#include "debug.h"
 #include "ecs.h"
 #include "gpu.h"
+#include "hash_map.h"
 #include "heap.h"
 #include "queue.h"
+#include "scheduler.h"
+#include "sort.h"
 #include "thread.h"
+#include "timer.h"
 #include "wm.h"
 
 #include <assert.h>
@@ -13,35 +18,77 @@
 enum
 {
 	k_render_max_drawables = 512,
+	k_render_max_draws = 2048,
+	k_render_max_groups = 256,
+	k_render_max_instance_size = 128,
+	// Views instanced models may be seen from in one frame.
+	k_render_max_views = 16,
+	// Bytes of uniform and instance data the game may push in one frame.
+	k_render_packet_data_size = 1024 * 1024,
+	// Most worker threads recording a frame's draws, one secondary command buffer each.
+	k_render_max_record_workers = k_gpu_max_secondary_cmd_buffers,
+	// Fewest draws worth a secondary command buffer of their own.
+	k_render_min_draws_per_range = 256,
+	// Frames between reports of recording time.
+	k_render_record_report_frames = 1000,
 };
 
-typedef enum command_type_t
+// Draw sort key: shader index in bits 48-63, mesh index in bits 32-47, uniform index in bits 0-31.
+// Sorting by key groups draws by pipeline, then by mesh, so each is bound as few times as possible.
+// Instanced groups set the group bit, and hold a group index in place of the uniform index.
+enum
 {
-	k_command_frame_done,
-	k_command_model,
-} command_type_t;
+	k_draw_key_shader_shift = 48,
+	k_draw_key_mesh_shift = 32,
+	k_draw_key_mesh_mask = 0xffff,
+	k_draw_key_index_mask = 0x7fffffff,
+	k_draw_key_group_bit = 0x80000000,
+};
 
-typedef struct model_command_t
+// A model pushed by the game thread, its data copied into the packet's data.
+typedef struct packet_draw_t
 {
-	command_type_t type;
-	ecs_entity_ref_t entity;
 	gpu_mesh_info_t* mesh;
 	gpu_shader_info_t* shader;
-	gpu_uniform_buffer_info_t uniform_buffer;
-} model_command_t;
-
-typedef struct frame_done_command_t
+	// Index of the packet view of an instanced model, or -1 for a plain model.
+	int view;
+	// Uniform data of a plain model, or instance data of an instanced model.
+	uint32_t data_offset;
+	uint32_t data_size;
+} packet_draw_t;
+
+// A view instanced models were pushed for, with the uniform data they share.
+typedef struct packet_view_t
 {
-	command_type_t type;
-} frame_done_command_t;
+	ecs_entity_ref_t entity;
+	uint32_t uniform_offset;
+	uint32_t uniform_size;
+} packet_view_t;
 
-typedef struct draw_instance_t
+// Everything the game pushes in a frame, handed to the render thread with one queue push.
+// Packets come from a fixed pool and return to it once the render thread has submitted their frame.
+typedef struct frame_packet_t
 {
-	ecs_entity_ref_t entity;
-	gpu_uniform_buffer_t** uniform_buffers;
-	gpu_descriptor_t** descriptors;
-	int frame_counter;
-} draw_instance_t;
+	int draw_count;
+	packet_draw_t draws[k_render_max_draws];
+	int view_count;
+	packet_view_t views[k_render_max_views];
+	size_t data_size;
+	char* data;
+} frame_packet_t;
+
+// Allocator of stable slots in a resource array.
+// A slot's generation changes whenever it is freed, so a handle to a freed slot
+// is never mistaken for the slot's next user.
+typedef struct slot_pool_t
+{
+	// Slots below this have been used; those not in use are on the free list.
+	int count;
+	int free_count;
+	int free_slots[k_render_max_drawables];
+	uint16_t generations[k_render_max_drawables];
+	bool in_use[k_render_max_drawables];
+} slot_pool_t;
 
 typedef struct draw_mesh_t
 {
@@ -55,44 +102,184 @@ typedef struct draw_shader_t
 	gpu_shader_info_t* info;
 	gpu_shader_t* shader;
 	gpu_pipeline_t* pipeline;
+	// Reads each draw's uniform data from the frame's uniform memory at a dynamic offset.
+	gpu_descriptor_t* descriptor;
+	size_t uniform_size;
 	int frame_counter;
 } draw_shader_t;
 
+// Instanced models of one frame sharing shader, mesh and view; drawn with one instanced draw.
+typedef struct draw_group_t
+{
+	draw_shader_t* shader;
+	draw_mesh_t* mesh;
+	// Index of the view in the frame packet.
+	int view;
+	// Offset of the uniform data shared by the group.
+	uint32_t uniform_offset;
+	size_t instance_size;
+	int instance_count;
+	// Byte offset of the first instance in the frame's instance buffer.
+	size_t offset;
+} draw_group_t;
+
+// Bind and draw counts of one frame.
+typedef struct draw_stats_t
+{
+	int draws;
+	int instanced_draws;
+	int instances;
+	int pipeline_binds;
+	int mesh_binds;
+	int descriptor_binds;
+	// Binds the frame would have taken in submission order.
+	int unsorted_pipeline_binds;
+	int unsorted_mesh_binds;
+} draw_stats_t;
+
+// A slice of a frame's sorted draws, recorded into one secondary command buffer.
+typedef struct record_range_t
+{
+	struct render_t* render;
+	int index;
+	int first_draw;
+	int draw_count;
+	gpu_cmd_buffer_t* cmd_buffer;
+	draw_stats_t stats;
+} record_range_t;
+
 typedef struct render_t
 {
 	heap_t* heap;
+	fs_t* fs;
 	wm_window_t* window;
+	const void* backend_config;
 	thread_t* thread;
 	gpu_t* gpu;
+
+	// Submitted frame packets, followed by NULL on shutdown.
 	queue_t* queue;
+	// Packets free to fill. The game waits on this when it is as far ahead of rendering as allowed.
+	queue_t* free_packets;
+	frame_packet_t* packets;
+	int packet_count;
+	// Packet the game thread is filling, or NULL before the first push of a frame.
+	frame_packet_t* packet;
 
 	int frame_counter;
 	int gpu_frame_count;
 
-	int instance_count;
-	int mesh_count;
-	int shader_count;
-	draw_instance_t instances[k_render_max_drawables];
+	// Resources live in stable slots, found by hash maps from info pointer to slot handle.
+	slot_pool_t mesh_slots;
+	slot_pool_t shader_slots;
 	draw_mesh_t meshes[k_render_max_drawables];
 	draw_shader_t shaders[k_render_max_drawables];
+	hash_map_t* mesh_map;
+	hash_map_t* shader_map;
+
+	// Draws of the current frame, submitted in key order when the frame is done.
+	int draw_count;
+	uint64_t draw_keys[k_render_max_draws];
+	// Uniform data offsets of the current frame's draws, indexed from draw keys.
+	int uniform_count;
+	uint32_t uniform_offsets[k_render_max_draws];
+	uint64_t draw_keys_scratch[k_render_max_draws];
+
+	// Instanced models of the current frame in push order, with their instance data in the frame packet.
+	// Packed group by group into the frame's instance buffer when the frame is done.
+	int group_count;
+	draw_group_t groups[k_render_max_groups];
+	int instanced_count;
+	int instanced_groups[k_render_max_draws];
+	const char* instanced_sources[k_render_max_draws];
+	char* instanced_packed;
+	gpu_instance_buffer_t** instance_buffers;
+
+	// Runs one recording system per range; ranges past the frame's range count do nothing.
+	// With no workers, draws are recorded on the render thread into the frame's command buffer.
+	scheduler_t* record_scheduler;
+	int record_workers;
+	int record_range_count;
+	int record_frame_index;
+	record_range_t record_ranges[k_render_max_record_workers];
+	uint64_t record_ticks;
+	int record_frames;
 } render_t;
 
+// A packet draw adds at most one draw key, one uniform offset and one instanced source,
+// so a full packet fits the per-frame draw arrays.
+_Static_assert(sizeof(((frame_packet_t*)0)->draws) / sizeof(packet_draw_t) <= k_render_max_draws, "frame packets must not hold more draws than a frame can submit");
+
 static int render_thread_func(void* user);
-static draw_shader_t* create_or_get_shader_for_model_command(render_t* render, model_command_t* command);
-static draw_mesh_t* create_or_get_mesh_for_model_command(render_t* render, model_command_t* command);
-static draw_instance_t* create_or_get_instance_for_model_command(render_t* render, model_command_t* command, gpu_shader_t* shader);
+static int slot_pool_alloc(slot_pool_t* pool);
+static void slot_pool_free(slot_pool_t* pool, int slot);
+static uint32_t slot_pool_get_handle(slot_pool_t* pool, int slot);
+static int slot_pool_resolve(slot_pool_t* pool, uint32_t handle);
+static draw_shader_t* create_or_get_shader(render_t* render, gpu_shader_info_t* info, gpu_mesh_info_t* mesh_info);
+static draw_mesh_t* create_or_get_mesh(render_t* render, gpu_mesh_info_t* info);
+static bool write_uniforms(render_t* render, draw_shader_t* shader, gpu_uniform_buffer_info_t* uniform_buffer, uint32_t* offset);
+static frame_packet_t* get_packet(render_t* render);
+static bool packet_push_data(frame_packet_t* packet, const void* data, size_t size, uint32_t* offset);
+static void push_model(render_t* render, frame_packet_t* packet, packet_draw_t* draw);
+static void push_instanced_model(render_t* render, frame_packet_t* packet, packet_draw_t* draw);
+static void push_draw(render_t* render, draw_shader_t* shader, draw_mesh_t* mesh, uint32_t index);
+static void pack_instances(render_t* render, int frame_index);
+static void submit_draws(render_t* render, gpu_cmd_buffer_t* cmdbuf, int frame_index);
+static void record_range_system(void* user);
+static void record_draws(render_t* render, gpu_cmd_buffer_t* cmdbuf, int first_draw, int draw_count, int frame_index, draw_stats_t* stats);
 static void destroy_stale_data(render_t* render);
 
-render_t* render_create(heap_t* heap, wm_window_t* window)
+render_t* render_create(heap_t* heap, fs_t* fs, wm_window_t* window, int frames_ahead, int record_workers, const void* backend_config)
 {
 	render_t* render = heap_alloc(heap, sizeof(render_t), 8);
 	render->heap = heap;
+	render->fs = fs;
 	render->window = window;
-	render->queue = queue_create(heap, 3);
+	render->backend_config = backend_config;
+
+	// One packet for each frame the game may run ahead, and one for the frame it is filling.
+	render->packet_count = __max(frames_ahead, 1) + 1;
+	render->packets = heap_alloc(heap, sizeof(frame_packet_t) * render->packet_count, 8);
+	render->queue = queue_create(heap, render->packet_count + 1);
+	render->free_packets = queue_create(heap, render->packet_count);
+	for (int i = 0; i < render->packet_count; ++i)
+	{
+		frame_packet_t* packet = &render->packets[i];
+		packet->draw_count = 0;
+		packet->view_count = 0;
+		packet->data_size = 0;
+		packet->data = heap_alloc(heap, k_render_packet_data_size, 16);
+		queue_push(render->free_packets, packet);
+	}
+	render->packet = NULL;
+
 	render->frame_counter = 0;
-	render->instance_count = 0;
-	render->mesh_count = 0;
-	render->shader_count = 0;
+	memset(&render->mesh_slots, 0, sizeof(render->mesh_slots));
+	memset(&render->shader_slots, 0, sizeof(render->shader_slots));
+	render->mesh_map = hash_map_create(heap, k_render_max_drawables);
+	render->shader_map = hash_map_create(heap, k_render_max_drawables);
+	render->draw_count = 0;
+	render->uniform_count = 0;
+	render->group_count = 0;
+	render->instanced_count = 0;
+	render->instanced_packed = heap_alloc(heap, k_render_max_draws * k_render_max_instance_size, 16);
+	render->instance_buffers = NULL;
+
+	render->record_scheduler = NULL;
+	render->record_workers = __min(__max(record_workers, 0), k_render_max_record_workers);
+	render->record_range_count = 0;
+	render->record_ticks = 0;
+	render->record_frames = 0;
+	if (render->record_workers > 0)
+	{
+		render->record_scheduler = scheduler_create(heap, render->record_workers);
+		for (int i = 0; i < render->record_workers; ++i)
+		{
+			render->record_ranges[i] = (record_range_t) { .render = render, .index = i };
+			scheduler_add_system(render->record_scheduler, "record_draws", record_range_system, &render->record_ranges[i], ecs_mask_empty(), ecs_mask_empty());
+		}
+	}
+
 	render->thread = thread_create(render_thread_func, render);
 	return render;
 }
@@ -102,117 +289,178 @@ void render_destroy(render_t* render)
 	queue_push(render->queue, NULL);
 	thread_destroy(render->thread);
 	queue_destroy(render->queue);
+	queue_destroy(render->free_packets);
+	for (int i = 0; i < render->packet_count; ++i)
+	{
+		heap_free(render->heap, render->packets[i].data);
+	}
+	heap_free(render->heap, render->packets);
+	if (render->record_scheduler)
+	{
+		scheduler_destroy(render->record_scheduler);
+	}
+	hash_map_destroy(render->shader_map);
+	hash_map_destroy(render->mesh_map);
+	heap_free(render->heap, render->instanced_packed);
 	heap_free(render->heap, render);
 }
 
 void render_push_model(render_t* render, ecs_entity_ref_t* entity, gpu_mesh_info_t* mesh, gpu_shader_info_t* shader, gpu_uniform_buffer_info_t* uniform)
 {
-	model_command_t* command = heap_alloc(render->heap, sizeof(model_command_t), 8);
-	command->type = k_command_model;
-	command->entity = *entity;
-	command->mesh = mesh;
-	command->shader = shader;
-	command->uniform_buffer.size = uniform->size;
-	command->uniform_buffer.data = heap_alloc(render->heap, uniform->size, 8);
-	memcpy(command->uniform_buffer.data, uniform->data, uniform->size);
-	queue_push(render->queue, command);
+	frame_packet_t* packet = get_packet(render);
+	if (packet->draw_count >= _countof(packet->draws))
+	{
+		debug_print(k_print_error, "Render: more than %d draws pushed in one frame\n", k_render_max_draws);
+		return;
+	}
+	packet_draw_t* draw = &packet->draws[packet->draw_count];
+	if (packet_push_data(packet, uniform->data, uniform->size, &draw->data_offset))
+	{
+		draw->mesh = mesh;
+		draw->shader = shader;
+		draw->view = -1;
+		draw->data_size = (uint32_t)uniform->size;
+		packet->draw_count++;
+	}
+}
+
+void render_push_instanced_model(render_t* render, ecs_entity_ref_t* view, gpu_mesh_info_t* mesh, gpu_shader_info_t* shader, gpu_uniform_buffer_info_t* uniform, const void* instance)
+{
+	size_t instance_size = gpu_instance_layout_get_size(shader->instance_layout);
+	assert(instance_size > 0 && instance_size <= k_render_max_instance_size);
+
+	frame_packet_t* packet = get_packet(render);
+	if (packet->draw_count >= _countof(packet->draws))
+	{
+		debug_print(k_print_error, "Render: more than %d draws pushed in one frame\n", k_render_max_draws);
+		return;
+	}
+
+	// The view's uniform data is only copied the first time the view is seen in a frame.
+	int view_index = 0;
+	for (; view_index < packet->view_count; ++view_index)
+	{
+		if (memcmp(&packet->views[view_index].entity, view, sizeof(ecs_entity_ref_t)) == 0)
+		{
+			break;
+		}
+	}
+	if (view_index == packet->view_count)
+	{
+		if (packet->view_count >= _countof(packet->views))
+		{
+			debug_print(k_print_error, "Render: more than %d views of instanced models pushed in one frame\n", k_render_max_views);
+			return;
+		}
+		packet_view_t* packet_view = &packet->views[view_index];
+		packet_view->entity = *view;
+		packet_view->uniform_size = (uint32_t)uniform->size;
+		if (!packet_push_data(packet, uniform->data, uniform->size, &packet_view->uniform_offset))
+		{
+			return;
+		}
+		packet->view_count++;
+	}
+
+	packet_draw_t* draw = &packet->draws[packet->draw_count];
+	if (packet_push_data(packet, instance, instance_size, &draw->data_offset))
+	{
+		draw->mesh = mesh;
+		draw->shader = shader;
+		draw->view = view_index;
+		draw->data_size = (uint32_t)instance_size;
+		packet->draw_count++;
+	}
 }
 
 void render_push_done(render_t* render)
 {
-	frame_done_command_t* command = heap_alloc(render->heap, sizeof(frame_done_command_t), 8);
-	command->type = k_command_frame_done;
-	queue_push(render->queue, command);
+	queue_push(render->queue, get_packet(render));
+	render->packet = NULL;
 }
 
 static int render_thread_func(void* user)
 {
 	render_t* render = user;
 
-	render->gpu = gpu_create(render->heap, render->window);
+	render->gpu = gpu_create(render->heap, render->fs, render->window, render->backend_config);
 	render->gpu_frame_count = gpu_get_frame_count(render->gpu);
 
-	gpu_cmd_buffer_t* cmdbuf = NULL;
-	gpu_pipeline_t* last_pipeline = NULL;
-	gpu_mesh_t* last_mesh = NULL;
+	// One instance buffer per frame in flight, so a frame never overwrites instances the GPU may still read.
+	render->instance_buffers = heap_alloc(render->heap, sizeof(gpu_instance_buffer_t*) * render->gpu_frame_count, 8);
+	for (int i = 0; i < render->gpu_frame_count; ++i)
+	{
+		render->instance_buffers[i] = gpu_instance_buffer_create(render->gpu, k_render_max_draws * k_render_max_instance_size);
+	}
+
 	int frame_index = 0;
 
 	while (true)
 	{
-		command_type_t* type = queue_pop(render->queue);
-		if (!type)
+		frame_packet_t* packet = queue_pop(render->queue);
+		if (!packet)
 		{
 			break;
 		}
 
-		if (!cmdbuf)
+		gpu_cmd_buffer_t* cmdbuf = gpu_frame_begin(render->gpu, render->record_scheduler != NULL);
+		for (int i = 0; i < packet->draw_count; ++i)
 		{
-			cmdbuf = gpu_frame_begin(render->gpu);
-		}
-
-		if (*type == k_command_frame_done)
-		{
-			gpu_frame_end(render->gpu);
-			cmdbuf = NULL;
-			last_pipeline = NULL;
-			last_mesh = NULL;
-
-			destroy_stale_data(render);
-			++render->frame_counter;
-			frame_index = render->frame_counter % render->gpu_frame_count;
-		}
-		else if (*type == k_command_model)
-		{
-			model_command_t* command = (model_command_t*)type;
-			draw_shader_t* shader = create_or_get_shader_for_model_command(render, command);
-			draw_mesh_t* mesh = create_or_get_mesh_for_model_command(render, command);
-			draw_instance_t* instance = create_or_get_instance_for_model_command(render, command, shader->shader);
-
-			heap_free(render->heap, command->uniform_buffer.data);
-
-			if (last_pipeline != shader->pipeline)
+			packet_draw_t* draw = &packet->draws[i];
+			if (draw->view < 0)
 			{
-				gpu_cmd_pipeline_bind(render->gpu, cmdbuf, shader->pipeline);
-				last_pipeline = shader->pipeline;
+				push_model(render, packet, draw);
 			}
-			if (last_mesh != mesh->mesh)
+			else
 			{
-				gpu_cmd_mesh_bind(render->gpu, cmdbuf, mesh->mesh);
-				last_mesh = mesh->mesh;
+				push_instanced_model(render, packet, draw);
 			}
-			gpu_cmd_descriptor_bind(render->gpu, cmdbuf, instance->descriptors[frame_index]);
-			gpu_cmd_draw(render->gpu, cmdbuf);
 		}
-
-		heap_free(render->heap, type);
+		submit_draws(render, cmdbuf, frame_index);
+		gpu_frame_end(render->gpu);
+
+		// Instance data is read from the packet until the frame's draws are submitted.
+		packet->draw_count = 0;
+		packet->view_count = 0;
+		packet->data_size = 0;
+		queue_push(render->free_packets, packet);
+
+		destroy_stale_data(render);
+		++render->frame_counter;
+		frame_index = render->frame_counter % render->gpu_frame_count;
 	}
 
 	gpu_wait_until_idle(render->gpu);
 	render->frame_counter += render->gpu_frame_count + 1;
 	destroy_stale_data(render);
 
+	for (int i = 0; i < render->gpu_frame_count; ++i)
+	{
+		gpu_instance_buffer_destroy(render->gpu, render->instance_buffers[i]);
+	}
+	heap_free(render->heap, render->instance_buffers);
+
 	gpu_destroy(render->gpu);
 	render->gpu = NULL;
 
 	return 0;
 }
 
-static draw_shader_t* create_or_get_shader_for_model_command(render_t* render, model_command_t* command)
+static draw_shader_t* create_or_get_shader(render_t* render, gpu_shader_info_t* info, gpu_mesh_info_t* mesh_info)
 {
 	draw_shader_t* shader = NULL;
-	for (int i = 0; i < render->shader_count; ++i)
+	uint32_t handle;
+	if (hash_map_find(render->shader_map, (uintptr_t)info, &handle))
 	{
-		if (render->shaders[i].info == command->shader)
-		{
-			shader = &render->shaders[i];
-			break;
-		}
+		shader = &render->shaders[slot_pool_resolve(&render->shader_slots, handle)];
 	}
-	if (!shader)
+	else
 	{
-		assert(render->shader_count < _countof(render->shaders));
-		shader = &render->shaders[render->shader_count++];
-		shader->info = command->shader;
+		int slot = slot_pool_alloc(&render->shader_slots);
+		shader = &render->shaders[slot];
+		memset(shader, 0, sizeof(*shader));
+		shader->info = info;
+		hash_map_insert(render->shader_map, (uintptr_t)info, slot_pool_get_handle(&render->shader_slots, slot));
 	}
 	if (!shader->shader)
 	{
@@ -223,7 +471,8 @@ static draw_shader_t* create_or_get_shader_for_model_command(render_t* render, m
 		gpu_pipeline_info_t pipeline_info =
 		{
 			.shader = shader->shader,
-			.mesh_layout = command->mesh->layout,
+			.mesh_layout = mesh_info->layout,
+			.instance_layout = info->instance_layout,
 		};
 		shader->pipeline = gpu_pipeline_create(render->gpu, &pipeline_info);
 	}
@@ -231,106 +480,380 @@ static draw_shader_t* create_or_get_shader_for_model_command(render_t* render, m
 	return shader;
 }
 
-static draw_mesh_t* create_or_get_mesh_for_model_command(render_t* render, model_command_t* command)
+static draw_mesh_t* create_or_get_mesh(render_t* render, gpu_mesh_info_t* info)
 {
 	draw_mesh_t* mesh = NULL;
-	for (int i = 0; i < render->mesh_count; ++i)
+	uint32_t handle;
+	if (hash_map_find(render->mesh_map, (uintptr_t)info, &handle))
 	{
-		if (render->meshes[i].info == command->mesh)
-		{
-			mesh = &render->meshes[i];
-			break;
-		}
+		mesh = &render->meshes[slot_pool_resolve(&render->mesh_slots, handle)];
 	}
-	if (!mesh)
+	else
 	{
-		assert(render->mesh_count < _countof(render->meshes));
-		mesh = &render->meshes[render->mesh_count++];
-		mesh->info = command->mesh;
+		int slot = slot_pool_alloc(&render->mesh_slots);
+		mesh = &render->meshes[slot];
+		memset(mesh, 0, sizeof(*mesh));
+		mesh->info = info;
+		hash_map_insert(render->mesh_map, (uintptr_t)info, slot_pool_get_handle(&render->mesh_slots, slot));
 	}
 	if (!mesh->mesh)
 	{
-		mesh->mesh = gpu_mesh_create(render->gpu, command->mesh);
+		mesh->mesh = gpu_mesh_create(render->gpu, info);
 	}
 	mesh->frame_counter = render->frame_counter;
 	return mesh;
 }
 
-static draw_instance_t* create_or_get_instance_for_model_command(render_t* render, model_command_t* command, gpu_shader_t* shader)
+static bool write_uniforms(render_t* render, draw_shader_t* shader, gpu_uniform_buffer_info_t* uniform_buffer, uint32_t* offset)
+{
+	// One descriptor serves every draw with the shader; draws differ only in their uniform offset.
+	if (!shader->descriptor)
+	{
+		gpu_descriptor_info_t descriptor_info =
+		{
+			.shader = shader->shader,
+			.uniform_sizes = &uniform_buffer->size,
+			.uniform_buffer_count = 1,
+		};
+		shader->descriptor = gpu_descriptor_create(render->gpu, &descriptor_info);
+		shader->uniform_size = uniform_buffer->size;
+	}
+	assert(uniform_buffer->size == shader->uniform_size);
+
+	return gpu_uniform_write(render->gpu, uniform_buffer->data, uniform_buffer->size, offset);
+}
+
+static frame_packet_t* get_packet(render_t* render)
+{
+	// Blocks until the render thread returns a packet when the game is as far ahead as allowed.
+	if (!render->packet)
+	{
+		render->packet = queue_pop(render->free_packets);
+	}
+	return render->packet;
+}
+
+static bool packet_push_data(frame_packet_t* packet, const void* data, size_t size, uint32_t* offset)
+{
+	size_t start = (packet->data_size + 15) & ~(size_t)15;
+	if (start + size > k_render_packet_data_size)
+	{
+		debug_print(k_print_error, "Render: %zu bytes of frame data overflow the packet's %d bytes\n", size, k_render_packet_data_size);
+		return false;
+	}
+	memcpy(packet->data + start, data, size);
+	packet->data_size = start + size;
+	*offset = (uint32_t)start;
+	return true;
+}
+
+static void push_model(render_t* render, frame_packet_t* packet, packet_draw_t* draw)
+{
+	draw_shader_t* shader = create_or_get_shader(render, draw->shader, draw->mesh);
+	draw_mesh_t* mesh = create_or_get_mesh(render, draw->mesh);
+	gpu_uniform_buffer_info_t uniform_buffer = { .data = packet->data + draw->data_offset, .size = draw->data_size };
+	assert(render->uniform_count < _countof(render->uniform_offsets));
+	if (write_uniforms(render, shader, &uniform_buffer, &render->uniform_offsets[render->uniform_count]))
+	{
+		push_draw(render, shader, mesh, render->uniform_count++);
+	}
+}
+
+static void push_instanced_model(render_t* render, frame_packet_t* packet, packet_draw_t* draw)
 {
-	draw_instance_t* instance = NULL;
-	for (int i = 0; i < render->instance_count; ++i)
+	draw_shader_t* shader = create_or_get_shader(render, draw->shader, draw->mesh);
+	draw_mesh_t* mesh = create_or_get_mesh(render, draw->mesh);
+
+	// Find this frame's group for the shader, mesh and view.
+	// Shared uniform data is only written when the group is first seen in a frame.
+	int group = 0;
+	for (; group < render->group_count; ++group)
 	{
-		if (memcmp(&render->instances[i].entity, &command->entity, sizeof(ecs_entity_ref_t)) == 0)
+		draw_group_t* g = &render->groups[group];
+		if (g->shader == shader && g->mesh == mesh && g->view == draw->view)
 		{
-			instance = &render->instances[i];
 			break;
 		}
 	}
-	if (!instance)
+	if (group == render->group_count)
 	{
-		assert(render->instance_count < _countof(render->instances));
-		instance = &render->instances[render->instance_count++];
+		if (render->group_count >= _countof(render->groups))
+		{
+			debug_print(k_print_error, "Render: more than %d instanced groups in one frame\n", k_render_max_groups);
+			return;
+		}
+		render->groups[group] = (draw_group_t)
+		{
+			.shader = shader,
+			.mesh = mesh,
+			.view = draw->view,
+			.instance_size = draw->data_size,
+		};
+		packet_view_t* view = &packet->views[draw->view];
+		gpu_uniform_buffer_info_t uniform_buffer = { .data = packet->data + view->uniform_offset, .size = view->uniform_size };
+		if (!write_uniforms(render, shader, &uniform_buffer, &render->groups[group].uniform_offset))
+		{
+			return;
+		}
+		render->group_count++;
+		push_draw(render, shader, mesh, k_draw_key_group_bit | group);
+	}
+
+	assert(render->instanced_count < _countof(render->instanced_groups));
+	render->groups[group].instance_count++;
+	render->instanced_groups[render->instanced_count] = group;
+	render->instanced_sources[render->instanced_count] = packet->data + draw->data_offset;
+	render->instanced_count++;
+}
+
+static void push_draw(render_t* render, draw_shader_t* shader, draw_mesh_t* mesh, uint32_t index)
+{
+	// Objects are only removed at the end of a frame, so array indices are stable until the draws are submitted.
+	assert(render->draw_count < _countof(render->draw_keys));
+	uint64_t shader_index = shader - render->shaders;
+	uint64_t mesh_index = mesh - render->meshes;
+	render->draw_keys[render->draw_count++] =
+		(shader_index << k_draw_key_shader_shift) |
+		(mesh_index << k_draw_key_mesh_shift) |
+		index;
+}
 
-		instance->entity = command->entity;
-		instance->uniform_buffers = heap_alloc(render->heap, sizeof(gpu_uniform_buffer_t*) * render->gpu_frame_count, 8);
-		instance->descriptors = heap_alloc(render->heap, sizeof(gpu_descriptor_t*) * render->gpu_frame_count, 8);
-		for (int i = 0; i < render->gpu_frame_count; ++i)
+static void pack_instances(render_t* render, int frame_index)
+{
+	// Lay groups out back to back, then copy each instance into its group's range.
+	size_t offset = 0;
+	size_t cursors[k_render_max_groups];
+	for (int g = 0; g < render->group_count; ++g)
+	{
+		render->groups[g].offset = offset;
+		cursors[g] = offset;
+		offset += render->groups[g].instance_size * render->groups[g].instance_count;
+	}
+	for (int i = 0; i < render->instanced_count; ++i)
+	{
+		draw_group_t* group = &render->groups[render->instanced_groups[i]];
+		size_t* cursor = &cursors[render->instanced_groups[i]];
+		memcpy(render->instanced_packed + *cursor, render->instanced_sources[i], group->instance_size);
+		*cursor += group->instance_size;
+	}
+	if (offset)
+	{
+		gpu_instance_buffer_update(render->gpu, render->instance_buffers[frame_index], render->instanced_packed, offset);
+	}
+}
+
+static void submit_draws(render_t* render, gpu_cmd_buffer_t* cmdbuf, int frame_index)
+{
+	draw_stats_t stats = { .draws = render->draw_count };
+
+	uint64_t last_key = UINT64_MAX;
+	for (int i = 0; i < render->draw_count; ++i)
+	{
+		uint64_t key = render->draw_keys[i];
+		stats.unsorted_pipeline_binds += (key >> k_draw_key_shader_shift) != (last_key >> k_draw_key_shader_shift);
+		stats.unsorted_mesh_binds += (key >> k_draw_key_mesh_shift) != (last_key >> k_draw_key_mesh_shift);
+		last_key = key;
+	}
+
+	sort_radix_u64(render->draw_keys, render->draw_keys_scratch, render->draw_count);
+	pack_instances(render, frame_index);
+
+	uint64_t record_start = timer_get_ticks();
+	if (render->record_scheduler)
+	{
+		// Split the sorted draws into even ranges, one per secondary command buffer.
+		// Each range starts with fresh binds, so small frames stay in one range.
+		int range_count = (render->draw_count + k_render_min_draws_per_range - 1) / k_render_min_draws_per_range;
+		range_count = __min(range_count, render->record_workers);
+		int first_draw = 0;
+		for (int r = 0; r < range_count; ++r)
 		{
-			instance->uniform_buffers[i] = gpu_uniform_buffer_create(render->gpu, &command->uniform_buffer);
+			record_range_t* range = &render->record_ranges[r];
+			range->first_draw = first_draw;
+			range->draw_count = (render->draw_count - first_draw) / (range_count - r);
+			first_draw += range->draw_count;
+		}
+		render->record_range_count = range_count;
+		render->record_frame_index = frame_index;
 
-			gpu_descriptor_info_t descriptor_info =
+		if (range_count == 1)
+		{
+			record_range_system(&render->record_ranges[0]);
+		}
+		else if (range_count > 1)
+		{
+			scheduler_run(render->record_scheduler);
+		}
+
+		// Ranges whose command buffer failed to begin are dropped from the frame.
+		gpu_cmd_buffer_t* secondary_cmd_buffers[k_render_max_record_workers];
+		int secondary_count = 0;
+		for (int r = 0; r < range_count; ++r)
+		{
+			if (!render->record_ranges[r].cmd_buffer)
 			{
-				.shader = shader,
-				.uniform_buffers = &instance->uniform_buffers[i],
-				.uniform_buffer_count = 1,
-			};
-			instance->descriptors[i] = gpu_descriptor_create(render->gpu, &descriptor_info);
+				continue;
+			}
+			draw_stats_t* range_stats = &render->record_ranges[r].stats;
+			stats.instanced_draws += range_stats->instanced_draws;
+			stats.instances += range_stats->instances;
+			stats.pipeline_binds += range_stats->pipeline_binds;
+			stats.mesh_binds += range_stats->mesh_binds;
+			stats.descriptor_binds += range_stats->descriptor_binds;
+			secondary_cmd_buffers[secondary_count++] = render->record_ranges[r].cmd_buffer;
+		}
+		if (secondary_count)
+		{
+			gpu_cmd_execute_secondary(render->gpu, cmdbuf, secondary_cmd_buffers, secondary_count);
 		}
 	}
+	else
+	{
+		record_draws(render, cmdbuf, 0, render->draw_count, frame_index, &stats);
+	}
+	render->record_ticks += timer_get_ticks() - record_start;
+	if (++render->record_frames == k_render_record_report_frames)
+	{
+		debug_print(k_print_info, "Render: recorded %.3f ms/frame over %d frames, %d draws in %d ranges last frame.\n",
+			(double)timer_ticks_to_us(render->record_ticks) / 1000.0 / render->record_frames, render->record_frames,
+			render->draw_count, __max(render->record_range_count, 1));
+		debug_print(k_print_info, "Render: %d draws (%d instanced, %d instances), %d pipeline binds (%d unsorted), %d mesh binds (%d unsorted), %d descriptor binds last frame.\n",
+			stats.draws, stats.instanced_draws, stats.instances, stats.pipeline_binds, stats.unsorted_pipeline_binds, stats.mesh_binds, stats.unsorted_mesh_binds, stats.descriptor_binds);
+		render->record_ticks = 0;
+		render->record_frames = 0;
+	}
 
-	int frame_index = render->frame_counter % render->gpu_frame_count;
-	gpu_uniform_buffer_update(render->gpu, instance->uniform_buffers[frame_index], command->uniform_buffer.data, command->uniform_buffer.size);
+	render->draw_count = 0;
+	render->uniform_count = 0;
+	render->group_count = 0;
+	render->instanced_count = 0;
+}
 
-	instance->frame_counter = render->frame_counter;
+static void record_range_system(void* user)
+{
+	record_range_t* range = user;
+	render_t* render = range->render;
+	if (range->index >= render->record_range_count)
+	{
+		return;
+	}
 
-	return instance;
+	memset(&range->stats, 0, sizeof(range->stats));
+	range->cmd_buffer = gpu_secondary_cmd_buffer_begin(render->gpu, range->index);
+	if (!range->cmd_buffer)
+	{
+		return;
+	}
+	record_draws(render, range->cmd_buffer, range->first_draw, range->draw_count, render->record_frame_index, &range->stats);
+	gpu_secondary_cmd_buffer_end(render->gpu, range->cmd_buffer);
 }
 
-static void destroy_stale_data(render_t* render)
+static void record_draws(render_t* render, gpu_cmd_buffer_t* cmdbuf, int first_draw, int draw_count, int frame_index, draw_stats_t* stats)
 {
-	for (int i = render->instance_count - 1; i >= 0; --i)
+	gpu_pipeline_t* last_pipeline = NULL;
+	gpu_mesh_t* last_mesh = NULL;
+	uint32_t last_uniform_offset = UINT32_MAX;
+	for (int i = first_draw; i < first_draw + draw_count; ++i)
 	{
-		if (render->instances[i].frame_counter + render->gpu_frame_count <= render->frame_counter)
+		uint64_t key = render->draw_keys[i];
+		draw_shader_t* shader = &render->shaders[key >> k_draw_key_shader_shift];
+		draw_mesh_t* mesh = &render->meshes[(key >> k_draw_key_mesh_shift) & k_draw_key_mesh_mask];
+		draw_group_t* group = (key & k_draw_key_group_bit) ? &render->groups[key & k_draw_key_index_mask] : NULL;
+		uint32_t uniform_offset = group ? group->uniform_offset : render->uniform_offsets[key & k_draw_key_index_mask];
+
+		if (last_pipeline != shader->pipeline)
 		{
-			for (int f = 0; f < render->gpu_frame_count; ++f)
-			{
-				gpu_descriptor_destroy(render->gpu, render->instances[i].descriptors[f]);
-				gpu_uniform_buffer_destroy(render->gpu, render->instances[i].uniform_buffers[f]);
-			}
-			heap_free(render->heap, render->instances[i].descriptors);
-			heap_free(render->heap, render->instances[i].uniform_buffers);
-			render->instances[i] = render->instances[render->instance_count - 1];
-			render->instance_count--;
+			gpu_cmd_pipeline_bind(render->gpu, cmdbuf, shader->pipeline);
+			last_pipeline = shader->pipeline;
+			// Rebind mesh and descriptors under a new pipeline; its layout may differ from the last one.
+			last_mesh = NULL;
+			last_uniform_offset = UINT32_MAX;
+			stats->pipeline_binds++;
+		}
+		if (last_mesh != mesh->mesh)
+		{
+			gpu_cmd_mesh_bind(render->gpu, cmdbuf, mesh->mesh);
+			last_mesh = mesh->mesh;
+			stats->mesh_binds++;
+		}
+		if (last_uniform_offset != uniform_offset)
+		{
+			gpu_cmd_descriptor_bind(render->gpu, cmdbuf, shader->descriptor, &uniform_offset);
+			last_uniform_offset = uniform_offset;
+			stats->descriptor_binds++;
+		}
+		if (group)
+		{
+			gpu_cmd_instance_buffer_bind(render->gpu, cmdbuf, render->instance_buffers[frame_index], group->offset);
+			gpu_cmd_draw_instanced(render->gpu, cmdbuf, 0, group->instance_count);
+			stats->instanced_draws++;
+			stats->instances += group->instance_count;
+		}
+		else
+		{
+			gpu_cmd_draw(render->gpu, cmdbuf);
 		}
 	}
-	for (int i = render->mesh_count - 1; i >= 0; --i)
+}
+
+static void destroy_stale_data(render_t* render)
+{
+	for (int i = 0; i < render->mesh_slots.count; ++i)
 	{
-		if (render->meshes[i].frame_counter + render->gpu_frame_count <= render->frame_counter)
+		if (render->mesh_slots.in_use[i] &&
+			render->meshes[i].frame_counter + render->gpu_frame_count <= render->frame_counter)
 		{
 			gpu_mesh_destroy(render->gpu, render->meshes[i].mesh);
-			render->meshes[i] = render->meshes[render->mesh_count - 1];
-			render->mesh_count--;
+			hash_map_remove(render->mesh_map, (uintptr_t)render->meshes[i].info);
+			slot_pool_free(&render->mesh_slots, i);
 		}
 	}
-	for (int i = render->shader_count - 1; i >= 0; --i)
+	for (int i = 0; i < render->shader_slots.count; ++i)
 	{
-		if (render->shaders[i].frame_counter + render->gpu_frame_count <= render->frame_counter)
+		if (render->shader_slots.in_use[i] &&
+			render->shaders[i].frame_counter + render->gpu_frame_count <= render->frame_counter)
 		{
+			gpu_descriptor_destroy(render->gpu, render->shaders[i].descriptor);
 			gpu_pipeline_destroy(render->gpu, render->shaders[i].pipeline);
 			gpu_shader_destroy(render->gpu, render->shaders[i].shader);
-			render->shaders[i] = render->shaders[render->shader_count - 1];
-			render->shader_count--;
+			hash_map_remove(render->shader_map, (uintptr_t)render->shaders[i].info);
+			slot_pool_free(&render->shader_slots, i);
 		}
 	}
 }
+
+static int slot_pool_alloc(slot_pool_t* pool)
+{
+	int slot;
+	if (pool->free_count)
+	{
+		slot = pool->free_slots[--pool->free_count];
+	}
+	else
+	{
+		assert(pool->count < _countof(pool->in_use));
+		slot = pool->count++;
+	}
+	pool->in_use[slot] = true;
+	return slot;
+}
+
+static void slot_pool_free(slot_pool_t* pool, int slot)
+{
+	pool->in_use[slot] = false;
+	pool->generations[slot]++;
+	pool->free_slots[pool->free_count++] = slot;
+}
+
+// Handle: generation in the high 16 bits, slot in the low 16 bits.
+static uint32_t slot_pool_get_handle(slot_pool_t* pool, int slot)
+{
+	return ((uint32_t)pool->generations[slot] << 16) | (uint32_t)slot;
+}
+
+static int slot_pool_resolve(slot_pool_t* pool, uint32_t handle)
+{
+	int slot = handle & 0xffff;
+	assert(pool->in_use[slot] && pool->generations[slot] == handle >> 16);
+	return slot;
+}
@@ -1,10 +1,14 @@
 #pragma once
 
 // High-level graphics rendering interface.
+// The game thread fills a frame packet with each frame's models and hands the whole packet
+// to the render thread when the frame is done. Packets come from a small pool, which sets
+// how many frames the game may run ahead of rendering.
 
 typedef struct render_t render_t;
 
 typedef struct ecs_entity_ref_t ecs_entity_ref_t;
+typedef struct fs_t fs_t;
 typedef struct gpu_mesh_info_t gpu_mesh_info_t;
 typedef struct gpu_shader_info_t gpu_shader_info_t;
 typedef struct gpu_uniform_buffer_info_t gpu_uniform_buffer_info_t;
@@ -12,13 +16,25 @@ typedef struct heap_t heap_t;
 typedef struct wm_window_t wm_window_t;
 
 // Create a render system.
-render_t* render_create(heap_t* heap, wm_window_t* window);
+// The file system is used to keep compiled pipelines between runs; it must outlive the render system.
+// The game may push frames_ahead frames, at least one, beyond the frame being rendered before pushes wait.
+// Large frames are recorded in parallel on up to record_workers worker threads, at most 8;
+// with none, the render thread records every draw itself.
+// Backend config is handed to gpu_create(); it may be NULL and must stay valid until render_destroy().
+render_t* render_create(heap_t* heap, fs_t* fs, wm_window_t* window, int frames_ahead, int record_workers, const void* backend_config);
 
 // Destroy a render system.
 void render_destroy(render_t* render);
 
-// Push a model onto a queue of items to be rendered.
+// Add a model to the current frame. Its uniform data is copied.
+// The first push of a frame waits for a free packet when the game is as far ahead as allowed.
 void render_push_model(render_t* render, ecs_entity_ref_t* entity, gpu_mesh_info_t* mesh, gpu_shader_info_t* shader, gpu_uniform_buffer_info_t* uniform);
 
-// Push an end-of-frame marker on a queue of items to be rendered.
+// Push a model drawn with GPU instancing. The shader must have an instance layout.
+// Models pushed in a frame for the same view with the same mesh and shader are drawn with one instanced draw.
+// Uniform holds data shared by the view, such as camera matrices; it is read once per frame and view.
+// Instance holds the data of this model, laid out as the shader's instance layout.
+void render_push_instanced_model(render_t* render, ecs_entity_ref_t* view, gpu_mesh_info_t* mesh, gpu_shader_info_t* shader, gpu_uniform_buffer_info_t* uniform, const void* instance);
+
+// Hand the current frame's packet to the render thread.
 void render_push_done(render_t* render);
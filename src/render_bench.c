@@ -0,0 +1,223 @@
+#include "render_bench.h"
+
+#include "debug.h"
+
+#if defined(GPU_NULL)
+
+#include "ecs.h"
+#include "gpu.h"
+#include "gpu_null.h"
+#include "heap.h"
+#include "render.h"
+#include "timer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Time runs from the first push until the render system has drained its queue and stopped,
+// so it covers the game thread handing commands over as well as the render thread consuming them.
+
+enum
+{
+	k_bench_frames = 200,
+	k_bench_draws = 2048,
+	k_bench_max_meshes = 128,
+	k_bench_max_mesh_sets = 4,
+	k_bench_log_capacity = k_bench_draws * 4 + 64,
+};
+
+typedef struct bench_case_t
+{
+	const char* name;
+	// Models pushed each frame.
+	int draws;
+	// Distinct meshes drawn each frame.
+	int mesh_count;
+	// Frames rotate through this many sets of meshes. With more sets than frames in flight,
+	// meshes go unused long enough to be destroyed and are created again when their set comes back.
+	int mesh_sets;
+	bool instanced;
+	uint32_t frame_wait_us;
+	// Frames the game may push beyond the frame being rendered.
+	int frames_ahead;
+	// Worker threads recording draws.
+	int record_workers;
+} bench_case_t;
+
+static const bench_case_t k_bench_cases[] =
+{
+	{ "plain, 1 mesh", k_bench_draws, 1, 1, false, 0, 2, 4 },
+	{ "plain, 128 meshes", k_bench_draws, 128, 1, false, 0, 2, 4 },
+	{ "plain, meshes go stale", k_bench_draws, 128, 4, false, 0, 2, 4 },
+	{ "instanced, 1 mesh", k_bench_draws, 1, 1, true, 0, 2, 4 },
+	{ "plain, 4 ms GPU frames", k_bench_draws, 1, 1, false, 4000, 2, 4 },
+	{ "plain, 1 frame ahead", k_bench_draws, 1, 1, false, 0, 1, 4 },
+};
+
+// Recording worker counts compared on the 128 mesh case, against recording on the render thread.
+static const int k_bench_record_workers[] = { 0, 1, 2, 4, 8 };
+
+typedef struct bench_uniform_t
+{
+	float projection[16];
+	float model[16];
+	float view[16];
+	float color[4];
+} bench_uniform_t;
+
+typedef struct bench_instance_t
+{
+	float model[16];
+	float color[3];
+} bench_instance_t;
+
+typedef struct bench_world_t
+{
+	heap_t* heap;
+	gpu_mesh_info_t* meshes;
+	gpu_shader_info_t plain_shader;
+	gpu_shader_info_t instanced_shader;
+	gpu_null_command_t* log;
+} bench_world_t;
+
+static const float k_bench_vertices[] =
+{
+	-1.0f, -1.0f, 0.0f, 0.0f,
+	1.0f, -1.0f, 0.0f, 0.0f,
+	1.0f, 1.0f, 0.0f, 0.0f,
+};
+static const uint16_t k_bench_indices[] = { 0, 1, 2 };
+
+static double bench_ms(uint64_t ticks)
+{
+	return (double)ticks * 1000.0 / (double)timer_get_ticks_per_second();
+}
+
+static bool bench_case_run(bench_world_t* world, const bench_case_t* bench, double* ms_per_frame)
+{
+	gpu_null_counters_t counters = { 0 };
+	gpu_null_config_t config =
+	{
+		.frame_count = 2,
+		.frame_wait_us = bench->frame_wait_us,
+		.counters = &counters,
+		.command_log = world->log,
+		.command_log_capacity = k_bench_log_capacity,
+	};
+
+	render_t* render = render_create(world->heap, NULL, NULL, bench->frames_ahead, bench->record_workers, &config);
+
+	ecs_entity_ref_t view = { 0 };
+	bench_uniform_t uniform_data = { .color = { 1.0f, 1.0f, 1.0f, 1.0f } };
+	gpu_uniform_buffer_info_t uniform = { .data = &uniform_data, .size = sizeof(uniform_data) };
+	bench_instance_t instance_data = { .color = { 1.0f, 1.0f, 1.0f } };
+
+	uint64_t t0 = timer_get_ticks();
+	for (int frame = 0; frame < k_bench_frames; ++frame)
+	{
+		gpu_mesh_info_t* meshes = world->meshes + (frame % bench->mesh_sets) * k_bench_max_meshes;
+		for (int i = 0; i < bench->draws; ++i)
+		{
+			gpu_mesh_info_t* mesh = &meshes[i % bench->mesh_count];
+			if (bench->instanced)
+			{
+				instance_data.model[0] = (float)i;
+				render_push_instanced_model(render, &view, mesh, &world->instanced_shader, &uniform, &instance_data);
+			}
+			else
+			{
+				ecs_entity_ref_t entity = { .entity = i };
+				uniform_data.model[0] = (float)i;
+				render_push_model(render, &entity, mesh, &world->plain_shader, &uniform);
+			}
+		}
+		render_push_done(render);
+	}
+	render_destroy(render);
+	uint64_t ticks = timer_get_ticks() - t0;
+
+	// Draws in the log of the last frame, counting each instance of an instanced draw.
+	int logged_draws = 0;
+	for (int i = 0; i < __min(counters.last_frame_commands, k_bench_log_capacity); ++i)
+	{
+		if (world->log[i].type == k_gpu_null_command_draw || world->log[i].type == k_gpu_null_command_draw_instanced)
+		{
+			logged_draws += world->log[i].count;
+		}
+	}
+
+	int drawn = bench->instanced ? counters.instances : counters.draws;
+	double ms = bench_ms(ticks);
+	*ms_per_frame = ms / k_bench_frames;
+	debug_print(k_print_info, "%-28s %10.3f ms/frame %8.1f ns/draw %6d cmds/frame %5d mesh creates\n",
+		bench->name, ms / k_bench_frames, ms * 1000000.0 / ((double)k_bench_frames * bench->draws),
+		counters.last_frame_commands, counters.mesh_creates);
+
+	if (counters.frames != k_bench_frames || drawn != k_bench_frames * bench->draws || logged_draws != bench->draws)
+	{
+		debug_print(k_print_error, "Render bench '%s' pushed %d draws over %d frames; GPU drew %d over %d frames, %d in the last frame.\n",
+			bench->name, k_bench_frames * bench->draws, k_bench_frames, drawn, counters.frames, logged_draws);
+		return false;
+	}
+	return true;
+}
+
+bool render_bench_run(heap_t* heap)
+{
+	bench_world_t world = { .heap = heap };
+	world.meshes = heap_alloc(heap, sizeof(gpu_mesh_info_t) * k_bench_max_meshes * k_bench_max_mesh_sets, 8);
+	for (int i = 0; i < k_bench_max_meshes * k_bench_max_mesh_sets; ++i)
+	{
+		world.meshes[i] = (gpu_mesh_info_t)
+		{
+			.layout = k_gpu_mesh_layout_tri_p444_i2,
+			.vertex_data = (void*)k_bench_vertices,
+			.vertex_data_size = sizeof(k_bench_vertices),
+			.index_data = (void*)k_bench_indices,
+			.index_data_size = sizeof(k_bench_indices),
+		};
+	}
+	world.plain_shader = (gpu_shader_info_t) { .uniform_buffer_count = 1, .instance_layout = k_gpu_instance_layout_none };
+	world.instanced_shader = (gpu_shader_info_t) { .uniform_buffer_count = 1, .instance_layout = k_gpu_instance_layout_m4444_c444 };
+	world.log = heap_alloc(heap, sizeof(gpu_null_command_t) * k_bench_log_capacity, 8);
+
+	debug_print(k_print_info, "--- render (%d frames of %d draws, null GPU) ---\n", k_bench_frames, k_bench_draws);
+
+	bool valid = true;
+	double ms_per_frame = 0.0;
+	for (int i = 0; i < _countof(k_bench_cases); ++i)
+	{
+		valid &= bench_case_run(&world, &k_bench_cases[i], &ms_per_frame);
+	}
+
+	debug_print(k_print_info, "--- render recording workers ---\n");
+	double serial_ms_per_frame = 0.0;
+	for (int i = 0; i < _countof(k_bench_record_workers); ++i)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "plain, %d record workers", k_bench_record_workers[i]);
+		bench_case_t bench = k_bench_cases[1];
+		bench.name = name;
+		bench.record_workers = k_bench_record_workers[i];
+		valid &= bench_case_run(&world, &bench, &ms_per_frame);
+		if (i == 0)
+		{
+			serial_ms_per_frame = ms_per_frame;
+		}
+		debug_print(k_print_info, "%-28s %10.2fx speedup over the render thread alone\n", "", serial_ms_per_frame / ms_per_frame);
+	}
+
+	heap_free(heap, world.log);
+	heap_free(heap, world.meshes);
+	return valid;
+}
+
+#else
+
+bool render_bench_run(heap_t* heap)
+{
+	debug_print(k_print_info, "--- render: skipped, build the Bench configuration, which defines GPU_NULL, to run ---\n");
+	return true;
+}
+
+#endif // GPU_NULL
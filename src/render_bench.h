@@ -0,0 +1,15 @@
+#pragma once
+
+// Render Benchmarks
+// Measures render thread throughput with the null GPU backend: plain, instanced and
+// many-mesh frames, meshes going stale and being recreated, and frames waiting on a slow GPU.
+// Also compares recording with different numbers of worker threads.
+// Only runs in builds with GPU_NULL defined, such as the Bench configuration.
+
+#include <stdbool.h>
+
+typedef struct heap_t heap_t;
+
+// Run the benchmark and print results.
+// Returns false if the backend did not see the draws that were pushed.
+bool render_bench_run(heap_t* heap);
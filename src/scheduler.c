@@ -0,0 +1,375 @@
+#include "scheduler.h"
+
+#include "atomic.h"
+#include "debug.h"
+#include "heap.h"
+#include "queue.h"
+#include "semaphore.h"
+#include "thread.h"
+#include "timer.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+enum
+{
+	k_max_systems = 64,
+	k_trace_capacity = 64 * 1024,
+};
+
+typedef struct system_t
+{
+	char name[32];
+	scheduler_system_func_t func;
+	void* user;
+	ecs_mask_t read_mask;
+	ecs_mask_t write_mask;
+	// Registered with SCHEDULER_EXCLUSIVE; conflicts with every system.
+	bool exclusive;
+
+	// Dependency graph edges as system index bit masks.
+	uint64_t predecessors;
+	uint64_t successors;
+	int predecessor_count;
+
+	// Per-frame state.
+	int pending;
+	int worker;
+	uint64_t start_ticks;
+	uint64_t end_ticks;
+} system_t;
+
+typedef struct worker_t
+{
+	scheduler_t* scheduler;
+	thread_t* thread;
+	int index;
+} worker_t;
+
+typedef struct trace_event_t
+{
+	int system;
+	int worker;
+	int frame;
+	bool critical;
+	uint64_t start_ticks;
+	uint64_t end_ticks;
+} trace_event_t;
+
+typedef struct scheduler_t
+{
+	heap_t* heap;
+
+	int system_count;
+	system_t systems[k_max_systems];
+	bool graph_dirty;
+
+	int worker_count;
+	worker_t* workers;
+	queue_t* ready_queue;
+	semaphore_t* frame_done;
+	int remaining;
+
+	bool tracing;
+	char trace_path[256];
+	uint64_t trace_start_ticks;
+	int trace_frame;
+	int trace_count;
+	trace_event_t* trace_events;
+} scheduler_t;
+
+static int worker_thread_func(void* user);
+static void run_system(scheduler_t* scheduler, system_t* system, int worker);
+static void build_graph(scheduler_t* scheduler);
+static void record_trace(scheduler_t* scheduler);
+
+scheduler_t* scheduler_create(heap_t* heap, int worker_count)
+{
+	scheduler_t* scheduler = heap_alloc(heap, sizeof(scheduler_t), 8);
+	memset(scheduler, 0, sizeof(*scheduler));
+	scheduler->heap = heap;
+	scheduler->worker_count = worker_count;
+
+	if (worker_count > 0)
+	{
+		scheduler->ready_queue = queue_create(heap, k_max_systems + worker_count);
+		scheduler->frame_done = semaphore_create(0, 1);
+		scheduler->workers = heap_alloc(heap, sizeof(worker_t) * worker_count, 8);
+		for (int i = 0; i < worker_count; ++i)
+		{
+			scheduler->workers[i].scheduler = scheduler;
+			scheduler->workers[i].index = i;
+			scheduler->workers[i].thread = thread_create(worker_thread_func, &scheduler->workers[i]);
+		}
+	}
+	return scheduler;
+}
+
+void scheduler_destroy(scheduler_t* scheduler)
+{
+	if (scheduler->tracing)
+	{
+		scheduler_trace_stop(scheduler);
+	}
+
+	if (scheduler->worker_count > 0)
+	{
+		for (int i = 0; i < scheduler->worker_count; ++i)
+		{
+			queue_push(scheduler->ready_queue, NULL);
+		}
+		for (int i = 0; i < scheduler->worker_count; ++i)
+		{
+			thread_destroy(scheduler->workers[i].thread);
+		}
+		heap_free(scheduler->heap, scheduler->workers);
+		semaphore_destroy(scheduler->frame_done);
+		queue_destroy(scheduler->ready_queue);
+	}
+	if (scheduler->trace_events)
+	{
+		heap_free(scheduler->heap, scheduler->trace_events);
+	}
+	heap_free(scheduler->heap, scheduler);
+}
+
+int scheduler_add_system(scheduler_t* scheduler, const char* name, scheduler_system_func_t func, void* user, ecs_mask_t read_mask, ecs_mask_t write_mask)
+{
+	if (scheduler->system_count >= _countof(scheduler->systems))
+	{
+		debug_print(k_print_warning, "Out of scheduler systems.\n");
+		return -1;
+	}
+
+	int index = scheduler->system_count++;
+	system_t* system = &scheduler->systems[index];
+	memset(system, 0, sizeof(*system));
+	strcpy_s(system->name, sizeof(system->name), name);
+	system->func = func;
+	system->user = user;
+	system->read_mask = read_mask;
+	system->write_mask = write_mask;
+	ecs_mask_t all = SCHEDULER_EXCLUSIVE;
+	system->exclusive = ecs_mask_equals(&write_mask, &all);
+	scheduler->graph_dirty = true;
+	return index;
+}
+
+void scheduler_run(scheduler_t* scheduler)
+{
+	if (scheduler->graph_dirty)
+	{
+		build_graph(scheduler);
+	}
+	if (scheduler->system_count == 0)
+	{
+		return;
+	}
+
+	if (scheduler->worker_count == 0)
+	{
+		// Registration order is a valid topological order.
+		for (int i = 0; i < scheduler->system_count; ++i)
+		{
+			run_system(scheduler, &scheduler->systems[i], 0);
+		}
+	}
+	else
+	{
+		for (int i = 0; i < scheduler->system_count; ++i)
+		{
+			scheduler->systems[i].pending = scheduler->systems[i].predecessor_count;
+		}
+		scheduler->remaining = scheduler->system_count;
+		for (int i = 0; i < scheduler->system_count; ++i)
+		{
+			if (scheduler->systems[i].predecessor_count == 0)
+			{
+				queue_push(scheduler->ready_queue, &scheduler->systems[i]);
+			}
+		}
+		semaphore_acquire(scheduler->frame_done);
+	}
+
+	if (scheduler->tracing)
+	{
+		record_trace(scheduler);
+	}
+}
+
+void scheduler_trace_start(scheduler_t* scheduler, const char* path)
+{
+	if (!scheduler->trace_events)
+	{
+		scheduler->trace_events = heap_alloc(scheduler->heap, sizeof(trace_event_t) * k_trace_capacity, 8);
+	}
+	strcpy_s(scheduler->trace_path, sizeof(scheduler->trace_path), path);
+	scheduler->trace_start_ticks = timer_get_ticks();
+	scheduler->trace_frame = 0;
+	scheduler->trace_count = 0;
+	scheduler->tracing = true;
+}
+
+void scheduler_trace_stop(scheduler_t* scheduler)
+{
+	scheduler->tracing = false;
+
+	FILE* file = NULL;
+	if (fopen_s(&file, scheduler->trace_path, "w") != 0 || !file)
+	{
+		debug_print(k_print_error, "Failed to open schedule trace %s.\n", scheduler->trace_path);
+		return;
+	}
+
+	// Worker threads get one track each; the critical path gets a track after them.
+	int worker_tracks = __max(scheduler->worker_count, 1);
+	fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	for (int i = 0; i <= worker_tracks; ++i)
+	{
+		if (i < worker_tracks)
+		{
+			fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, \"args\": {\"name\": \"worker %d\"}},\n", i, i);
+		}
+		else
+		{
+			fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, \"args\": {\"name\": \"critical path\"}},\n", i);
+		}
+	}
+	for (int i = 0; i < scheduler->trace_count; ++i)
+	{
+		trace_event_t* event = &scheduler->trace_events[i];
+		uint64_t ts = timer_ticks_to_us(event->start_ticks - scheduler->trace_start_ticks);
+		uint64_t dur = timer_ticks_to_us(event->end_ticks - event->start_ticks);
+		int tid = event->critical ? worker_tracks : event->worker;
+		fprintf(file, "{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"ts\": %llu, \"dur\": %llu, \"args\": {\"frame\": %d}}%s\n",
+			scheduler->systems[event->system].name, tid, ts, dur, event->frame,
+			i + 1 < scheduler->trace_count ? "," : "");
+	}
+	fprintf(file, "]}\n");
+	fclose(file);
+}
+
+static int worker_thread_func(void* user)
+{
+	worker_t* worker = user;
+	scheduler_t* scheduler = worker->scheduler;
+	while (true)
+	{
+		system_t* system = queue_pop(scheduler->ready_queue);
+		if (system == NULL)
+		{
+			break;
+		}
+
+		run_system(scheduler, system, worker->index);
+
+		for (int i = 0; i < scheduler->system_count; ++i)
+		{
+			if ((system->successors & (1ULL << i)) && atomic_decrement(&scheduler->systems[i].pending) == 1)
+			{
+				queue_push(scheduler->ready_queue, &scheduler->systems[i]);
+			}
+		}
+		if (atomic_decrement(&scheduler->remaining) == 1)
+		{
+			semaphore_release(scheduler->frame_done);
+		}
+	}
+	return 0;
+}
+
+static void run_system(scheduler_t* scheduler, system_t* system, int worker)
+{
+	system->worker = worker;
+	system->start_ticks = timer_get_ticks();
+	system->func(system->user);
+	system->end_ticks = timer_get_ticks();
+}
+
+static void build_graph(scheduler_t* scheduler)
+{
+	for (int j = 0; j < scheduler->system_count; ++j)
+	{
+		system_t* later = &scheduler->systems[j];
+		later->predecessors = 0;
+		later->successors = 0;
+		later->predecessor_count = 0;
+		ecs_mask_t later_access = ecs_mask_or(later->read_mask, later->write_mask);
+		for (int i = 0; i < j; ++i)
+		{
+			system_t* earlier = &scheduler->systems[i];
+			bool conflict = earlier->exclusive || later->exclusive ||
+				ecs_mask_contains_any(&earlier->write_mask, &later_access) ||
+				ecs_mask_contains_any(&earlier->read_mask, &later->write_mask);
+			if (conflict)
+			{
+				later->predecessors |= 1ULL << i;
+				later->predecessor_count++;
+				earlier->successors |= 1ULL << j;
+			}
+		}
+	}
+	scheduler->graph_dirty = false;
+}
+
+static void record_trace(scheduler_t* scheduler)
+{
+	if (scheduler->trace_count + 2 * scheduler->system_count > k_trace_capacity)
+	{
+		return;
+	}
+
+	// Longest path through the graph, weighted by measured durations.
+	// Registration order is topological, so one forward pass suffices.
+	uint64_t path_ticks[k_max_systems];
+	int path_prev[k_max_systems];
+	int last = 0;
+	for (int j = 0; j < scheduler->system_count; ++j)
+	{
+		system_t* system = &scheduler->systems[j];
+		path_ticks[j] = 0;
+		path_prev[j] = -1;
+		for (int i = 0; i < j; ++i)
+		{
+			if ((system->predecessors & (1ULL << i)) && path_ticks[i] > path_ticks[j])
+			{
+				path_ticks[j] = path_ticks[i];
+				path_prev[j] = i;
+			}
+		}
+		path_ticks[j] += system->end_ticks - system->start_ticks;
+		if (path_ticks[j] > path_ticks[last])
+		{
+			last = j;
+		}
+	}
+
+	for (int i = 0; i < scheduler->system_count; ++i)
+	{
+		system_t* system = &scheduler->systems[i];
+		scheduler->trace_events[scheduler->trace_count++] = (trace_event_t)
+		{
+			.system = i,
+			.worker = system->worker,
+			.frame = scheduler->trace_frame,
+			.critical = false,
+			.start_ticks = system->start_ticks,
+			.end_ticks = system->end_ticks,
+		};
+	}
+	for (int i = last; i >= 0; i = path_prev[i])
+	{
+		system_t* system = &scheduler->systems[i];
+		scheduler->trace_events[scheduler->trace_count++] = (trace_event_t)
+		{
+			.system = i,
+			.worker = system->worker,
+			.frame = scheduler->trace_frame,
+			.critical = true,
+			.start_ticks = system->start_ticks,
+			.end_ticks = system->end_ticks,
+		};
+	}
+	scheduler->trace_frame++;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+// System Scheduler
+// Runs game systems on worker threads.
+// Each system declares the component types it reads and writes; systems whose
+// accesses do not conflict run concurrently, others run in registration order.
+
+#include "ecs_mask.h"
+
+#include <stdint.h>
+
+typedef struct heap_t heap_t;
+
+// Handle to a system scheduler.
+typedef struct scheduler_t scheduler_t;
+
+// Function run once per frame for a system.
+typedef void (*scheduler_system_func_t)(void* user);
+
+// Write mask for systems that must run alone, e.g. ones that call ecs_update()
+// or spawn and remove entities. Such systems are ordered against every other system,
+// including ones with empty masks.
+#define SCHEDULER_EXCLUSIVE (ecs_mask_all())
+
+// Create a system scheduler.
+// With zero workers, systems run serially on the thread calling scheduler_run().
+scheduler_t* scheduler_create(heap_t* heap, int worker_count);
+
+// Destroy a system scheduler, stopping its worker threads.
+void scheduler_destroy(scheduler_t* scheduler);
+
+// Register a system.
+// Read and write masks are entity component type masks.
+// A system depends on every earlier system that writes what it reads or writes,
+// or reads what it writes.
+// Returns the index of the system, or -1 if out of space.
+int scheduler_add_system(scheduler_t* scheduler, const char* name, scheduler_system_func_t func, void* user, ecs_mask_t read_mask, ecs_mask_t write_mask);
+
+// Run every system once, blocking until all are complete.
+void scheduler_run(scheduler_t* scheduler);
+
+// Start recording system schedules.
+// A Chrome trace file will be written to path, including each frame's critical path.
+void scheduler_trace_start(scheduler_t* scheduler, const char* path);
+
+// Stop recording system schedules and write the trace file.
+void scheduler_trace_stop(scheduler_t* scheduler);
@@ -0,0 +1,26 @@
+#version 450
+
+layout (location = 0) in vec3 inPos;
+
+// Per-instance data; see k_gpu_instance_layout_m4444_c444.
+layout (location = 2) in mat4 inModelMatrix;
+layout (location = 6) in vec3 inColor;
+
+layout (binding = 0) uniform UBO 
+{
+	mat4 projectionMatrix;
+	mat4 viewMatrix;
+} ubo;
+
+layout (location = 0) out vec3 outColor;
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+void main()
+{
+	outColor = inColor;
+	gl_Position = ubo.projectionMatrix * ubo.viewMatrix * inModelMatrix * vec4(inPos.xyz, 1.0);
+}
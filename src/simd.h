@@ -0,0 +1,418 @@
+#pragma once
+
+// SIMD support.
+// Thin 4-wide float vector abstraction over SSE, NEON, or plain scalar code,
+// plus an 8-wide vector that is one AVX register or a pair of 4-wide vectors.
+// The instruction set is selected at compile time; define SIMD_FORCE_SCALAR
+// to build the scalar fallback on any target.
+
+#if !defined(SIMD_FORCE_SCALAR) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__))
+#define SIMD_SSE 1
+#include <xmmintrin.h>
+#if defined(__AVX__)
+#define SIMD_AVX 1
+#include <immintrin.h>
+#endif
+#elif !defined(SIMD_FORCE_SCALAR) && (defined(_M_ARM64) || defined(__ARM_NEON))
+#define SIMD_NEON 1
+#include <arm_neon.h>
+#else
+#define SIMD_SCALAR 1
+#include <math.h>
+#include <stdlib.h>
+#endif
+
+// Four packed floats.
+#if defined(SIMD_SSE)
+typedef __m128 simd4f_t;
+#elif defined(SIMD_NEON)
+typedef float32x4_t simd4f_t;
+#else
+typedef struct simd4f_t
+{
+	float f[4];
+} simd4f_t;
+#endif
+
+// Name of the instruction set in use.
+__forceinline const char* simd_get_instruction_set()
+{
+#if defined(SIMD_AVX)
+	return "AVX";
+#elif defined(SIMD_SSE)
+	return "SSE";
+#elif defined(SIMD_NEON)
+	return "NEON";
+#else
+	return "scalar";
+#endif
+}
+
+// Load four floats from any address.
+__forceinline simd4f_t simd4f_load(const float* p)
+{
+#if defined(SIMD_SSE)
+	return _mm_loadu_ps(p);
+#elif defined(SIMD_NEON)
+	return vld1q_f32(p);
+#else
+	return (simd4f_t) { .f = { p[0], p[1], p[2], p[3] } };
+#endif
+}
+
+// Store four floats to any address.
+__forceinline void simd4f_store(float* p, simd4f_t v)
+{
+#if defined(SIMD_SSE)
+	_mm_storeu_ps(p, v);
+#elif defined(SIMD_NEON)
+	vst1q_f32(p, v);
+#else
+	p[0] = v.f[0]; p[1] = v.f[1]; p[2] = v.f[2]; p[3] = v.f[3];
+#endif
+}
+
+// Make a vector from four floats.
+__forceinline simd4f_t simd4f_set(float x, float y, float z, float w)
+{
+#if defined(SIMD_SSE)
+	return _mm_setr_ps(x, y, z, w);
+#elif defined(SIMD_NEON)
+	float tmp[4] = { x, y, z, w };
+	return vld1q_f32(tmp);
+#else
+	return (simd4f_t) { .f = { x, y, z, w } };
+#endif
+}
+
+// Make a vector with every lane set to s.
+__forceinline simd4f_t simd4f_splat(float s)
+{
+#if defined(SIMD_SSE)
+	return _mm_set1_ps(s);
+#elif defined(SIMD_NEON)
+	return vdupq_n_f32(s);
+#else
+	return (simd4f_t) { .f = { s, s, s, s } };
+#endif
+}
+
+// Make a vector with every lane zero.
+__forceinline simd4f_t simd4f_zero()
+{
+	return simd4f_splat(0.0f);
+}
+
+// Get lane 0 of a vector.
+__forceinline float simd4f_get_x(simd4f_t v)
+{
+#if defined(SIMD_SSE)
+	return _mm_cvtss_f32(v);
+#elif defined(SIMD_NEON)
+	return vgetq_lane_f32(v, 0);
+#else
+	return v.f[0];
+#endif
+}
+
+__forceinline simd4f_t simd4f_add(simd4f_t a, simd4f_t b)
+{
+#if defined(SIMD_SSE)
+	return _mm_add_ps(a, b);
+#elif defined(SIMD_NEON)
+	return vaddq_f32(a, b);
+#else
+	return (simd4f_t) { .f = { a.f[0] + b.f[0], a.f[1] + b.f[1], a.f[2] + b.f[2], a.f[3] + b.f[3] } };
+#endif
+}
+
+__forceinline simd4f_t simd4f_sub(simd4f_t a, simd4f_t b)
+{
+#if defined(SIMD_SSE)
+	return _mm_sub_ps(a, b);
+#elif defined(SIMD_NEON)
+	return vsubq_f32(a, b);
+#else
+	return (simd4f_t) { .f = { a.f[0] - b.f[0], a.f[1] - b.f[1], a.f[2] - b.f[2], a.f[3] - b.f[3] } };
+#endif
+}
+
+__forceinline simd4f_t simd4f_mul(simd4f_t a, simd4f_t b)
+{
+#if defined(SIMD_SSE)
+	return _mm_mul_ps(a, b);
+#elif defined(SIMD_NEON)
+	return vmulq_f32(a, b);
+#else
+	return (simd4f_t) { .f = { a.f[0] * b.f[0], a.f[1] * b.f[1], a.f[2] * b.f[2], a.f[3] * b.f[3] } };
+#endif
+}
+
+__forceinline simd4f_t simd4f_div(simd4f_t a, simd4f_t b)
+{
+#if defined(SIMD_SSE)
+	return _mm_div_ps(a, b);
+#elif defined(SIMD_NEON)
+	return vdivq_f32(a, b);
+#else
+	return (simd4f_t) { .f = { a.f[0] / b.f[0], a.f[1] / b.f[1], a.f[2] / b.f[2], a.f[3] / b.f[3] } };
+#endif
+}
+
+__forceinline simd4f_t simd4f_sqrt(simd4f_t v)
+{
+#if defined(SIMD_SSE)
+	return _mm_sqrt_ps(v);
+#elif defined(SIMD_NEON)
+	return vsqrtq_f32(v);
+#else
+	return (simd4f_t) { .f = { sqrtf(v.f[0]), sqrtf(v.f[1]), sqrtf(v.f[2]), sqrtf(v.f[3]) } };
+#endif
+}
+
+// Lane-wise minimum.
+__forceinline simd4f_t simd4f_min(simd4f_t a, simd4f_t b)
+{
+#if defined(SIMD_SSE)
+	return _mm_min_ps(a, b);
+#elif defined(SIMD_NEON)
+	return vminq_f32(a, b);
+#else
+	return (simd4f_t) { .f = { __min(a.f[0], b.f[0]), __min(a.f[1], b.f[1]), __min(a.f[2], b.f[2]), __min(a.f[3], b.f[3]) } };
+#endif
+}
+
+// Lane-wise maximum.
+__forceinline simd4f_t simd4f_max(simd4f_t a, simd4f_t b)
+{
+#if defined(SIMD_SSE)
+	return _mm_max_ps(a, b);
+#elif defined(SIMD_NEON)
+	return vmaxq_f32(a, b);
+#else
+	return (simd4f_t) { .f = { __max(a.f[0], b.f[0]), __max(a.f[1], b.f[1]), __max(a.f[2], b.f[2]), __max(a.f[3], b.f[3]) } };
+#endif
+}
+
+// Compute a * b + c.
+__forceinline simd4f_t simd4f_madd(simd4f_t a, simd4f_t b, simd4f_t c)
+{
+#if defined(SIMD_NEON)
+	return vmlaq_f32(c, a, b);
+#else
+	return simd4f_add(simd4f_mul(a, b), c);
+#endif
+}
+
+// Compute c - a * b.
+__forceinline simd4f_t simd4f_nmadd(simd4f_t a, simd4f_t b, simd4f_t c)
+{
+#if defined(SIMD_NEON)
+	return vmlsq_f32(c, a, b);
+#else
+	return simd4f_sub(c, simd4f_mul(a, b));
+#endif
+}
+
+// Lanes x and y from a followed by lanes z and w from b,
+// each picked by lane index 0-3. Indices must be compile-time constants.
+#if defined(SIMD_SSE)
+#define simd4f_shuffle(a, b, x, y, z, w) _mm_shuffle_ps((a), (b), _MM_SHUFFLE((w), (z), (y), (x)))
+#elif defined(SIMD_NEON)
+#define simd4f_shuffle(a, b, x, y, z, w) simd4f_shuffle_lanes((a), (b), (x), (y), (z), (w))
+__forceinline simd4f_t simd4f_shuffle_lanes(simd4f_t a, simd4f_t b, int x, int y, int z, int w)
+{
+	float fa[4], fb[4];
+	vst1q_f32(fa, a);
+	vst1q_f32(fb, b);
+	float tmp[4] = { fa[x], fa[y], fb[z], fb[w] };
+	return vld1q_f32(tmp);
+}
+#else
+#define simd4f_shuffle(a, b, x, y, z, w) ((simd4f_t) { .f = { (a).f[(x)], (a).f[(y)], (b).f[(z)], (b).f[(w)] } })
+#endif
+
+// Broadcast a lane of v, chosen by compile-time constant index, to every lane.
+#define simd4f_splat_lane(v, i) simd4f_shuffle((v), (v), (i), (i), (i), (i))
+
+// Transpose four row vectors in place.
+__forceinline void simd4f_transpose(simd4f_t* r0, simd4f_t* r1, simd4f_t* r2, simd4f_t* r3)
+{
+#if defined(SIMD_SSE)
+	_MM_TRANSPOSE4_PS(*r0, *r1, *r2, *r3);
+#else
+	simd4f_t t0 = simd4f_shuffle(*r0, *r1, 0, 1, 0, 1);
+	simd4f_t t1 = simd4f_shuffle(*r0, *r1, 2, 3, 2, 3);
+	simd4f_t t2 = simd4f_shuffle(*r2, *r3, 0, 1, 0, 1);
+	simd4f_t t3 = simd4f_shuffle(*r2, *r3, 2, 3, 2, 3);
+	*r0 = simd4f_shuffle(t0, t2, 0, 2, 0, 2);
+	*r1 = simd4f_shuffle(t0, t2, 1, 3, 1, 3);
+	*r2 = simd4f_shuffle(t1, t3, 0, 2, 0, 2);
+	*r3 = simd4f_shuffle(t1, t3, 1, 3, 1, 3);
+#endif
+}
+
+// Sum of all four lanes, broadcast to every lane.
+__forceinline simd4f_t simd4f_sum(simd4f_t v)
+{
+	simd4f_t s = simd4f_add(v, simd4f_shuffle(v, v, 1, 0, 3, 2));
+	return simd4f_add(s, simd4f_shuffle(s, s, 2, 3, 0, 1));
+}
+
+// Eight packed floats.
+// One 256-bit register with AVX, otherwise a pair of four-wide vectors.
+#if defined(SIMD_AVX)
+typedef __m256 simd8f_t;
+#else
+typedef struct simd8f_t
+{
+	simd4f_t lo;
+	simd4f_t hi;
+} simd8f_t;
+#endif
+
+// Load eight floats from any address.
+__forceinline simd8f_t simd8f_load(const float* p)
+{
+#if defined(SIMD_AVX)
+	return _mm256_loadu_ps(p);
+#else
+	return (simd8f_t) { simd4f_load(p), simd4f_load(p + 4) };
+#endif
+}
+
+// Store eight floats to any address.
+__forceinline void simd8f_store(float* p, simd8f_t v)
+{
+#if defined(SIMD_AVX)
+	_mm256_storeu_ps(p, v);
+#else
+	simd4f_store(p, v.lo);
+	simd4f_store(p + 4, v.hi);
+#endif
+}
+
+// Make a vector with every lane set to s.
+__forceinline simd8f_t simd8f_splat(float s)
+{
+#if defined(SIMD_AVX)
+	return _mm256_set1_ps(s);
+#else
+	return (simd8f_t) { simd4f_splat(s), simd4f_splat(s) };
+#endif
+}
+
+// Make a vector from a low and a high half.
+__forceinline simd8f_t simd8f_combine(simd4f_t lo, simd4f_t hi)
+{
+#if defined(SIMD_AVX)
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+#else
+	return (simd8f_t) { lo, hi };
+#endif
+}
+
+// Get lanes 0-3 of a vector.
+__forceinline simd4f_t simd8f_get_low(simd8f_t v)
+{
+#if defined(SIMD_AVX)
+	return _mm256_castps256_ps128(v);
+#else
+	return v.lo;
+#endif
+}
+
+// Get lanes 4-7 of a vector.
+__forceinline simd4f_t simd8f_get_high(simd8f_t v)
+{
+#if defined(SIMD_AVX)
+	return _mm256_extractf128_ps(v, 1);
+#else
+	return v.hi;
+#endif
+}
+
+__forceinline simd8f_t simd8f_add(simd8f_t a, simd8f_t b)
+{
+#if defined(SIMD_AVX)
+	return _mm256_add_ps(a, b);
+#else
+	return (simd8f_t) { simd4f_add(a.lo, b.lo), simd4f_add(a.hi, b.hi) };
+#endif
+}
+
+__forceinline simd8f_t simd8f_sub(simd8f_t a, simd8f_t b)
+{
+#if defined(SIMD_AVX)
+	return _mm256_sub_ps(a, b);
+#else
+	return (simd8f_t) { simd4f_sub(a.lo, b.lo), simd4f_sub(a.hi, b.hi) };
+#endif
+}
+
+__forceinline simd8f_t simd8f_mul(simd8f_t a, simd8f_t b)
+{
+#if defined(SIMD_AVX)
+	return _mm256_mul_ps(a, b);
+#else
+	return (simd8f_t) { simd4f_mul(a.lo, b.lo), simd4f_mul(a.hi, b.hi) };
+#endif
+}
+
+__forceinline simd8f_t simd8f_div(simd8f_t a, simd8f_t b)
+{
+#if defined(SIMD_AVX)
+	return _mm256_div_ps(a, b);
+#else
+	return (simd8f_t) { simd4f_div(a.lo, b.lo), simd4f_div(a.hi, b.hi) };
+#endif
+}
+
+__forceinline simd8f_t simd8f_sqrt(simd8f_t v)
+{
+#if defined(SIMD_AVX)
+	return _mm256_sqrt_ps(v);
+#else
+	return (simd8f_t) { simd4f_sqrt(v.lo), simd4f_sqrt(v.hi) };
+#endif
+}
+
+// Compute a * b + c.
+__forceinline simd8f_t simd8f_madd(simd8f_t a, simd8f_t b, simd8f_t c)
+{
+#if defined(SIMD_AVX)
+	return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#else
+	return (simd8f_t) { simd4f_madd(a.lo, b.lo, c.lo), simd4f_madd(a.hi, b.hi, c.hi) };
+#endif
+}
+
+// Compute c - a * b.
+__forceinline simd8f_t simd8f_nmadd(simd8f_t a, simd8f_t b, simd8f_t c)
+{
+#if defined(SIMD_AVX)
+	return _mm256_sub_ps(c, _mm256_mul_ps(a, b));
+#else
+	return (simd8f_t) { simd4f_nmadd(a.lo, b.lo, c.lo), simd4f_nmadd(a.hi, b.hi, c.hi) };
+#endif
+}
+
+// Lane-wise minimum.
+__forceinline simd8f_t simd8f_min(simd8f_t a, simd8f_t b)
+{
+#if defined(SIMD_AVX)
+	return _mm256_min_ps(a, b);
+#else
+	return (simd8f_t) { simd4f_min(a.lo, b.lo), simd4f_min(a.hi, b.hi) };
+#endif
+}
+
+// Lane-wise maximum.
+__forceinline simd8f_t simd8f_max(simd8f_t a, simd8f_t b)
+{
+#if defined(SIMD_AVX)
+	return _mm256_max_ps(a, b);
+#else
+	return (simd8f_t) { simd4f_max(a.lo, b.lo), simd4f_max(a.hi, b.hi) };
+#endif
+}
@@ -15,6 +15,11 @@
 #include <math.h>
 #include <string.h>
 
+enum
+{
+	k_max_entities = 512,
+};
+
 typedef struct transform_component_t
 {
 	transform_t transform;
@@ -84,12 +89,12 @@ simple_game_t* simple_game_create(heap_t* heap, fs_t* fs, wm_window_t* window, r
 
 	game->timer = timer_object_create(heap, NULL);
 	
-	game->ecs = ecs_create(heap);
-	game->transform_type = ecs_register_component_type(game->ecs, "transform", sizeof(transform_component_t), _Alignof(transform_component_t));
-	game->camera_type = ecs_register_component_type(game->ecs, "camera", sizeof(camera_component_t), _Alignof(camera_component_t));
-	game->model_type = ecs_register_component_type(game->ecs, "model", sizeof(model_component_t), _Alignof(model_component_t));
-	game->player_type = ecs_register_component_type(game->ecs, "player", sizeof(player_component_t), _Alignof(player_component_t));
-	game->name_type = ecs_register_component_type(game->ecs, "name", sizeof(name_component_t), _Alignof(name_component_t));
+	game->ecs = ecs_create(heap, k_max_entities);
+	game->transform_type = ecs_register_component_type(game->ecs, "transform", sizeof(transform_component_t), _Alignof(transform_component_t), k_ecs_storage_dense);
+	game->camera_type = ecs_register_component_type(game->ecs, "camera", sizeof(camera_component_t), _Alignof(camera_component_t), k_ecs_storage_sparse);
+	game->model_type = ecs_register_component_type(game->ecs, "model", sizeof(model_component_t), _Alignof(model_component_t), k_ecs_storage_dense);
+	game->player_type = ecs_register_component_type(game->ecs, "player", sizeof(player_component_t), _Alignof(player_component_t), k_ecs_storage_sparse);
+	game->name_type = ecs_register_component_type(game->ecs, "name", sizeof(name_component_t), _Alignof(name_component_t), k_ecs_storage_dense);
 
 	game->net = net_create(heap, game->ecs);
 	if (argc >= 2)
@@ -188,22 +193,13 @@ static void unload_resources(simple_game_t* game)
 	fs_work_destroy(game->vertex_shader_work);
 }
 
-static void player_net_configure(ecs_t* ecs, ecs_entity_ref_t entity, int type, void* user)
-{
-	simple_game_t* game = user;
-
-	model_component_t* model_comp = ecs_entity_get_component(ecs, entity, game->model_type, true);
-	model_comp->mesh_info = &game->cube_mesh;
-	model_comp->shader_info = &game->cube_shader;
-}
-
 static void spawn_player(simple_game_t* game, int index)
 {
-	uint64_t k_player_ent_mask =
-		(1ULL << game->transform_type) |
-		(1ULL << game->model_type) |
-		(1ULL << game->player_type) |
-		(1ULL << game->name_type);
+	ecs_mask_t k_player_ent_mask = ECS_MASK(
+		game->transform_type,
+		game->model_type,
+		game->player_type,
+		game->name_type);
 	game->player_ent = ecs_entity_add(game->ecs, k_player_ent_mask);
 
 	transform_component_t* transform_comp = ecs_entity_get_component(game->ecs, game->player_ent, game->transform_type, true);
@@ -219,22 +215,29 @@ static void spawn_player(simple_game_t* game, int index)
 	model_comp->mesh_info = &game->cube_mesh;
 	model_comp->shader_info = &game->cube_shader;
 
-	uint64_t k_player_ent_net_mask =
-		(1ULL << game->transform_type) |
-		(1ULL << game->model_type) |
-		(1ULL << game->name_type);
-	uint64_t k_player_ent_rep_mask =
-		(1ULL << game->transform_type);
-	net_state_register_entity_type(game->net, 0, k_player_ent_net_mask, k_player_ent_rep_mask, player_net_configure, game);
+	ecs_mask_t k_player_ent_net_mask = ECS_MASK(
+		game->transform_type,
+		game->model_type,
+		game->name_type);
+	ecs_mask_t k_player_ent_rep_mask = ECS_MASK(game->transform_type);
+
+	// Remote players are spawned from a prefab; replication fills in their transforms.
+	int player_net_prefab = ecs_register_prefab(game->ecs, k_player_ent_net_mask);
+	transform_comp = ecs_prefab_get_component(game->ecs, player_net_prefab, game->transform_type);
+	transform_identity(&transform_comp->transform);
+	model_comp = ecs_prefab_get_component(game->ecs, player_net_prefab, game->model_type);
+	model_comp->mesh_info = &game->cube_mesh;
+	model_comp->shader_info = &game->cube_shader;
+	net_state_register_entity_type(game->net, 0, player_net_prefab, k_player_ent_rep_mask, NULL, NULL);
 
 	net_state_register_entity_instance(game->net, 0, game->player_ent);
 }
 
 static void spawn_camera(simple_game_t* game)
 {
-	uint64_t k_camera_ent_mask =
-		(1ULL << game->camera_type) |
-		(1ULL << game->name_type);
+	ecs_mask_t k_camera_ent_mask = ECS_MASK(
+		game->camera_type,
+		game->name_type);
 	game->camera_ent = ecs_entity_add(game->ecs, k_camera_ent_mask);
 
 	name_component_t* name_comp = ecs_entity_get_component(game->ecs, game->camera_ent, game->name_type, true);
@@ -255,7 +258,7 @@ static void update_players(simple_game_t* game)
 
 	uint32_t key_mask = wm_get_key_mask(game->window);
 
-	uint64_t k_query_mask = (1ULL << game->transform_type) | (1ULL << game->player_type);
+	ecs_mask_t k_query_mask = ECS_MASK(game->transform_type, game->player_type);
 
 	for (ecs_query_t query = ecs_query_create(game->ecs, k_query_mask);
 		ecs_query_is_valid(game->ecs, &query);
@@ -293,20 +296,20 @@ static void update_players(simple_game_t* game)
 
 static void draw_models(simple_game_t* game)
 {
-	uint64_t k_camera_query_mask = (1ULL << game->camera_type);
+	ecs_mask_t k_camera_query_mask = ECS_MASK(game->camera_type);
 	for (ecs_query_t camera_query = ecs_query_create(game->ecs, k_camera_query_mask);
 		ecs_query_is_valid(game->ecs, &camera_query);
 		ecs_query_next(game->ecs, &camera_query))
 	{
-		camera_component_t* camera_comp = ecs_query_get_component(game->ecs, &camera_query, game->camera_type);
+		const camera_component_t* camera_comp = ecs_query_get_component_const(game->ecs, &camera_query, game->camera_type);
 
-		uint64_t k_model_query_mask = (1ULL << game->transform_type) | (1ULL << game->model_type);
+		ecs_mask_t k_model_query_mask = ECS_MASK(game->transform_type, game->model_type);
 		for (ecs_query_t query = ecs_query_create(game->ecs, k_model_query_mask);
 			ecs_query_is_valid(game->ecs, &query);
 			ecs_query_next(game->ecs, &query))
 		{
-			transform_component_t* transform_comp = ecs_query_get_component(game->ecs, &query, game->transform_type);
-			model_component_t* model_comp = ecs_query_get_component(game->ecs, &query, game->model_type);
+			const transform_component_t* transform_comp = ecs_query_get_component_const(game->ecs, &query, game->transform_type);
+			const model_component_t* model_comp = ecs_query_get_component_const(game->ecs, &query, game->model_type);
 			ecs_entity_ref_t entity_ref = ecs_query_get_entity(game->ecs, &query);
 
 			struct
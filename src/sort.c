@@ -0,0 +1,52 @@
+#include "sort.h"
+
+#include <string.h>
+
+void sort_radix_u64(uint64_t* keys, uint64_t* scratch, int count)
+{
+	// Histogram every byte position in one pass over the keys.
+	int counts[8][256];
+	memset(counts, 0, sizeof(counts));
+	for (int i = 0; i < count; ++i)
+	{
+		uint64_t key = keys[i];
+		for (int b = 0; b < 8; ++b)
+		{
+			counts[b][(key >> (b * 8)) & 0xff]++;
+		}
+	}
+
+	uint64_t* src = keys;
+	uint64_t* dst = scratch;
+	for (int b = 0; b < 8; ++b)
+	{
+		// Skip bytes that are the same in every key.
+		int* byte_counts = counts[b];
+		if (count == 0 || byte_counts[(src[0] >> (b * 8)) & 0xff] == count)
+		{
+			continue;
+		}
+
+		int offsets[256];
+		int offset = 0;
+		for (int d = 0; d < 256; ++d)
+		{
+			offsets[d] = offset;
+			offset += byte_counts[d];
+		}
+		for (int i = 0; i < count; ++i)
+		{
+			uint64_t key = src[i];
+			dst[offsets[(key >> (b * 8)) & 0xff]++] = key;
+		}
+
+		uint64_t* temp = src;
+		src = dst;
+		dst = temp;
+	}
+
+	if (src != keys)
+	{
+		memcpy(keys, src, sizeof(uint64_t) * count);
+	}
+}
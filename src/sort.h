@@ -0,0 +1,10 @@
+#pragma once
+
+// Sorting Support
+
+#include <stdint.h>
+
+// Sort count 64-bit keys in increasing order with a stable radix sort.
+// Scratch must hold count keys. Passes over bytes that are equal in every key are skipped,
+// so keys that differ only in a few bytes sort in few passes.
+void sort_radix_u64(uint64_t* keys, uint64_t* scratch, int count);
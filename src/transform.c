@@ -1,5 +1,12 @@
 #include "transform.h"
 
+#include "simd.h"
+
+// Gather and scatter treat a transform as ten consecutive floats.
+_Static_assert(sizeof(transform_t) == 10 * sizeof(float), "transform_t must be tightly packed");
+
+static void transform_to_matrix_x4(const transform_x4_t* transform, char* output, size_t output_stride);
+
 void transform_identity(transform_t* transform)
 {
 	transform->translation = vec3f_zero();
@@ -75,3 +82,156 @@ vec3f_t transform_transform_vec3(const transform_t* transform, vec3f_t v)
 	const vec3f_t rotated_translation = quatf_rotate_vec(transform->rotation, scaled_vector);
 	return vec3f_add(rotated_translation, transform->translation);
 }
+
+void transform_to_matrix_batch(const void* transforms, size_t transform_stride, int count, void* output, size_t output_stride)
+{
+	const char* in = transforms;
+	char* out = output;
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		transform_x4_t transform;
+		transform_x4_gather(&transform, in + transform_stride * i, transform_stride);
+		transform_to_matrix_x4(&transform, out + output_stride * i, output_stride);
+	}
+	for (; i < count; ++i)
+	{
+		transform_to_matrix((const transform_t*)(in + transform_stride * i), (mat4f_t*)(out + output_stride * i));
+	}
+}
+
+void transform_to_matrix_soa(const transform_soa_t* transforms, int count, void* output, size_t output_stride)
+{
+	char* out = output;
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		transform_x4_t transform =
+		{
+			.translation = vec3f_x4_load(&transforms->translation_x[i], &transforms->translation_y[i], &transforms->translation_z[i]),
+			.scale = vec3f_x4_load(&transforms->scale_x[i], &transforms->scale_y[i], &transforms->scale_z[i]),
+			.rotation =
+			{
+				simd4f_load(&transforms->rotation_x[i]), simd4f_load(&transforms->rotation_y[i]),
+				simd4f_load(&transforms->rotation_z[i]), simd4f_load(&transforms->rotation_w[i]),
+			},
+		};
+		transform_to_matrix_x4(&transform, out + output_stride * i, output_stride);
+	}
+	for (; i < count; ++i)
+	{
+		transform_t transform =
+		{
+			.translation = { .x = transforms->translation_x[i], .y = transforms->translation_y[i], .z = transforms->translation_z[i] },
+			.scale = { .x = transforms->scale_x[i], .y = transforms->scale_y[i], .z = transforms->scale_z[i] },
+			.rotation = { .x = transforms->rotation_x[i], .y = transforms->rotation_y[i], .z = transforms->rotation_z[i], .w = transforms->rotation_w[i] },
+		};
+		transform_to_matrix(&transform, (mat4f_t*)(out + output_stride * i));
+	}
+}
+
+void transform_x4_gather(transform_x4_t* result, const void* transforms, size_t transform_stride)
+{
+	const char* in = transforms;
+	const float* p0 = (const float*)(in + transform_stride * 0);
+	const float* p1 = (const float*)(in + transform_stride * 1);
+	const float* p2 = (const float*)(in + transform_stride * 2);
+	const float* p3 = (const float*)(in + transform_stride * 3);
+
+	// Transpose four AoS transforms into SoA lanes:
+	// floats 0-3 are translation and scale.x, 4-7 scale.yz and rotation.xy, 6-9 the rotation.
+	simd4f_t tx = simd4f_load(p0), ty = simd4f_load(p1), tz = simd4f_load(p2), sx = simd4f_load(p3);
+	simd4f_transpose(&tx, &ty, &tz, &sx);
+	simd4f_t sy = simd4f_load(p0 + 4), sz = simd4f_load(p1 + 4), unused0 = simd4f_load(p2 + 4), unused1 = simd4f_load(p3 + 4);
+	simd4f_transpose(&sy, &sz, &unused0, &unused1);
+	simd4f_t qx = simd4f_load(p0 + 6), qy = simd4f_load(p1 + 6), qz = simd4f_load(p2 + 6), qw = simd4f_load(p3 + 6);
+	simd4f_transpose(&qx, &qy, &qz, &qw);
+
+	result->translation = (vec3f_x4_t) { tx, ty, tz };
+	result->scale = (vec3f_x4_t) { sx, sy, sz };
+	result->rotation = (quatf_x4_t) { qx, qy, qz, qw };
+}
+
+void transform_x4_scatter(void* transforms, size_t transform_stride, const transform_x4_t* transform)
+{
+	// Inverse of the gather; floats 4-7 are stored before 6-9, which rewrite rotation.xy with the same values.
+	simd4f_t r0[4] = { transform->translation.x, transform->translation.y, transform->translation.z, transform->scale.x };
+	simd4f_t r1[4] = { transform->scale.y, transform->scale.z, transform->rotation.x, transform->rotation.y };
+	simd4f_t r2[4] = { transform->rotation.x, transform->rotation.y, transform->rotation.z, transform->rotation.w };
+	simd4f_transpose(&r0[0], &r0[1], &r0[2], &r0[3]);
+	simd4f_transpose(&r1[0], &r1[1], &r1[2], &r1[3]);
+	simd4f_transpose(&r2[0], &r2[1], &r2[2], &r2[3]);
+
+	char* out = transforms;
+	for (int k = 0; k < 4; ++k)
+	{
+		float* p = (float*)(out + transform_stride * k);
+		simd4f_store(p, r0[k]);
+		simd4f_store(p + 4, r1[k]);
+		simd4f_store(p + 6, r2[k]);
+	}
+}
+
+vec3f_x4_t transform_x4_transform_vec3(const transform_x4_t* transform, vec3f_x4_t v)
+{
+	const vec3f_x4_t scaled_vector = vec3f_x4_mul(v, transform->scale);
+	const vec3f_x4_t rotated_translation = vec3f_x4_quat_rotate(transform->rotation, scaled_vector);
+	return vec3f_x4_add(rotated_translation, transform->translation);
+}
+
+// Same math as transform_to_matrix() with one transform per lane.
+static void transform_to_matrix_x4(const transform_x4_t* transform, char* output, size_t output_stride)
+{
+	simd4f_t tx = transform->translation.x, ty = transform->translation.y, tz = transform->translation.z;
+	simd4f_t sx = transform->scale.x, sy = transform->scale.y, sz = transform->scale.z;
+	simd4f_t qx = transform->rotation.x, qy = transform->rotation.y, qz = transform->rotation.z, qw = transform->rotation.w;
+
+	simd4f_t one = simd4f_splat(1.0f);
+	simd4f_t two = simd4f_splat(2.0f);
+	simd4f_t x2 = simd4f_mul(qx, two);
+	simd4f_t y2 = simd4f_mul(qy, two);
+	simd4f_t z2 = simd4f_mul(qz, two);
+	simd4f_t xx = simd4f_mul(qx, x2);
+	simd4f_t yy = simd4f_mul(qy, y2);
+	simd4f_t zz = simd4f_mul(qz, z2);
+	simd4f_t xy = simd4f_mul(qx, y2);
+	simd4f_t xz = simd4f_mul(qx, z2);
+	simd4f_t yz = simd4f_mul(qy, z2);
+	simd4f_t wx = simd4f_mul(qw, x2);
+	simd4f_t wy = simd4f_mul(qw, y2);
+	simd4f_t wz = simd4f_mul(qw, z2);
+
+	simd4f_t m00 = simd4f_mul(sx, simd4f_sub(one, simd4f_add(yy, zz)));
+	simd4f_t m01 = simd4f_mul(sx, simd4f_add(xy, wz));
+	simd4f_t m02 = simd4f_mul(sx, simd4f_sub(xz, wy));
+	simd4f_t m10 = simd4f_mul(sy, simd4f_sub(xy, wz));
+	simd4f_t m11 = simd4f_mul(sy, simd4f_sub(one, simd4f_add(xx, zz)));
+	simd4f_t m12 = simd4f_mul(sy, simd4f_add(yz, wx));
+	simd4f_t m20 = simd4f_mul(sz, simd4f_add(xz, wy));
+	simd4f_t m21 = simd4f_mul(sz, simd4f_sub(yz, wx));
+	simd4f_t m22 = simd4f_mul(sz, simd4f_sub(one, simd4f_add(xx, yy)));
+
+	// Transpose lanes back into one row per matrix.
+	simd4f_t zero = simd4f_zero();
+	simd4f_t w = zero;
+	simd4f_transpose(&m00, &m01, &m02, &w);
+	simd4f_t row0[4] = { m00, m01, m02, w };
+	w = zero;
+	simd4f_transpose(&m10, &m11, &m12, &w);
+	simd4f_t row1[4] = { m10, m11, m12, w };
+	w = zero;
+	simd4f_transpose(&m20, &m21, &m22, &w);
+	simd4f_t row2[4] = { m20, m21, m22, w };
+	w = one;
+	simd4f_transpose(&tx, &ty, &tz, &w);
+	simd4f_t row3[4] = { tx, ty, tz, w };
+
+	for (int k = 0; k < 4; ++k)
+	{
+		mat4f_t* m = (mat4f_t*)(output + output_stride * k);
+		simd4f_store(m->data[0], row0[k]);
+		simd4f_store(m->data[1], row1[k]);
+		simd4f_store(m->data[2], row2[k]);
+		simd4f_store(m->data[3], row3[k]);
+	}
+}
@@ -6,6 +6,7 @@
 #include "mat4f.h"
 #include "quatf.h"
 #include "vec3f.h"
+#include "vec3f_soa.h"
 
 // Transform object.
 typedef struct transform_t
@@ -15,12 +16,45 @@ typedef struct transform_t
 	quatf_t rotation;
 } transform_t;
 
+// Transforms in structure-of-arrays layout, one array per scalar.
+typedef struct transform_soa_t
+{
+	const float* translation_x;
+	const float* translation_y;
+	const float* translation_z;
+	const float* scale_x;
+	const float* scale_y;
+	const float* scale_z;
+	const float* rotation_x;
+	const float* rotation_y;
+	const float* rotation_z;
+	const float* rotation_w;
+} transform_soa_t;
+
+// Four transforms, one SIMD register per component.
+typedef struct transform_x4_t
+{
+	vec3f_x4_t translation;
+	vec3f_x4_t scale;
+	quatf_x4_t rotation;
+} transform_x4_t;
+
 // Make a transform with no rotation, unit scale, and zero position.
 void transform_identity(transform_t* transform);
 
 // Convert a transform to a matrix representation.
 void transform_to_matrix(const transform_t* transform, mat4f_t* output);
 
+// Convert count transforms to matrices, four at a time with SIMD.
+// Transforms are read every transform_stride bytes, so a component array whose
+// elements begin with a transform_t can be passed directly.
+// Matrices are written every output_stride bytes, e.g. straight into per-object uniform blocks.
+void transform_to_matrix_batch(const void* transforms, size_t transform_stride, int count, void* output, size_t output_stride);
+
+// Convert count structure-of-arrays transforms to matrices, four at a time with SIMD.
+// Matrices are written every output_stride bytes.
+void transform_to_matrix_soa(const transform_soa_t* transforms, int count, void* output, size_t output_stride);
+
 // Combine to transforms -- result and t -- and store the output in result.
 void transform_multiply(transform_t* result, const transform_t* t);
 
@@ -29,3 +63,12 @@ void transform_invert(transform_t* transform);
 
 // Transform a vector by a transform object. Return the resulting vector.
 vec3f_t transform_transform_vec3(const transform_t* transform, vec3f_t v);
+
+// Gather four transforms read every transform_stride bytes.
+void transform_x4_gather(transform_x4_t* result, const void* transforms, size_t transform_stride);
+
+// Scatter four transforms to transform_t written every transform_stride bytes.
+void transform_x4_scatter(void* transforms, size_t transform_stride, const transform_x4_t* transform);
+
+// Transform four vectors, each by the matching transform, as transform_transform_vec3() does.
+vec3f_x4_t transform_x4_transform_vec3(const transform_x4_t* transform, vec3f_x4_t v);
@@ -0,0 +1,309 @@
+#pragma once
+
+// Structure-of-arrays vector support.
+// A vec3f_x4_t holds four vectors as one SIMD register per component,
+// so each operation works on four entities at once; vec3f_x8_t holds eight.
+// Gather and scatter convert to and from arrays of vec3f_t at any stride,
+// e.g. a field inside a component array.
+
+#include "quatf.h"
+#include "simd.h"
+#include "vec3f.h"
+
+#include <stddef.h>
+#include <string.h>
+
+// Four 3D vectors, one register per component.
+typedef struct vec3f_x4_t
+{
+	simd4f_t x, y, z;
+} vec3f_x4_t;
+
+// Four quaternions, one register per component.
+typedef struct quatf_x4_t
+{
+	simd4f_t x, y, z, w;
+} quatf_x4_t;
+
+// Eight 3D vectors, one register per component.
+typedef struct vec3f_x8_t
+{
+	simd8f_t x, y, z;
+} vec3f_x8_t;
+
+// Eight quaternions, one register per component.
+typedef struct quatf_x8_t
+{
+	simd8f_t x, y, z, w;
+} quatf_x8_t;
+
+// Load four vectors from separate x, y and z arrays.
+__forceinline vec3f_x4_t vec3f_x4_load(const float* x, const float* y, const float* z)
+{
+	return (vec3f_x4_t) { simd4f_load(x), simd4f_load(y), simd4f_load(z) };
+}
+
+// Store four vectors to separate x, y and z arrays.
+__forceinline void vec3f_x4_store(float* x, float* y, float* z, vec3f_x4_t v)
+{
+	simd4f_store(x, v.x);
+	simd4f_store(y, v.y);
+	simd4f_store(z, v.z);
+}
+
+// Make four copies of a vector.
+__forceinline vec3f_x4_t vec3f_x4_splat(vec3f_t v)
+{
+	return (vec3f_x4_t) { simd4f_splat(v.x), simd4f_splat(v.y), simd4f_splat(v.z) };
+}
+
+// Gather four vec3f_t read every stride bytes.
+__forceinline vec3f_x4_t vec3f_x4_gather(const void* vectors, size_t stride)
+{
+	const char* p = vectors;
+	const vec3f_t* v0 = (const vec3f_t*)(p + stride * 0);
+	const vec3f_t* v1 = (const vec3f_t*)(p + stride * 1);
+	const vec3f_t* v2 = (const vec3f_t*)(p + stride * 2);
+	const vec3f_t* v3 = (const vec3f_t*)(p + stride * 3);
+	simd4f_t r0 = simd4f_set(v0->x, v0->y, v0->z, 0.0f);
+	simd4f_t r1 = simd4f_set(v1->x, v1->y, v1->z, 0.0f);
+	simd4f_t r2 = simd4f_set(v2->x, v2->y, v2->z, 0.0f);
+	simd4f_t r3 = simd4f_set(v3->x, v3->y, v3->z, 0.0f);
+	simd4f_transpose(&r0, &r1, &r2, &r3);
+	return (vec3f_x4_t) { r0, r1, r2 };
+}
+
+// Scatter four vectors to vec3f_t written every stride bytes.
+__forceinline void vec3f_x4_scatter(void* vectors, size_t stride, vec3f_x4_t v)
+{
+	simd4f_t r0 = v.x, r1 = v.y, r2 = v.z, r3 = simd4f_zero();
+	simd4f_transpose(&r0, &r1, &r2, &r3);
+	float rows[4][4];
+	simd4f_store(rows[0], r0);
+	simd4f_store(rows[1], r1);
+	simd4f_store(rows[2], r2);
+	simd4f_store(rows[3], r3);
+	char* p = vectors;
+	for (int i = 0; i < 4; ++i)
+	{
+		memcpy(p + stride * i, rows[i], sizeof(vec3f_t));
+	}
+}
+
+// Gather four quatf_t read every stride bytes.
+__forceinline quatf_x4_t quatf_x4_gather(const void* quats, size_t stride)
+{
+	const char* p = quats;
+	simd4f_t r0 = simd4f_load((const float*)(p + stride * 0));
+	simd4f_t r1 = simd4f_load((const float*)(p + stride * 1));
+	simd4f_t r2 = simd4f_load((const float*)(p + stride * 2));
+	simd4f_t r3 = simd4f_load((const float*)(p + stride * 3));
+	simd4f_transpose(&r0, &r1, &r2, &r3);
+	return (quatf_x4_t) { r0, r1, r2, r3 };
+}
+
+// Scatter four quaternions to quatf_t written every stride bytes.
+__forceinline void quatf_x4_scatter(void* quats, size_t stride, quatf_x4_t q)
+{
+	simd4f_t r0 = q.x, r1 = q.y, r2 = q.z, r3 = q.w;
+	simd4f_transpose(&r0, &r1, &r2, &r3);
+	char* p = quats;
+	simd4f_store((float*)(p + stride * 0), r0);
+	simd4f_store((float*)(p + stride * 1), r1);
+	simd4f_store((float*)(p + stride * 2), r2);
+	simd4f_store((float*)(p + stride * 3), r3);
+}
+
+__forceinline vec3f_x4_t vec3f_x4_add(vec3f_x4_t a, vec3f_x4_t b)
+{
+	return (vec3f_x4_t) { simd4f_add(a.x, b.x), simd4f_add(a.y, b.y), simd4f_add(a.z, b.z) };
+}
+
+__forceinline vec3f_x4_t vec3f_x4_sub(vec3f_x4_t a, vec3f_x4_t b)
+{
+	return (vec3f_x4_t) { simd4f_sub(a.x, b.x), simd4f_sub(a.y, b.y), simd4f_sub(a.z, b.z) };
+}
+
+__forceinline vec3f_x4_t vec3f_x4_mul(vec3f_x4_t a, vec3f_x4_t b)
+{
+	return (vec3f_x4_t) { simd4f_mul(a.x, b.x), simd4f_mul(a.y, b.y), simd4f_mul(a.z, b.z) };
+}
+
+// Scale each vector by the matching lane of f.
+__forceinline vec3f_x4_t vec3f_x4_scale(vec3f_x4_t v, simd4f_t f)
+{
+	return (vec3f_x4_t) { simd4f_mul(v.x, f), simd4f_mul(v.y, f), simd4f_mul(v.z, f) };
+}
+
+// Compute a * f + b, with f per lane.
+__forceinline vec3f_x4_t vec3f_x4_madd(vec3f_x4_t a, simd4f_t f, vec3f_x4_t b)
+{
+	return (vec3f_x4_t) { simd4f_madd(a.x, f, b.x), simd4f_madd(a.y, f, b.y), simd4f_madd(a.z, f, b.z) };
+}
+
+__forceinline simd4f_t vec3f_x4_dot(vec3f_x4_t a, vec3f_x4_t b)
+{
+	return simd4f_madd(a.z, b.z, simd4f_madd(a.y, b.y, simd4f_mul(a.x, b.x)));
+}
+
+__forceinline vec3f_x4_t vec3f_x4_cross(vec3f_x4_t a, vec3f_x4_t b)
+{
+	return (vec3f_x4_t)
+	{
+		simd4f_nmadd(a.z, b.y, simd4f_mul(a.y, b.z)),
+		simd4f_nmadd(a.x, b.z, simd4f_mul(a.z, b.x)),
+		simd4f_nmadd(a.y, b.x, simd4f_mul(a.x, b.y)),
+	};
+}
+
+__forceinline simd4f_t vec3f_x4_mag(vec3f_x4_t v)
+{
+	return simd4f_sqrt(vec3f_x4_dot(v, v));
+}
+
+// Normalize each vector. Zero-length vectors stay zero.
+__forceinline vec3f_x4_t vec3f_x4_norm(vec3f_x4_t v)
+{
+	simd4f_t m = simd4f_max(vec3f_x4_mag(v), simd4f_splat(1e-30f));
+	return vec3f_x4_scale(v, simd4f_div(simd4f_splat(1.0f), m));
+}
+
+// Rotate each vector by the matching quaternion, as quatf_rotate_vec() does.
+__forceinline vec3f_x4_t vec3f_x4_quat_rotate(quatf_x4_t q, vec3f_x4_t v)
+{
+	vec3f_x4_t qv = { q.x, q.y, q.z };
+	vec3f_x4_t t = vec3f_x4_cross(qv, v);
+	t = vec3f_x4_add(t, t);
+	return vec3f_x4_add(vec3f_x4_madd(t, q.w, v), vec3f_x4_cross(qv, t));
+}
+
+// Combine the rotations of matching quaternions, as quatf_mul() does.
+__forceinline quatf_x4_t quatf_x4_mul(quatf_x4_t a, quatf_x4_t b)
+{
+	vec3f_x4_t av = { a.x, a.y, a.z };
+	vec3f_x4_t bv = { b.x, b.y, b.z };
+	vec3f_x4_t v = vec3f_x4_add(vec3f_x4_cross(av, bv), vec3f_x4_madd(bv, a.w, vec3f_x4_scale(av, b.w)));
+	return (quatf_x4_t) { v.x, v.y, v.z, simd4f_sub(simd4f_mul(a.w, b.w), vec3f_x4_dot(av, bv)) };
+}
+
+// Load eight vectors from separate x, y and z arrays.
+__forceinline vec3f_x8_t vec3f_x8_load(const float* x, const float* y, const float* z)
+{
+	return (vec3f_x8_t) { simd8f_load(x), simd8f_load(y), simd8f_load(z) };
+}
+
+// Store eight vectors to separate x, y and z arrays.
+__forceinline void vec3f_x8_store(float* x, float* y, float* z, vec3f_x8_t v)
+{
+	simd8f_store(x, v.x);
+	simd8f_store(y, v.y);
+	simd8f_store(z, v.z);
+}
+
+// Make eight copies of a vector.
+__forceinline vec3f_x8_t vec3f_x8_splat(vec3f_t v)
+{
+	return (vec3f_x8_t) { simd8f_splat(v.x), simd8f_splat(v.y), simd8f_splat(v.z) };
+}
+
+// Gather eight vec3f_t read every stride bytes.
+__forceinline vec3f_x8_t vec3f_x8_gather(const void* vectors, size_t stride)
+{
+	vec3f_x4_t lo = vec3f_x4_gather(vectors, stride);
+	vec3f_x4_t hi = vec3f_x4_gather((const char*)vectors + stride * 4, stride);
+	return (vec3f_x8_t) { simd8f_combine(lo.x, hi.x), simd8f_combine(lo.y, hi.y), simd8f_combine(lo.z, hi.z) };
+}
+
+// Scatter eight vectors to vec3f_t written every stride bytes.
+__forceinline void vec3f_x8_scatter(void* vectors, size_t stride, vec3f_x8_t v)
+{
+	vec3f_x4_scatter(vectors, stride, (vec3f_x4_t) { simd8f_get_low(v.x), simd8f_get_low(v.y), simd8f_get_low(v.z) });
+	vec3f_x4_scatter((char*)vectors + stride * 4, stride, (vec3f_x4_t) { simd8f_get_high(v.x), simd8f_get_high(v.y), simd8f_get_high(v.z) });
+}
+
+// Gather eight quatf_t read every stride bytes.
+__forceinline quatf_x8_t quatf_x8_gather(const void* quats, size_t stride)
+{
+	quatf_x4_t lo = quatf_x4_gather(quats, stride);
+	quatf_x4_t hi = quatf_x4_gather((const char*)quats + stride * 4, stride);
+	return (quatf_x8_t) { simd8f_combine(lo.x, hi.x), simd8f_combine(lo.y, hi.y), simd8f_combine(lo.z, hi.z), simd8f_combine(lo.w, hi.w) };
+}
+
+// Scatter eight quaternions to quatf_t written every stride bytes.
+__forceinline void quatf_x8_scatter(void* quats, size_t stride, quatf_x8_t q)
+{
+	quatf_x4_scatter(quats, stride, (quatf_x4_t) { simd8f_get_low(q.x), simd8f_get_low(q.y), simd8f_get_low(q.z), simd8f_get_low(q.w) });
+	quatf_x4_scatter((char*)quats + stride * 4, stride, (quatf_x4_t) { simd8f_get_high(q.x), simd8f_get_high(q.y), simd8f_get_high(q.z), simd8f_get_high(q.w) });
+}
+
+__forceinline vec3f_x8_t vec3f_x8_add(vec3f_x8_t a, vec3f_x8_t b)
+{
+	return (vec3f_x8_t) { simd8f_add(a.x, b.x), simd8f_add(a.y, b.y), simd8f_add(a.z, b.z) };
+}
+
+__forceinline vec3f_x8_t vec3f_x8_sub(vec3f_x8_t a, vec3f_x8_t b)
+{
+	return (vec3f_x8_t) { simd8f_sub(a.x, b.x), simd8f_sub(a.y, b.y), simd8f_sub(a.z, b.z) };
+}
+
+__forceinline vec3f_x8_t vec3f_x8_mul(vec3f_x8_t a, vec3f_x8_t b)
+{
+	return (vec3f_x8_t) { simd8f_mul(a.x, b.x), simd8f_mul(a.y, b.y), simd8f_mul(a.z, b.z) };
+}
+
+// Scale each vector by the matching lane of f.
+__forceinline vec3f_x8_t vec3f_x8_scale(vec3f_x8_t v, simd8f_t f)
+{
+	return (vec3f_x8_t) { simd8f_mul(v.x, f), simd8f_mul(v.y, f), simd8f_mul(v.z, f) };
+}
+
+// Compute a * f + b, with f per lane.
+__forceinline vec3f_x8_t vec3f_x8_madd(vec3f_x8_t a, simd8f_t f, vec3f_x8_t b)
+{
+	return (vec3f_x8_t) { simd8f_madd(a.x, f, b.x), simd8f_madd(a.y, f, b.y), simd8f_madd(a.z, f, b.z) };
+}
+
+__forceinline simd8f_t vec3f_x8_dot(vec3f_x8_t a, vec3f_x8_t b)
+{
+	return simd8f_madd(a.z, b.z, simd8f_madd(a.y, b.y, simd8f_mul(a.x, b.x)));
+}
+
+__forceinline vec3f_x8_t vec3f_x8_cross(vec3f_x8_t a, vec3f_x8_t b)
+{
+	return (vec3f_x8_t)
+	{
+		simd8f_nmadd(a.z, b.y, simd8f_mul(a.y, b.z)),
+		simd8f_nmadd(a.x, b.z, simd8f_mul(a.z, b.x)),
+		simd8f_nmadd(a.y, b.x, simd8f_mul(a.x, b.y)),
+	};
+}
+
+__forceinline simd8f_t vec3f_x8_mag(vec3f_x8_t v)
+{
+	return simd8f_sqrt(vec3f_x8_dot(v, v));
+}
+
+// Normalize each vector. Zero-length vectors stay zero.
+__forceinline vec3f_x8_t vec3f_x8_norm(vec3f_x8_t v)
+{
+	simd8f_t m = simd8f_max(vec3f_x8_mag(v), simd8f_splat(1e-30f));
+	return vec3f_x8_scale(v, simd8f_div(simd8f_splat(1.0f), m));
+}
+
+// Rotate each vector by the matching quaternion, as quatf_rotate_vec() does.
+__forceinline vec3f_x8_t vec3f_x8_quat_rotate(quatf_x8_t q, vec3f_x8_t v)
+{
+	vec3f_x8_t qv = { q.x, q.y, q.z };
+	vec3f_x8_t t = vec3f_x8_cross(qv, v);
+	t = vec3f_x8_add(t, t);
+	return vec3f_x8_add(vec3f_x8_madd(t, q.w, v), vec3f_x8_cross(qv, t));
+}
+
+// Combine the rotations of matching quaternions, as quatf_mul() does.
+__forceinline quatf_x8_t quatf_x8_mul(quatf_x8_t a, quatf_x8_t b)
+{
+	vec3f_x8_t av = { a.x, a.y, a.z };
+	vec3f_x8_t bv = { b.x, b.y, b.z };
+	vec3f_x8_t v = vec3f_x8_add(vec3f_x8_cross(av, bv), vec3f_x8_madd(bv, a.w, vec3f_x8_scale(av, b.w)));
+	return (quatf_x8_t) { v.x, v.y, v.z, simd8f_sub(simd8f_mul(a.w, b.w), vec3f_x8_dot(av, bv)) };
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+// Packed 4-wide vector support.
+// A vec4f_t holds one SIMD register: an xyz vector with a spare w lane, or a quaternion.
+// Use for math on single values; see vec3f_soa.h to process several entities at once.
+
+#include "quatf.h"
+#include "simd.h"
+#include "vec3f.h"
+
+// Four floats in one SIMD register.
+typedef struct vec4f_t
+{
+	simd4f_t v;
+} vec4f_t;
+
+__forceinline vec4f_t vec4f_set(float x, float y, float z, float w)
+{
+	return (vec4f_t) { simd4f_set(x, y, z, w) };
+}
+
+__forceinline vec4f_t vec4f_splat(float f)
+{
+	return (vec4f_t) { simd4f_splat(f) };
+}
+
+__forceinline vec4f_t vec4f_zero()
+{
+	return (vec4f_t) { simd4f_zero() };
+}
+
+// Load four floats from any address.
+__forceinline vec4f_t vec4f_load(const float* p)
+{
+	return (vec4f_t) { simd4f_load(p) };
+}
+
+// Store four floats to any address.
+__forceinline void vec4f_store(float* p, vec4f_t v)
+{
+	simd4f_store(p, v.v);
+}
+
+// Make a packed vector from a vec3f_t and a w value.
+__forceinline vec4f_t vec4f_from_vec3f(vec3f_t v, float w)
+{
+	return (vec4f_t) { simd4f_set(v.x, v.y, v.z, w) };
+}
+
+// Get the xyz lanes of a packed vector.
+__forceinline vec3f_t vec4f_to_vec3f(vec4f_t v)
+{
+	float f[4];
+	simd4f_store(f, v.v);
+	return (vec3f_t) { .x = f[0], .y = f[1], .z = f[2] };
+}
+
+// Make a packed quaternion from a quatf_t.
+__forceinline vec4f_t vec4f_from_quatf(quatf_t q)
+{
+	return (vec4f_t) { simd4f_set(q.x, q.y, q.z, q.w) };
+}
+
+__forceinline quatf_t vec4f_to_quatf(vec4f_t q)
+{
+	quatf_t result;
+	simd4f_store(&result.x, q.v);
+	return result;
+}
+
+__forceinline vec4f_t vec4f_add(vec4f_t a, vec4f_t b)
+{
+	return (vec4f_t) { simd4f_add(a.v, b.v) };
+}
+
+__forceinline vec4f_t vec4f_sub(vec4f_t a, vec4f_t b)
+{
+	return (vec4f_t) { simd4f_sub(a.v, b.v) };
+}
+
+__forceinline vec4f_t vec4f_mul(vec4f_t a, vec4f_t b)
+{
+	return (vec4f_t) { simd4f_mul(a.v, b.v) };
+}
+
+__forceinline vec4f_t vec4f_scale(vec4f_t v, float f)
+{
+	return (vec4f_t) { simd4f_mul(v.v, simd4f_splat(f)) };
+}
+
+__forceinline vec4f_t vec4f_min(vec4f_t a, vec4f_t b)
+{
+	return (vec4f_t) { simd4f_min(a.v, b.v) };
+}
+
+__forceinline vec4f_t vec4f_max(vec4f_t a, vec4f_t b)
+{
+	return (vec4f_t) { simd4f_max(a.v, b.v) };
+}
+
+// Dot product of all four lanes.
+__forceinline float vec4f_dot(vec4f_t a, vec4f_t b)
+{
+	return simd4f_get_x(simd4f_sum(simd4f_mul(a.v, b.v)));
+}
+
+// Dot product of the xyz lanes.
+__forceinline float vec4f_dot3(vec4f_t a, vec4f_t b)
+{
+	simd4f_t m = simd4f_mul(a.v, b.v);
+	simd4f_t yz = simd4f_add(simd4f_splat_lane(m, 1), simd4f_splat_lane(m, 2));
+	return simd4f_get_x(simd4f_add(m, yz));
+}
+
+// Cross product of the xyz lanes. The w lane of the result is zero for finite input.
+__forceinline vec4f_t vec4f_cross3(vec4f_t a, vec4f_t b)
+{
+	simd4f_t a_yzx = simd4f_shuffle(a.v, a.v, 1, 2, 0, 3);
+	simd4f_t b_yzx = simd4f_shuffle(b.v, b.v, 1, 2, 0, 3);
+	simd4f_t c = simd4f_nmadd(a_yzx, b.v, simd4f_mul(a.v, b_yzx));
+	return (vec4f_t) { simd4f_shuffle(c, c, 1, 2, 0, 3) };
+}
+
+__forceinline float vec4f_mag3(vec4f_t v)
+{
+	return sqrtf(vec4f_dot3(v, v));
+}
+
+// Normalize the xyz lanes, scaling w by the same factor.
+// Vectors of near-zero length are returned unchanged, as with vec3f_norm().
+__forceinline vec4f_t vec4f_norm3(vec4f_t v)
+{
+	float m = vec4f_mag3(v);
+	if (almost_equalf(m, 0.0f))
+	{
+		return v;
+	}
+	return vec4f_scale(v, 1.0f / m);
+}
+
+// Combines the rotation of two packed quaternions -- a and b -- as quatf_mul() does.
+__forceinline vec4f_t vec4f_quat_mul(vec4f_t a, vec4f_t b)
+{
+	simd4f_t a_w = simd4f_splat_lane(a.v, 3);
+	simd4f_t b_w = simd4f_splat_lane(b.v, 3);
+	simd4f_t xyz = simd4f_add(vec4f_cross3(a, b).v, simd4f_madd(b.v, a_w, simd4f_mul(a.v, b_w)));
+	simd4f_t w = simd4f_splat(simd4f_get_x(a_w) * simd4f_get_x(b_w) - vec4f_dot3(a, b));
+
+	// Keep xyz, replace the w lane.
+	simd4f_t zw = simd4f_shuffle(xyz, w, 2, 2, 0, 0);
+	return (vec4f_t) { simd4f_shuffle(xyz, zw, 0, 1, 0, 2) };
+}
+
+// Computes the inverse of a normalized packed quaternion.
+__forceinline vec4f_t vec4f_quat_conjugate(vec4f_t q)
+{
+	return (vec4f_t) { simd4f_mul(q.v, simd4f_set(-1.0f, -1.0f, -1.0f, 1.0f)) };
+}
+
+// Rotates the xyz lanes of v by a packed quaternion, as quatf_rotate_vec() does.
+// The w lane of v passes through unchanged.
+__forceinline vec4f_t vec4f_quat_rotate(vec4f_t q, vec4f_t v)
+{
+	simd4f_t c = vec4f_cross3(q, v).v;
+	simd4f_t t = simd4f_add(c, c);
+	simd4f_t r = simd4f_madd(t, simd4f_splat_lane(q.v, 3), v.v);
+	return (vec4f_t) { simd4f_add(r, vec4f_cross3(q, (vec4f_t) { t }).v) };
+}
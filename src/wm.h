@@ -27,6 +27,8 @@ enum
 	k_key_down = 1 << 1,
 	k_key_left = 1 << 2,
 	k_key_right = 1 << 3,
+	k_key_save = 1 << 4,
+	k_key_load = 1 << 5,
 };
 
 